@@ -0,0 +1,70 @@
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+namespace {
+thread_local int thread_counters = 0;
+thread_local uint64_t thread_allocations = 0;
+atomic<int> process_counters{ 0 };
+atomic<uint64_t> process_allocations{ 0 };
+
+uint64_t GetAllocations(AllocationCounter::Scope scope) {
+    return scope == AllocationCounter::Scope::THREAD ? thread_allocations
+        : process_allocations.load(memory_order_relaxed);
+}
+}
+
+AllocationCounter::AllocationCounter(Scope scope)
+    : scope_(scope)
+    , start_(GetAllocations(scope)) {
+    if (scope_ == Scope::THREAD) {
+        ++thread_counters;
+    } else {
+        process_counters.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+AllocationCounter::~AllocationCounter() {
+    if (scope_ == Scope::THREAD) {
+        --thread_counters;
+    } else {
+        process_counters.fetch_sub(1, memory_order_relaxed);
+    }
+}
+
+uint64_t AllocationCounter::GetCount() const {
+    return GetAllocations(scope_) - start_;
+}
+
+void* operator new(size_t size) {
+    if (thread_counters != 0) {
+        ++thread_allocations;
+    }
+    if (process_counters.load(memory_order_relaxed) != 0) {
+        process_allocations.fetch_add(1, memory_order_relaxed);
+    }
+    if (void* ptr = malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw bad_alloc();
+}
+
+// GCC принимает free в заменённом operator delete за несовпадение с new
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts calls of the global operator new, which allocation_counter.cpp replaces, from its
+// construction on. While no counter exists an allocation costs one extra relaxed load
+class AllocationCounter {
+public:
+    enum class Scope {
+        // allocations of the thread that created the counter
+        THREAD,
+        // allocations of every thread: each of them is an atomic add
+        PROCESS,
+    };
+
+    explicit AllocationCounter(Scope scope = Scope::THREAD);
+    ~AllocationCounter();
+
+    AllocationCounter(const AllocationCounter&) = delete;
+    AllocationCounter& operator=(const AllocationCounter&) = delete;
+
+    uint64_t GetCount() const;
+
+private:
+    const Scope scope_;
+    const uint64_t start_;
+};
@@ -0,0 +1,798 @@
+#include "benchmark.h"
+
+#include "allocation_counter.h"
+#include "document_loader.h"
+#include "paginator.h"
+#include "process_queries.h"
+#include "query_context.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// The output of mt19937 is fixed by the standard, that of its distributions is not
+uint32_t DrawBelow(mt19937& generator, uint32_t bound) {
+    return static_cast<uint32_t>(uint64_t{ generator() } * bound >> 32);
+}
+
+double DrawUnit(mt19937& generator) {
+    return generator() / 4294967296.0;
+}
+
+template <typename Container>
+void Shuffle(mt19937& generator, Container& container) {
+    for (size_t i = container.size(); i > 1; --i) {
+        swap(container[i - 1], container[DrawBelow(generator, static_cast<uint32_t>(i))]);
+    }
+}
+
+vector<string> GenerateVocabulary(mt19937& generator, int size) {
+    vector<string> vocabulary;
+    unordered_set<string> seen;
+    while (vocabulary.size() < static_cast<size_t>(size)) {
+        string word(3 + DrawBelow(generator, 8), ' ');
+        for (char& letter : word) {
+            letter = static_cast<char>('a' + DrawBelow(generator, 26));
+        }
+        if (seen.insert(word).second) {
+            vocabulary.push_back(move(word));
+        }
+    }
+    return vocabulary;
+}
+
+// Draws ranks of the vocabulary, uniformly or by Zipf's law
+class WordSampler {
+public:
+    WordSampler(int vocabulary_size, double zipf_exponent)
+        : vocabulary_size_(static_cast<uint32_t>(vocabulary_size)) {
+        if (zipf_exponent > 0) {
+            double total = 0;
+            for (int rank = 1; rank <= vocabulary_size; ++rank) {
+                total += pow(rank, -zipf_exponent);
+                cumulative_.push_back(total);
+            }
+        }
+    }
+
+    uint32_t operator()(mt19937& generator) const {
+        if (cumulative_.empty()) {
+            return DrawBelow(generator, vocabulary_size_);
+        }
+        const double target = DrawUnit(generator) * cumulative_.back();
+        const auto it = upper_bound(cumulative_.begin(), cumulative_.end(), target);
+        return static_cast<uint32_t>(min<ptrdiff_t>(it - cumulative_.begin(), vocabulary_size_ - 1));
+    }
+
+private:
+    const uint32_t vocabulary_size_;
+    vector<double> cumulative_;
+};
+
+// Removes the file when it goes out of scope, also when a benchmark throws
+class TemporaryFile {
+public:
+    explicit TemporaryFile(string path)
+        : path_(move(path)) {
+    }
+    ~TemporaryFile() {
+        error_code ignored;
+        filesystem::remove(path_, ignored);
+    }
+    TemporaryFile(const TemporaryFile&) = delete;
+    TemporaryFile& operator=(const TemporaryFile&) = delete;
+
+    const string& GetPath() const {
+        return path_;
+    }
+
+private:
+    string path_;
+};
+
+uint64_t GetPeakResidentSetKib() {
+#if defined(__linux__)
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return 0;
+#endif
+}
+
+// Results of operations are summed here so that the compiler cannot drop them
+volatile size_t benchmark_sink = 0;
+
+// Runs setup and then operation(i) for every i below operation_count: once to warm up,
+// repetitions times timing every operation, and once more counting the allocations of all
+// threads, so that the atomic adds of the counter do not show in the times
+template <typename Setup, typename Operation>
+BenchmarkResult Measure(string name, size_t operation_count, size_t items_per_operation, int repetitions,
+    Setup setup, Operation operation) {
+    size_t checksum = 0;
+    setup();
+    for (size_t i = 0; i < operation_count; ++i) {
+        checksum += operation(i);
+    }
+    LatencyHistogram latencies;
+    uint64_t total_ns = 0;
+    for (int repetition = 0; repetition < repetitions; ++repetition) {
+        setup();
+        for (size_t i = 0; i < operation_count; ++i) {
+            const uint64_t start = Tracer::Now();
+            checksum += operation(i);
+            const uint64_t duration = Tracer::Now() - start;
+            latencies.Record(duration);
+            total_ns += duration;
+        }
+    }
+    setup();
+    uint64_t allocations = 0;
+    {
+        AllocationCounter counter(AllocationCounter::Scope::PROCESS);
+        for (size_t i = 0; i < operation_count; ++i) {
+            checksum += operation(i);
+        }
+        allocations = counter.GetCount();
+    }
+    benchmark_sink = checksum;
+
+    BenchmarkResult result;
+    result.name = move(name);
+    result.operations = operation_count * repetitions;
+    result.items = result.operations * items_per_operation;
+    result.seconds = total_ns / 1e9;
+    result.p50_ns = latencies.GetValueAtQuantile(0.5);
+    result.p99_ns = latencies.GetValueAtQuantile(0.99);
+    result.allocations_per_operation = operation_count == 0 ? 0 : static_cast<double>(allocations) / operation_count;
+    result.peak_rss_kib = GetPeakResidentSetKib();
+    return result;
+}
+
+template <typename Operation>
+BenchmarkResult Measure(string name, size_t operation_count, size_t items_per_operation, int repetitions,
+    Operation operation) {
+    return Measure(move(name), operation_count, items_per_operation, repetitions, [] {}, operation);
+}
+
+// queries of the corpus joined into one query of the long-query benchmarks
+const size_t LONG_QUERY_PARTS = 14;
+
+void RunCorpusBenchmarks(const CorpusOptions& options, int repetitions, vector<BenchmarkResult>& results, ostream& log) {
+    const Corpus corpus = GenerateCorpus(options);
+    const size_t document_count = corpus.documents.size();
+    const size_t query_count = corpus.queries.size();
+    const string prefix = options.name + "/"s;
+    const auto report = [&](BenchmarkResult result) {
+        log << result.name << ": "sv << static_cast<uint64_t>(result.GetThroughput()) << " items/s, p50 "sv
+            << result.p50_ns << " ns, p99 "sv << result.p99_ns << " ns, "sv << result.allocations_per_operation
+            << " allocations/op, peak RSS "sv << result.peak_rss_kib << " KiB"sv << endl;
+        results.push_back(move(result));
+    };
+
+    vector<NewDocument> batch;
+    for (size_t i = 0; i < document_count; ++i) {
+        batch.push_back({ static_cast<int>(i), corpus.documents[i], DocumentStatus::ACTUAL, corpus.ratings[i] });
+    }
+    optional<SearchServer> server;
+    const auto rebuild = [&] {
+        server.reset();
+        server.emplace(corpus.stop_words);
+        server->AddDocuments(execution::par, batch);
+    };
+
+    report(Measure(prefix + "ingest"s, document_count, 1, repetitions,
+        [&] {
+            server.reset();
+            server.emplace(corpus.stop_words);
+        },
+        [&](size_t i) {
+            server->AddDocument(static_cast<int>(i), corpus.documents[i], DocumentStatus::ACTUAL, corpus.ratings[i]);
+            return size_t{ 1 };
+        }));
+    report(Measure(prefix + "ingest_batch"s, 1, document_count, repetitions,
+        [&] {
+            server.reset();
+            server.emplace(corpus.stop_words);
+        },
+        [&](size_t) {
+            server->AddDocuments(execution::par, batch);
+            return document_count;
+        }));
+
+    const SearchServer& index = *server;
+    report(Measure(prefix + "find_top_seq"s, query_count, 1, repetitions, [&](size_t i) {
+        return index.FindTopDocuments(execution::seq, corpus.queries[i]).size();
+    }));
+    report(Measure(prefix + "find_top_par"s, query_count, 1, repetitions, [&](size_t i) {
+        return index.FindTopDocuments(execution::par, corpus.queries[i]).size();
+    }));
+    report(Measure(prefix + "find_top_daat"s, query_count, 1, repetitions, [&](size_t i) {
+        return index.FindTopDocuments(query_policy::daat, corpus.queries[i]).size();
+    }));
+    // long queries of comparable terms leave MaxScore nothing to skip, so daat scores them
+    // exhaustively and should keep up with find_top_seq
+    vector<string> long_queries;
+    for (size_t i = 0; i + LONG_QUERY_PARTS <= query_count; i += LONG_QUERY_PARTS) {
+        string query;
+        for (size_t j = i; j < i + LONG_QUERY_PARTS; ++j) {
+            query += corpus.queries[j] + ' ';
+        }
+        long_queries.push_back(move(query));
+    }
+    report(Measure(prefix + "find_top_seq_long"s, long_queries.size(), 1, repetitions, [&](size_t i) {
+        return index.FindTopDocuments(execution::seq, long_queries[i]).size();
+    }));
+    report(Measure(prefix + "find_top_daat_long"s, long_queries.size(), 1, repetitions, [&](size_t i) {
+        return index.FindTopDocuments(query_policy::daat, long_queries[i]).size();
+    }));
+    QueryContext context;
+    report(Measure(prefix + "find_top_context"s, query_count, 1, repetitions, [&](size_t i) {
+        return index.FindTopDocuments(context, corpus.queries[i]).size();
+    }));
+    // the document of a query is picked by a multiplicative hash of its number
+    const auto matched_document = [&](size_t i) {
+        return static_cast<int>(i * 2654435761u % document_count);
+    };
+    report(Measure(prefix + "match_document_seq"s, query_count, 1, repetitions, [&](size_t i) {
+        return get<0>(index.MatchDocument(execution::seq, corpus.queries[i], matched_document(i))).size();
+    }));
+    report(Measure(prefix + "match_document_par"s, query_count, 1, repetitions, [&](size_t i) {
+        return get<0>(index.MatchDocument(execution::par, corpus.queries[i], matched_document(i))).size();
+    }));
+    report(Measure(prefix + "process_queries"s, 1, query_count, repetitions, [&](size_t) {
+        return ProcessQueries(index, corpus.queries).size();
+    }));
+    // the joined results of all queries printed page by page into a reused buffer
+    const vector<Document> joined = ProcessQueriesJoined(index, corpus.queries);
+    string pages_text;
+    report(Measure(prefix + "paginate"s, 1, max<size_t>(1, joined.size()), repetitions, [&](size_t) {
+        pages_text.clear();
+        for (const auto page : Paginate(joined, 10)) {
+            AppendPage(pages_text, page);
+        }
+        return pages_text.size();
+    }));
+
+    {
+        const TemporaryFile snapshot((filesystem::temp_directory_path() / ("search_server_benchmark_"s + options.name)).string());
+        index.SaveSnapshot(snapshot.GetPath());
+        report(Measure(prefix + "snapshot_load"s, 1, document_count, repetitions, [&](size_t) {
+            return static_cast<size_t>(SearchServer::LoadSnapshot(snapshot.GetPath()).GetDocumentCount());
+        }));
+    }
+
+    // the corpus as lines "id, status, ratings, text" loaded by the LoadDocuments pipeline,
+    // from the mapped file and from a stream
+    {
+        const TemporaryFile documents((filesystem::temp_directory_path() / ("search_server_benchmark_"s + options.name + ".tsv"s)).string());
+        {
+            ofstream out(documents.GetPath(), ios::binary);
+            string line;
+            for (size_t i = 0; i < document_count; ++i) {
+                line.clear();
+                AppendDocumentLine(line, static_cast<int>(i), DocumentStatus::ACTUAL, corpus.ratings[i], corpus.documents[i]);
+                out << line;
+            }
+        }
+        const auto reset = [&] {
+            server.reset();
+            server.emplace(corpus.stop_words);
+        };
+        report(Measure(prefix + "load_documents_file"s, 1, document_count, repetitions, reset, [&](size_t) {
+            return static_cast<size_t>(LoadDocuments(*server, documents.GetPath()).documents);
+        }));
+        report(Measure(prefix + "load_documents_stream"s, 1, document_count, repetitions, reset, [&](size_t) {
+            ifstream in(documents.GetPath(), ios::binary);
+            return static_cast<size_t>(LoadDocuments(*server, in).documents);
+        }));
+    }
+
+    // documents are removed in an order unrelated to their ids
+    vector<int> removal_order(document_count);
+    for (size_t i = 0; i < document_count; ++i) {
+        removal_order[i] = static_cast<int>(i);
+    }
+    mt19937 generator(options.seed);
+    Shuffle(generator, removal_order);
+    report(Measure(prefix + "remove_document"s, document_count, 1, repetitions, rebuild, [&](size_t i) {
+        server->RemoveDocument(removal_order[i]);
+        return size_t{ 1 };
+    }));
+    report(Measure(prefix + "remove_duplicates"s, 1, document_count, repetitions, rebuild, [&](size_t) {
+        return RemoveDuplicates(*server).size();
+    }));
+}
+
+// Reads the subset of JSON that WriteBenchmarkReport writes: objects, arrays, strings,
+// numbers and literals, without surrogate pairs in strings
+struct JsonValue {
+    enum class Kind {
+        NUL,
+        BOOLEAN,
+        NUMBER,
+        STRING,
+        ARRAY,
+        OBJECT,
+    };
+
+    Kind kind = Kind::NUL;
+    bool boolean = false;
+    double number = 0;
+    string text;
+    vector<JsonValue> items;
+    vector<pair<string, JsonValue>> members;
+
+    const JsonValue& At(string_view key) const {
+        for (const auto& [name, value] : members) {
+            if (name == key) {
+                return value;
+            }
+        }
+        throw invalid_argument("benchmark report lacks \""s + string(key) + "\""s);
+    }
+
+    double GetNumber(string_view key) const {
+        const JsonValue& value = At(key);
+        if (value.kind != Kind::NUMBER) {
+            throw invalid_argument("\""s + string(key) + "\" of benchmark report is not a number"s);
+        }
+        return value.number;
+    }
+
+    const string& GetString(string_view key) const {
+        const JsonValue& value = At(key);
+        if (value.kind != Kind::STRING) {
+            throw invalid_argument("\""s + string(key) + "\" of benchmark report is not a string"s);
+        }
+        return value.text;
+    }
+
+    const vector<JsonValue>& GetArray(string_view key) const {
+        const JsonValue& value = At(key);
+        if (value.kind != Kind::ARRAY) {
+            throw invalid_argument("\""s + string(key) + "\" of benchmark report is not an array"s);
+        }
+        return value.items;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(string_view text)
+        : text_(text) {
+    }
+
+    JsonValue ParseDocument() {
+        JsonValue value = ParseValue();
+        SkipSpaces();
+        if (position_ != text_.size()) {
+            Fail("trailing characters"sv);
+        }
+        return value;
+    }
+
+private:
+    [[noreturn]] void Fail(string_view what) const {
+        throw invalid_argument("malformed benchmark report at offset "s + to_string(position_) + ": "s + string(what));
+    }
+
+    void SkipSpaces() {
+        while (position_ < text_.size() && (text_[position_] == ' ' || text_[position_] == '\t'
+            || text_[position_] == '\n' || text_[position_] == '\r')) {
+            ++position_;
+        }
+    }
+
+    char Peek() {
+        SkipSpaces();
+        if (position_ == text_.size()) {
+            Fail("unexpected end"sv);
+        }
+        return text_[position_];
+    }
+
+    void Expect(char expected) {
+        if (Peek() != expected) {
+            Fail("expected '"s + expected + "'"s);
+        }
+        ++position_;
+    }
+
+    bool TryConsume(char expected) {
+        if (Peek() == expected) {
+            ++position_;
+            return true;
+        }
+        return false;
+    }
+
+    JsonValue ParseValue() {
+        JsonValue value;
+        const char next = Peek();
+        if (next == '{') {
+            value.kind = JsonValue::Kind::OBJECT;
+            ++position_;
+            if (!TryConsume('}')) {
+                do {
+                    string name = ParseString();
+                    Expect(':');
+                    value.members.emplace_back(move(name), ParseValue());
+                } while (TryConsume(','));
+                Expect('}');
+            }
+        } else if (next == '[') {
+            value.kind = JsonValue::Kind::ARRAY;
+            ++position_;
+            if (!TryConsume(']')) {
+                do {
+                    value.items.push_back(ParseValue());
+                } while (TryConsume(','));
+                Expect(']');
+            }
+        } else if (next == '"') {
+            value.kind = JsonValue::Kind::STRING;
+            value.text = ParseString();
+        } else if (ParseLiteral("null"sv)) {
+            value.kind = JsonValue::Kind::NUL;
+        } else if (ParseLiteral("true"sv)) {
+            value.kind = JsonValue::Kind::BOOLEAN;
+            value.boolean = true;
+        } else if (ParseLiteral("false"sv)) {
+            value.kind = JsonValue::Kind::BOOLEAN;
+        } else {
+            value.kind = JsonValue::Kind::NUMBER;
+            const auto [end, error] = from_chars(text_.data() + position_, text_.data() + text_.size(), value.number);
+            if (error != errc()) {
+                Fail("expected a value"sv);
+            }
+            position_ = end - text_.data();
+        }
+        return value;
+    }
+
+    bool ParseLiteral(string_view literal) {
+        if (text_.substr(position_, literal.size()) == literal) {
+            position_ += literal.size();
+            return true;
+        }
+        return false;
+    }
+
+    string ParseString() {
+        Expect('"');
+        string result;
+        while (true) {
+            if (position_ == text_.size()) {
+                Fail("unterminated string"sv);
+            }
+            const char c = text_[position_++];
+            if (c == '"') {
+                return result;
+            }
+            if (c != '\\') {
+                result += c;
+                continue;
+            }
+            if (position_ == text_.size()) {
+                Fail("unterminated string"sv);
+            }
+            const char escaped = text_[position_++];
+            switch (escaped) {
+            case '"': case '\\': case '/':
+                result += escaped;
+                break;
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case 'n': result += '\n'; break;
+            case 'r': result += '\r'; break;
+            case 't': result += '\t'; break;
+            case 'u': {
+                unsigned code = 0;
+                const auto [end, error] = from_chars(text_.data() + position_,
+                    text_.data() + min(position_ + 4, text_.size()), code, 16);
+                if (error != errc() || end != text_.data() + position_ + 4) {
+                    Fail("bad \\u escape"sv);
+                }
+                position_ += 4;
+                // UTF-8 of a code point of the basic plane
+                if (code < 0x80) {
+                    result += static_cast<char>(code);
+                } else if (code < 0x800) {
+                    result += static_cast<char>(0xc0 | code >> 6);
+                    result += static_cast<char>(0x80 | (code & 0x3f));
+                } else {
+                    result += static_cast<char>(0xe0 | code >> 12);
+                    result += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+                    result += static_cast<char>(0x80 | (code & 0x3f));
+                }
+                break;
+            }
+            default:
+                Fail("bad escape"sv);
+            }
+        }
+    }
+
+    string_view text_;
+    size_t position_ = 0;
+};
+
+void WriteString(ostream& out, string_view text) {
+    out << '"';
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            const char* digits = "0123456789abcdef";
+            out << "\\u00"sv << digits[c >> 4] << digits[c & 0xf];
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// The shortest text that reads back as the same double, so that corpora compare equal
+void WriteNumber(ostream& out, double value) {
+    char buffer[32];
+    const auto [end, error] = to_chars(buffer, buffer + sizeof(buffer), value);
+    out << string_view(buffer, end - buffer);
+}
+
+} // namespace
+
+bool CorpusOptions::operator==(const CorpusOptions& other) const {
+    return tie(name, seed, document_count, vocabulary_size, min_document_words, max_document_words, zipf_exponent,
+        stop_word_count, duplicate_share, query_count, query_words, minus_word_probability)
+        == tie(other.name, other.seed, other.document_count, other.vocabulary_size, other.min_document_words,
+            other.max_document_words, other.zipf_exponent, other.stop_word_count, other.duplicate_share,
+            other.query_count, other.query_words, other.minus_word_probability);
+}
+
+bool CorpusOptions::operator!=(const CorpusOptions& other) const {
+    return !(*this == other);
+}
+
+Corpus GenerateCorpus(const CorpusOptions& options) {
+    if (options.document_count < 0 || options.vocabulary_size <= options.stop_word_count || options.stop_word_count < 0
+        || options.min_document_words < 1 || options.max_document_words < options.min_document_words
+        || options.query_count < 0 || options.query_words < 1) {
+        throw invalid_argument("Invalid corpus options"s);
+    }
+    mt19937 generator(options.seed);
+    Corpus corpus;
+    corpus.vocabulary = GenerateVocabulary(generator, options.vocabulary_size);
+    for (int rank = 0; rank < options.stop_word_count; ++rank) {
+        corpus.stop_words += (rank == 0 ? ""s : " "s) + corpus.vocabulary[rank];
+    }
+
+    const WordSampler sampler(options.vocabulary_size, options.zipf_exponent);
+    vector<string_view> words;
+    for (int document = 0; document < options.document_count; ++document) {
+        words.clear();
+        if (document > 0 && DrawUnit(generator) < options.duplicate_share) {
+            const string& original = corpus.documents[DrawBelow(generator, document)];
+            for (size_t start = 0; start < original.size();) {
+                const size_t end = min(original.find(' ', start), original.size());
+                words.push_back(string_view(original).substr(start, end - start));
+                start = end + 1;
+            }
+            Shuffle(generator, words);
+        } else {
+            const uint32_t word_count = options.min_document_words
+                + DrawBelow(generator, options.max_document_words - options.min_document_words + 1);
+            for (uint32_t i = 0; i < word_count; ++i) {
+                words.push_back(corpus.vocabulary[sampler(generator)]);
+            }
+        }
+        string text;
+        for (const string_view word : words) {
+            if (!text.empty()) {
+                text += ' ';
+            }
+            text += word;
+        }
+        corpus.documents.push_back(move(text));
+        vector<int> ratings(1 + DrawBelow(generator, 5));
+        for (int& rating : ratings) {
+            rating = static_cast<int>(DrawBelow(generator, 21)) - 10;
+        }
+        corpus.ratings.push_back(move(ratings));
+    }
+
+    for (int query = 0; query < options.query_count; ++query) {
+        string text;
+        for (int i = 0; i < options.query_words; ++i) {
+            if (!text.empty()) {
+                text += ' ';
+            }
+            if (DrawUnit(generator) < options.minus_word_probability) {
+                text += '-';
+            }
+            text += corpus.vocabulary[sampler(generator)];
+        }
+        corpus.queries.push_back(move(text));
+    }
+    return corpus;
+}
+
+vector<CorpusOptions> GetStandardCorpora(uint32_t seed, int document_count) {
+    vector<CorpusOptions> corpora;
+    for (const bool zipf : { false, true }) {
+        for (const bool long_documents : { false, true }) {
+            CorpusOptions options;
+            options.name = (zipf ? "zipf-"s : "uniform-"s) + (long_documents ? "long"s : "short"s);
+            options.seed = seed;
+            options.zipf_exponent = zipf ? 1.0 : 0.0;
+            if (long_documents) {
+                // a tenth of the documents with twice the words of the short corpus in total
+                options.document_count = max(1, document_count / 10);
+                options.min_document_words = 200;
+                options.max_document_words = 600;
+            } else {
+                options.document_count = document_count;
+            }
+            corpora.push_back(move(options));
+        }
+    }
+    return corpora;
+}
+
+double BenchmarkResult::GetThroughput() const {
+    return seconds > 0 ? items / seconds : 0;
+}
+
+BenchmarkReport RunBenchmarks(const BenchmarkOptions& options, ostream& log) {
+    BenchmarkReport report;
+    report.corpora = options.corpora;
+    for (const CorpusOptions& corpus : options.corpora) {
+        RunCorpusBenchmarks(corpus, options.repetitions, report.results, log);
+    }
+    return report;
+}
+
+void WriteBenchmarkReport(ostream& out, const BenchmarkReport& report) {
+    const auto field = [&out](string_view name, auto value, bool last = false) {
+        WriteString(out, name);
+        out << ": "sv;
+        if constexpr (is_convertible_v<decltype(value), string_view>) {
+            WriteString(out, value);
+        } else {
+            WriteNumber(out, static_cast<double>(value));
+        }
+        out << (last ? ""sv : ", "sv);
+    };
+    out << "{\n  \"corpora\": ["sv;
+    for (size_t i = 0; i < report.corpora.size(); ++i) {
+        const CorpusOptions& corpus = report.corpora[i];
+        out << (i == 0 ? "\n    {"sv : ",\n    {"sv);
+        field("name"sv, string_view(corpus.name));
+        field("seed"sv, corpus.seed);
+        field("document_count"sv, corpus.document_count);
+        field("vocabulary_size"sv, corpus.vocabulary_size);
+        field("min_document_words"sv, corpus.min_document_words);
+        field("max_document_words"sv, corpus.max_document_words);
+        field("zipf_exponent"sv, corpus.zipf_exponent);
+        field("stop_word_count"sv, corpus.stop_word_count);
+        field("duplicate_share"sv, corpus.duplicate_share);
+        field("query_count"sv, corpus.query_count);
+        field("query_words"sv, corpus.query_words);
+        field("minus_word_probability"sv, corpus.minus_word_probability, true);
+        out << '}';
+    }
+    out << "\n  ],\n  \"results\": ["sv;
+    for (size_t i = 0; i < report.results.size(); ++i) {
+        const BenchmarkResult& result = report.results[i];
+        out << (i == 0 ? "\n    {"sv : ",\n    {"sv);
+        field("name"sv, string_view(result.name));
+        field("operations"sv, result.operations);
+        field("items"sv, result.items);
+        field("seconds"sv, result.seconds);
+        field("throughput"sv, result.GetThroughput());
+        field("p50_ns"sv, result.p50_ns);
+        field("p99_ns"sv, result.p99_ns);
+        field("allocations_per_operation"sv, result.allocations_per_operation);
+        field("peak_rss_kib"sv, result.peak_rss_kib, true);
+        out << '}';
+    }
+    out << "\n  ]\n}\n"sv;
+}
+
+BenchmarkReport ReadBenchmarkReport(istream& in) {
+    const string text{ istreambuf_iterator<char>(in), istreambuf_iterator<char>() };
+    const JsonValue root = JsonParser(text).ParseDocument();
+    if (root.kind != JsonValue::Kind::OBJECT) {
+        throw invalid_argument("benchmark report is not a JSON object"s);
+    }
+    BenchmarkReport report;
+    for (const JsonValue& value : root.GetArray("corpora"sv)) {
+        CorpusOptions corpus;
+        corpus.name = value.GetString("name"sv);
+        corpus.seed = static_cast<uint32_t>(value.GetNumber("seed"sv));
+        corpus.document_count = static_cast<int>(value.GetNumber("document_count"sv));
+        corpus.vocabulary_size = static_cast<int>(value.GetNumber("vocabulary_size"sv));
+        corpus.min_document_words = static_cast<int>(value.GetNumber("min_document_words"sv));
+        corpus.max_document_words = static_cast<int>(value.GetNumber("max_document_words"sv));
+        corpus.zipf_exponent = value.GetNumber("zipf_exponent"sv);
+        corpus.stop_word_count = static_cast<int>(value.GetNumber("stop_word_count"sv));
+        corpus.duplicate_share = value.GetNumber("duplicate_share"sv);
+        corpus.query_count = static_cast<int>(value.GetNumber("query_count"sv));
+        corpus.query_words = static_cast<int>(value.GetNumber("query_words"sv));
+        corpus.minus_word_probability = value.GetNumber("minus_word_probability"sv);
+        report.corpora.push_back(move(corpus));
+    }
+    for (const JsonValue& value : root.GetArray("results"sv)) {
+        BenchmarkResult result;
+        result.name = value.GetString("name"sv);
+        result.operations = static_cast<uint64_t>(value.GetNumber("operations"sv));
+        result.items = static_cast<uint64_t>(value.GetNumber("items"sv));
+        result.seconds = value.GetNumber("seconds"sv);
+        result.p50_ns = static_cast<uint64_t>(value.GetNumber("p50_ns"sv));
+        result.p99_ns = static_cast<uint64_t>(value.GetNumber("p99_ns"sv));
+        result.allocations_per_operation = value.GetNumber("allocations_per_operation"sv);
+        result.peak_rss_kib = static_cast<uint64_t>(value.GetNumber("peak_rss_kib"sv));
+        report.results.push_back(move(result));
+    }
+    return report;
+}
+
+vector<BenchmarkRegression> FindRegressions(const BenchmarkReport& baseline, const BenchmarkReport& current,
+    double threshold_percent) {
+    for (const CorpusOptions& corpus : current.corpora) {
+        const auto it = find_if(baseline.corpora.begin(), baseline.corpora.end(), [&corpus](const CorpusOptions& other) {
+            return other.name == corpus.name;
+        });
+        if (it != baseline.corpora.end() && *it != corpus) {
+            throw invalid_argument("corpus "s + corpus.name + " of the baseline was generated with other options"s);
+        }
+    }
+    const double factor = threshold_percent / 100;
+    vector<BenchmarkRegression> regressions;
+    for (const BenchmarkResult& result : current.results) {
+        const auto it = find_if(baseline.results.begin(), baseline.results.end(), [&result](const BenchmarkResult& other) {
+            return other.name == result.name;
+        });
+        if (it == baseline.results.end()) {
+            continue;
+        }
+        if (result.GetThroughput() < it->GetThroughput() * (1 - factor)) {
+            regressions.push_back({ result.name, "throughput"s, it->GetThroughput(), result.GetThroughput() });
+        }
+        // the smaller the better: any growth from zero, e.g. of allocations, is a regression
+        const auto check = [&](const string& metric, double baseline_value, double current_value) {
+            if (current_value > baseline_value * (1 + factor)) {
+                regressions.push_back({ result.name, metric, baseline_value, current_value });
+            }
+        };
+        check("p50_ns"s, static_cast<double>(it->p50_ns), static_cast<double>(result.p50_ns));
+        check("p99_ns"s, static_cast<double>(it->p99_ns), static_cast<double>(result.p99_ns));
+        check("allocations_per_operation"s, it->allocations_per_operation, result.allocations_per_operation);
+        check("peak_rss_kib"s, static_cast<double>(it->peak_rss_kib), static_cast<double>(result.peak_rss_kib));
+    }
+    return regressions;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Parameters of a generated corpus: the same options give the same documents and queries
+// with any standard library
+struct CorpusOptions {
+    std::string name;
+    uint32_t seed = 1;
+    int document_count = 10'000;
+    int vocabulary_size = 10'000;
+    // the number of words of a document is uniform in [min_document_words, max_document_words]
+    int min_document_words = 10;
+    int max_document_words = 30;
+    // 0 draws words uniformly, s > 0 draws the word of rank r with probability
+    // proportional to 1 / r^s, as in natural text
+    double zipf_exponent = 0;
+    // the most frequent words of the vocabulary are stop words
+    int stop_word_count = 10;
+    // share of documents that repeat the words of an earlier document in another order
+    double duplicate_share = 0.05;
+    int query_count = 1'000;
+    int query_words = 5;
+    double minus_word_probability = 0.1;
+
+    bool operator==(const CorpusOptions& other) const;
+    bool operator!=(const CorpusOptions& other) const;
+};
+
+struct Corpus {
+    std::string stop_words;
+    std::vector<std::string> vocabulary;
+    std::vector<std::string> documents;
+    std::vector<std::vector<int>> ratings;
+    std::vector<std::string> queries;
+};
+
+Corpus GenerateCorpus(const CorpusOptions& options);
+
+// Uniform and Zipfian vocabularies with short and long documents
+std::vector<CorpusOptions> GetStandardCorpora(uint32_t seed = 1, int document_count = 10'000);
+
+struct BenchmarkResult {
+    // "<corpus>/<benchmark>", e.g. "zipf-long/find_top_par"
+    std::string name;
+    uint64_t operations = 0;
+    // units of work of all operations, e.g. queries of a ProcessQueries batch
+    uint64_t items = 0;
+    double seconds = 0;
+    uint64_t p50_ns = 0;
+    uint64_t p99_ns = 0;
+    double allocations_per_operation = 0;
+    // peak resident set of the process once the benchmark finished
+    uint64_t peak_rss_kib = 0;
+
+    // Items per second
+    double GetThroughput() const;
+};
+
+struct BenchmarkReport {
+    std::vector<CorpusOptions> corpora;
+    std::vector<BenchmarkResult> results;
+};
+
+struct BenchmarkOptions {
+    std::vector<CorpusOptions> corpora = GetStandardCorpora();
+    // timed passes over the operations of a benchmark, after one warm-up pass
+    int repetitions = 3;
+};
+
+// Runs every benchmark on every corpus, printing a line per benchmark to log
+BenchmarkReport RunBenchmarks(const BenchmarkOptions& options, std::ostream& log);
+
+void WriteBenchmarkReport(std::ostream& out, const BenchmarkReport& report);
+// Reads what WriteBenchmarkReport wrote; throws invalid_argument on malformed JSON
+BenchmarkReport ReadBenchmarkReport(std::istream& in);
+
+struct BenchmarkRegression {
+    std::string name;
+    // "throughput", "p50_ns", "p99_ns", "allocations_per_operation" or "peak_rss_kib"
+    std::string metric;
+    double baseline = 0;
+    double current = 0;
+};
+
+// Metrics of benchmarks present in both reports that got worse than the baseline by more
+// than threshold_percent. Throws invalid_argument if a corpus of both reports was generated
+// with other options, as their numbers are not comparable
+std::vector<BenchmarkRegression> FindRegressions(const BenchmarkReport& baseline, const BenchmarkReport& current,
+    double threshold_percent);
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// Multi-producer multi-consumer FIFO holding at most capacity elements. TryPush refuses
+// an element when the queue is full or closed, Push waits for room instead. Consumers
+// block in Pop until an element arrives or the queue is closed and drained.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity_(capacity) {
+    }
+
+    bool TryPush(T value) {
+        {
+            std::lock_guard guard(mutex_);
+            if (closed_ || items_.size() >= capacity_) {
+                return false;
+            }
+            items_.push_back(std::move(value));
+        }
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // Returns false if the queue is closed before there is room
+    bool Push(T value) {
+        {
+            std::unique_lock lock(mutex_);
+            not_full_.wait(lock, [this] {
+                return closed_ || items_.size() < capacity_;
+            });
+            if (closed_) {
+                return false;
+            }
+            items_.push_back(std::move(value));
+        }
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // Returns false once the queue is closed and empty
+    bool Pop(T& value) {
+        {
+            std::unique_lock lock(mutex_);
+            not_empty_.wait(lock, [this] {
+                return closed_ || !items_.empty();
+            });
+            if (items_.empty()) {
+                return false;
+            }
+            value = std::move(items_.front());
+            items_.pop_front();
+        }
+        not_full_.notify_one();
+        return true;
+    }
+
+    // Refuses new elements and wakes the producers waiting in Push; the queued ones can
+    // still be popped
+    void Close() {
+        {
+            std::lock_guard guard(mutex_);
+            closed_ = true;
+        }
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard guard(mutex_);
+        return items_.size();
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+private:
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<T> items_;
+    bool closed_ = false;
+};
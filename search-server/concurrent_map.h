@@ -39,7 +39,9 @@ public:
     }
 
     void erase(Key key) {
-        buckets_[key].map.erase(key);
+        auto& bucket = buckets_[static_cast<uint64_t>(key) % buckets_.size()];
+        std::lock_guard guard(bucket.mutex);
+        bucket.map.erase(key);
     }
 
     std::map<Key, Value> BuildOrdinaryMap() {
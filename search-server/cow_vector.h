@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Array that either owns its elements or views memory it does not own, such as
+// a memory-mapped snapshot. Copies share the owned elements too. A viewed or shared
+// array is copied into storage of its own on its first modification, so reads and
+// copies never pay for the copy.
+template <typename T>
+class CowVector {
+public:
+    CowVector() = default;
+
+    static CowVector View(const T* data, size_t size) {
+        CowVector result;
+        result.view_ = data;
+        result.view_size_ = size;
+        result.is_view_ = true;
+        return result;
+    }
+
+    const T* data() const {
+        if (is_view_) {
+            return view_;
+        }
+        return owned_ ? owned_->data() : nullptr;
+    }
+    size_t size() const {
+        if (is_view_) {
+            return view_size_;
+        }
+        return owned_ ? owned_->size() : 0;
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+    const T& operator[](size_t index) const {
+        return data()[index];
+    }
+    const T& back() const {
+        return data()[size() - 1];
+    }
+    const T* begin() const {
+        return data();
+    }
+    const T* end() const {
+        return data() + size();
+    }
+
+    bool IsView() const {
+        return is_view_;
+    }
+
+    // Detaches from the viewed or shared memory; the returned vector may be modified freely
+    std::vector<T>& Mutable() {
+        if (is_view_) {
+            owned_ = std::make_shared<std::vector<T>>(view_, view_ + view_size_);
+            is_view_ = false;
+            view_ = nullptr;
+            view_size_ = 0;
+        }
+        else if (!owned_) {
+            owned_ = std::make_shared<std::vector<T>>();
+        }
+        else if (owned_.use_count() > 1) {
+            owned_ = std::make_shared<std::vector<T>>(*owned_);
+        }
+        else {
+            // the last other owner may have just let go on another thread: see its reads
+            // before writing over them
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *owned_;
+    }
+
+    size_t GetMemoryUsage() const {
+        return owned_ ? owned_->capacity() * sizeof(T) : 0;
+    }
+
+private:
+    std::shared_ptr<std::vector<T>> owned_;
+    const T* view_ = nullptr;
+    size_t view_size_ = 0;
+    bool is_view_ = false;
+};
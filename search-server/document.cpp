@@ -1,5 +1,8 @@
 #include "document.h"
 
+#include <charconv>
+#include <string_view>
+
 Document::Document(int id, double relevance, int rating)
     : id(id)
     , relevance(relevance)
@@ -13,4 +16,21 @@ std::ostream& operator<<(std::ostream& out, const Document& document) {
         << "relevance = "s << document.relevance << ", "s
         << "rating = "s << document.rating << " }"s;
     return out;
-}
\ No newline at end of file
+}
+
+void AppendDocument(std::string& buffer, const Document& document) {
+    using namespace std::string_view_literals;
+    // %g with the default precision of 6, which is what a stream prints
+    char number[32];
+    const auto append_number = [&](auto value, auto... format) {
+        const auto [end, error] = std::to_chars(number, number + sizeof(number), value, format...);
+        buffer.append(number, end);
+    };
+    buffer += "{ document_id = "sv;
+    append_number(document.id);
+    buffer += ", relevance = "sv;
+    append_number(document.relevance, std::chars_format::general, 6);
+    buffer += ", rating = "sv;
+    append_number(document.rating);
+    buffer += " }"sv;
+}
@@ -17,4 +17,7 @@ enum class DocumentStatus {
     REMOVED,
 };
 
-std::ostream& operator<<(std::ostream& out, const Document& document);
\ No newline at end of file
+std::ostream& operator<<(std::ostream& out, const Document& document);
+// Appends the same text as operator<< with default stream flags. A buffer reused
+// between calls stops allocating once it has grown
+void AppendDocument(std::string& buffer, const Document& document);
\ No newline at end of file
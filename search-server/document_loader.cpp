@@ -0,0 +1,362 @@
+#include "document_loader.h"
+
+#include "bounded_queue.h"
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DOCUMENT_LOADER_USE_MMAP
+#endif
+
+using namespace std;
+
+namespace {
+
+const array<string_view, 4> STATUS_NAMES = { "ACTUAL"sv, "IRRELEVANT"sv, "BANNED"sv, "REMOVED"sv };
+
+// Whole lines of the input. A block read from a stream owns its bytes, a block of a mapped
+// file views the mapping
+struct Block {
+    uint64_t index = 0;
+    // of the first byte in the input
+    uint64_t offset = 0;
+    unique_ptr<char[]> storage;
+    string_view text;
+    SearchServer::TokenizedBatch batch;
+};
+
+string AtOffset(uint64_t offset, const char* what) {
+    return "line at byte "s + to_string(offset) + ": "s + what;
+}
+
+int ParseInt(string_view text, const char* what) {
+    int value = 0;
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    if (text.empty() || error != errc() || end != text.data() + text.size()) {
+        throw invalid_argument("Invalid "s + what);
+    }
+    return value;
+}
+
+NewDocument ParseLine(string_view line) {
+    const size_t id_end = line.find('\t');
+    const size_t status_end = id_end == string_view::npos ? id_end : line.find('\t', id_end + 1);
+    const size_t ratings_end = status_end == string_view::npos ? status_end : line.find('\t', status_end + 1);
+    if (ratings_end == string_view::npos) {
+        throw invalid_argument("Expected id, status, ratings and text separated by tabs"s);
+    }
+    NewDocument document;
+    document.id = ParseInt(line.substr(0, id_end), "document id");
+    const string_view status = line.substr(id_end + 1, status_end - id_end - 1);
+    const auto status_it = find(STATUS_NAMES.begin(), STATUS_NAMES.end(), status);
+    if (status_it == STATUS_NAMES.end()) {
+        throw invalid_argument("Invalid document status"s);
+    }
+    document.status = static_cast<DocumentStatus>(status_it - STATUS_NAMES.begin());
+    string_view ratings = line.substr(status_end + 1, ratings_end - status_end - 1);
+    while (!ratings.empty()) {
+        const size_t space = min(ratings.find(' '), ratings.size());
+        if (space > 0) {
+            document.ratings.push_back(ParseInt(ratings.substr(0, space), "rating"));
+        }
+        ratings.remove_prefix(min(space + 1, ratings.size()));
+    }
+    document.text = line.substr(ratings_end + 1);
+    return document;
+}
+
+vector<NewDocument> ParseBlock(const Block& block) {
+    vector<NewDocument> documents;
+    const string_view text = block.text;
+    for (size_t line_start = 0; line_start < text.size();) {
+        const size_t line_end = min(text.find('\n', line_start), text.size());
+        string_view line = text.substr(line_start, line_end - line_start);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (!line.empty()) {
+            try {
+                documents.push_back(ParseLine(line));
+            }
+            catch (const invalid_argument& error) {
+                throw invalid_argument(AtOffset(block.offset + line_start, error.what()));
+            }
+        }
+        line_start = line_end + 1;
+    }
+    return documents;
+}
+
+// Runs the reader and the tokenisers on threads of their own and adds the blocks on the
+// calling thread. read(queue) pushes blocks in order and returns once Push fails;
+// release(block) is called after the block is added
+template <typename Read, typename Release>
+DocumentLoadStats RunPipeline(SearchServer& search_server, const DocumentLoadOptions& options, Read read,
+    Release release) {
+    const auto start = chrono::steady_clock::now();
+    BoundedQueue<Block> read_blocks(max<size_t>(1, options.queue_capacity));
+    BoundedQueue<Block> tokenized_blocks(max<size_t>(1, options.queue_capacity));
+    mutex error_mutex;
+    exception_ptr first_error;
+    // closing both queues stops every stage
+    const auto fail = [&](exception_ptr error) {
+        {
+            lock_guard guard(error_mutex);
+            if (!first_error) {
+                first_error = error;
+            }
+        }
+        read_blocks.Close();
+        tokenized_blocks.Close();
+    };
+
+    thread reader([&] {
+        try {
+            read(read_blocks);
+        }
+        catch (...) {
+            fail(current_exception());
+        }
+        read_blocks.Close();
+    });
+    const size_t tokenizer_count = max<size_t>(1, options.tokenizer_count);
+    atomic<size_t> running_tokenizers{ tokenizer_count };
+    vector<thread> tokenizers;
+    for (size_t i = 0; i < tokenizer_count; ++i) {
+        tokenizers.emplace_back([&] {
+            try {
+                Block block;
+                while (read_blocks.Pop(block)) {
+                    vector<NewDocument> documents = ParseBlock(block);
+                    try {
+                        block.batch = search_server.TokenizeDocuments(move(documents));
+                    }
+                    catch (const invalid_argument& error) {
+                        throw invalid_argument("block at byte "s + to_string(block.offset) + ": "s + error.what());
+                    }
+                    if (!tokenized_blocks.Push(move(block))) {
+                        break;
+                    }
+                }
+            }
+            catch (...) {
+                fail(current_exception());
+            }
+            if (running_tokenizers.fetch_sub(1) == 1) {
+                tokenized_blocks.Close();
+            }
+        });
+    }
+
+    // tokenisers finish blocks out of order, the index gets them in input order
+    DocumentLoadStats stats;
+    try {
+        map<uint64_t, Block> pending;
+        Block block;
+        while (tokenized_blocks.Pop(block)) {
+            pending.emplace(block.index, move(block));
+            for (auto it = pending.begin(); it != pending.end() && it->first == stats.blocks; it = pending.erase(it)) {
+                Block& next = it->second;
+                const size_t document_count = next.batch.GetDocuments().size();
+                try {
+                    search_server.AddTokenizedDocuments(move(next.batch));
+                }
+                catch (const invalid_argument& error) {
+                    throw invalid_argument("block at byte "s + to_string(next.offset) + ": "s + error.what());
+                }
+                release(next);
+                stats.documents += document_count;
+                stats.bytes += next.text.size();
+                ++stats.blocks;
+            }
+        }
+    }
+    catch (...) {
+        fail(current_exception());
+    }
+    reader.join();
+    for (thread& tokenizer : tokenizers) {
+        tokenizer.join();
+    }
+    if (first_error) {
+        rethrow_exception(first_error);
+    }
+    stats.duration = chrono::steady_clock::now() - start;
+    return stats;
+}
+
+#ifdef DOCUMENT_LOADER_USE_MMAP
+class MappedFile {
+public:
+    explicit MappedFile(const string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw DocumentLoadError("Cannot open "s + path);
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+            close(fd);
+            throw DocumentLoadError("Cannot read "s + path);
+        }
+        size_ = static_cast<size_t>(file_stat.st_size);
+        if (size_ > 0) {
+            void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                throw DocumentLoadError("Cannot map "s + path);
+            }
+            data_ = static_cast<const char*>(mapping);
+            madvise(mapping, size_, MADV_SEQUENTIAL);
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    string_view GetText() const {
+        return { data_, size_ };
+    }
+
+    // Drops the pages lying wholly inside the text, which has been read for the last time,
+    // so that the resident set does not grow with the file
+    void Release(string_view text) const {
+        const uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        const uintptr_t begin = (reinterpret_cast<uintptr_t>(text.data()) + page_size - 1) / page_size * page_size;
+        const uintptr_t end = (reinterpret_cast<uintptr_t>(text.data()) + text.size()) / page_size * page_size;
+        if (begin < end) {
+            madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+        }
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+#endif
+
+} // namespace
+
+double DocumentLoadStats::GetMegabytesPerSecond() const {
+    const double seconds = chrono::duration<double>(duration).count();
+    return seconds > 0 ? bytes / 1e6 / seconds : 0;
+}
+
+DocumentLoadStats LoadDocuments(SearchServer& search_server, const string& path, const DocumentLoadOptions& options) {
+#ifdef DOCUMENT_LOADER_USE_MMAP
+    const MappedFile file(path);
+    const string_view text = file.GetText();
+    const size_t block_size = max<size_t>(1, options.block_size);
+    return RunPipeline(search_server, options,
+        [&](BoundedQueue<Block>& queue) {
+            uint64_t index = 0;
+            for (size_t begin = 0; begin < text.size();) {
+                // the block ends with the line holding its last byte
+                size_t end = min(text.size(), begin + block_size);
+                end = min(text.find('\n', end - 1), text.size() - 1) + 1;
+                Block block;
+                block.index = index++;
+                block.offset = begin;
+                block.text = text.substr(begin, end - begin);
+                if (!queue.Push(move(block))) {
+                    return;
+                }
+                begin = end;
+            }
+        },
+        [&file](const Block& block) {
+            file.Release(block.text);
+        });
+#else
+    ifstream input(path, ios::binary);
+    if (!input) {
+        throw DocumentLoadError("Cannot open "s + path);
+    }
+    return LoadDocuments(search_server, input, options);
+#endif
+}
+
+DocumentLoadStats LoadDocuments(SearchServer& search_server, istream& input, const DocumentLoadOptions& options) {
+    const size_t block_size = max<size_t>(1, options.block_size);
+    return RunPipeline(search_server, options,
+        [&](BoundedQueue<Block>& queue) {
+            // the unfinished last line of a read goes to the start of the next block
+            string carry;
+            uint64_t index = 0;
+            uint64_t offset = 0;
+            bool at_end = false;
+            while (!at_end) {
+                unique_ptr<char[]> storage(new char[carry.size() + block_size]);
+                memcpy(storage.get(), carry.data(), carry.size());
+                input.read(storage.get() + carry.size(), block_size);
+                if (input.bad()) {
+                    throw DocumentLoadError("Failed to read input"s);
+                }
+                at_end = !input;
+                const size_t size = carry.size() + static_cast<size_t>(input.gcount());
+                size_t end = size;
+                if (!at_end) {
+                    const string_view read_text(storage.get(), size);
+                    const size_t newline = read_text.rfind('\n');
+                    if (newline == string_view::npos) {
+                        // a line longer than a block
+                        carry.assign(storage.get(), size);
+                        continue;
+                    }
+                    end = newline + 1;
+                }
+                carry.assign(storage.get() + end, size - end);
+                if (end == 0) {
+                    break;
+                }
+                Block block;
+                block.index = index++;
+                block.offset = offset;
+                block.text = string_view(storage.get(), end);
+                block.storage = move(storage);
+                offset += end;
+                if (!queue.Push(move(block))) {
+                    return;
+                }
+            }
+        },
+        [](Block& block) {
+            block.storage.reset();
+        });
+}
+
+void AppendDocumentLine(string& buffer, int document_id, DocumentStatus status, const vector<int>& ratings,
+    string_view text) {
+    char number[16];
+    buffer.append(number, to_chars(number, number + sizeof(number), document_id).ptr);
+    buffer += '\t';
+    buffer += STATUS_NAMES.at(static_cast<size_t>(status));
+    buffer += '\t';
+    for (size_t i = 0; i < ratings.size(); ++i) {
+        if (i > 0) {
+            buffer += ' ';
+        }
+        buffer.append(number, to_chars(number, number + sizeof(number), ratings[i]).ptr);
+    }
+    buffer += '\t';
+    buffer += text;
+    buffer += '\n';
+}
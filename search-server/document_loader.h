@@ -0,0 +1,63 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Bulk load of documents, one per line:
+//
+//   id <TAB> status <TAB> ratings separated by spaces <TAB> text
+//
+// e.g. "17\tACTUAL\t5 -3 2\tпушистый кот". Status is ACTUAL, IRRELEVANT, BANNED or
+// REMOVED; the ratings may be empty; a trailing '\r' and empty lines are ignored.
+//
+// The input goes through a pipeline: a reader cuts it into blocks of whole lines, several
+// tokenisers parse and tokenise the blocks with SearchServer::TokenizeDocuments, and the
+// calling thread adds them to the server in input order. Bounded queues between the stages
+// stop the reader when the index falls behind. Texts are handed over as string_views into
+// the blocks, which live until their words are interned.
+
+struct DocumentLoadOptions {
+    // bytes read at once, rounded up to the end of a line
+    size_t block_size = size_t{ 4 } << 20;
+    size_t tokenizer_count = std::max(1u, std::thread::hardware_concurrency());
+    // blocks each queue holds, which with block_size bounds the memory of the pipeline
+    size_t queue_capacity = 4;
+};
+
+struct DocumentLoadStats {
+    uint64_t bytes = 0;
+    uint64_t documents = 0;
+    uint64_t blocks = 0;
+    std::chrono::nanoseconds duration{ 0 };
+
+    double GetMegabytesPerSecond() const;
+};
+
+// The file could not be read
+class DocumentLoadError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Maps the file into memory where the platform allows, otherwise reads it in blocks.
+// A malformed line or a document AddDocuments rejects throws invalid_argument with its byte
+// offset; the blocks added before it stay in the server
+DocumentLoadStats LoadDocuments(SearchServer& search_server, const std::string& path,
+    const DocumentLoadOptions& options = {});
+// Reads the stream in blocks of options.block_size with istream::read, e.g. from std::cin
+DocumentLoadStats LoadDocuments(SearchServer& search_server, std::istream& input,
+    const DocumentLoadOptions& options = {});
+
+// Appends a line in the format above
+void AppendDocumentLine(std::string& buffer, int document_id, DocumentStatus status, const std::vector<int>& ratings,
+    std::string_view text);
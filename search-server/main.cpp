@@ -1,14 +1,41 @@
 #include "search_server.h"
+#include "concurrent_map.h"
+#include "query_cache.h"
+#include "query_executor.h"
+#include "query_dispatcher.h"
+#include "versioned_search_server.h"
+#include "segmented_search_server.h"
+#include "remove_duplicates.h"
+#include "request_queue.h"
+#include "benchmark.h"
+#include "process_queries.h"
 
 #include "log_duration.h"
+#include "trace.h"
 #include "test_example_functions.h"
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <execution>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <optional>
 #include <random>
+#include <set>
+#include <shared_mutex>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <thread>
 #include <vector>
 
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
 using namespace std;
 
 string GenerateWord(mt19937& generator, int max_length) {
@@ -68,7 +95,784 @@ void Test(string_view mark, const SearchServer& search_server, const vector<stri
 
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
 
-int main() {
+// пропускная способность накопителей релевантности на потоке постингов как в TEST(par):
+// 100 запросов по 70 слов, у каждого слова ~df случайных документов из document_count
+template <typename Accumulate>
+void BenchmarkAccumulator(string_view mark, mt19937& generator, int document_count, Accumulate accumulate) {
+    const int word_count = 100 * 70;
+    const int postings_per_word = static_cast<int>(document_count * (1 - pow(1 - 1.0 / 1000, 70)));
+    vector<vector<int>> word_documents(word_count);
+    for (auto& documents : word_documents) {
+        for (int i = 0; i < postings_per_word; ++i) {
+            documents.push_back(uniform_int_distribution(0, document_count - 1)(generator));
+        }
+        sort(documents.begin(), documents.end());
+    }
+    LOG_DURATION(mark);
+    double total = 0;
+    for (int query = 0; query < 100; ++query) {
+        total += accumulate(word_documents.begin() + query * 70, word_documents.begin() + (query + 1) * 70);
+    }
+    cout << total << endl;
+}
+
+void BenchmarkAccumulators(mt19937& generator, int document_count) {
+    using WordIterator = vector<vector<int>>::const_iterator;
+    mt19937 concurrent_map_generator = generator;
+    BenchmarkAccumulator("ConcurrentMap<int, double>(10)"s, concurrent_map_generator, document_count,
+        [](WordIterator begin, WordIterator end) {
+            ConcurrentMap<int, double> accumulator(10);
+            for_each(execution::par, begin, end, [&accumulator](const vector<int>& documents) {
+                for (const int document : documents) {
+                    accumulator[document].ref_to_value += 0.1;
+                }
+            });
+            return static_cast<double>(accumulator.BuildOrdinaryMap().size());
+        });
+    BenchmarkAccumulator("ConcurrentScoreAccumulator"s, generator, document_count,
+        [document_count](WordIterator begin, WordIterator end) {
+            ConcurrentScoreAccumulator accumulator(document_count);
+            for_each(execution::par, begin, end, [&accumulator](const vector<int>& documents) {
+                for (const int document : documents) {
+                    accumulator.Add(document, 0.1);
+                }
+            });
+            double size = 0;
+            accumulator.ForEachScored([&size](size_t, double) { ++size; });
+            return size;
+        });
+}
+
+// запросы с очень частыми словами: их длинные списки документов определяют хвост задержек
+void BenchmarkCommonTerms(mt19937& generator, const vector<string>& dictionary) {
+    const vector<string> common_words = { "common0"s, "common1"s, "common2"s, "common3"s };
+    SearchServer search_server(""s);
+    for (int id = 0; id < 50'000; ++id) {
+        string text = GenerateQuery(generator, dictionary, 20);
+        for (const string& word : common_words) {
+            if (uniform_int_distribution(0, 3)(generator) > 0) {
+                text += " "s + word;
+            }
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 10 });
+    }
+    vector<string> queries;
+    for (int i = 0; i < 1'000; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, 3) + " "s + common_words[i % common_words.size()]
+            + " "s + common_words[(i + 1) % common_words.size()]);
+    }
+    Test("seq, common terms"s, search_server, queries, execution::seq);
+    Test("daat, common terms"s, search_server, queries, query_policy::daat);
+}
+
+// сравнение полной сортировки кандидатов с ограниченной кучей top-K
+void BenchmarkTopK(mt19937& generator) {
+    for (int candidate_count : { 1'000, 10'000, 100'000, 1'000'000 }) {
+        vector<Document> candidates;
+        candidates.reserve(candidate_count);
+        for (int id = 0; id < candidate_count; ++id) {
+            candidates.push_back({ id, uniform_real_distribution<>(0, 1)(generator), uniform_int_distribution(-10, 10)(generator) });
+        }
+        const int repeat_count = 10'000'000 / candidate_count;
+
+        vector<Document> sorted;
+        {
+            LOG_DURATION("full sort, "s + to_string(candidate_count) + " candidates"s);
+            for (int i = 0; i < repeat_count; ++i) {
+                sorted = candidates;
+                sort(sorted.begin(), sorted.end(), IsMoreRelevant);
+                sorted.resize(MAX_RESULT_DOCUMENT_COUNT);
+            }
+        }
+        vector<Document> top;
+        {
+            LOG_DURATION("top-K, "s + to_string(candidate_count) + " candidates"s);
+            for (int i = 0; i < repeat_count; ++i) {
+                top = SelectTopDocuments(candidates, MAX_RESULT_DOCUMENT_COUNT);
+            }
+        }
+        for (size_t i = 0; i < top.size(); ++i) {
+            if (top[i].id != sorted[i].id) {
+                cerr << "top-K result differs from full sort"s << endl;
+            }
+        }
+    }
+}
+
+// скорость индексации: по одному документу против пакетной загрузки
+template <typename Ingest>
+void BenchmarkIngest(string_view mark, const vector<string>& documents, const string& stop_words, Ingest ingest) {
+    const auto start = chrono::steady_clock::now();
+    SearchServer search_server(stop_words);
+    ingest(search_server);
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << mark << ", "s << documents.size() << " documents: "s << static_cast<int64_t>(seconds * 1000) << " ms, "s
+        << static_cast<int64_t>(documents.size() / seconds) << " documents/s"s << endl;
+}
+
+void BenchmarkIngests(mt19937& generator, const vector<string>& dictionary, int document_count, int word_count) {
+    const auto documents = GenerateQueries(generator, dictionary, document_count, word_count);
+    vector<NewDocument> batch;
+    batch.reserve(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        batch.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+    }
+    BenchmarkIngest("AddDocument"s, documents, dictionary[0], [&documents](SearchServer& search_server) {
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+    });
+    BenchmarkIngest("AddDocuments(seq)"s, documents, dictionary[0], [&batch](SearchServer& search_server) {
+        search_server.AddDocuments(batch);
+    });
+    BenchmarkIngest("AddDocuments(par)"s, documents, dictionary[0], [&batch](SearchServer& search_server) {
+        search_server.AddDocuments(execution::par, batch);
+    });
+}
+
+// прежний разбор: поиск пробелов через find и отдельная проверка каждого слова
+vector<string_view> SplitIntoWordsByFind(string_view text) {
+    vector<string_view> result;
+    text.remove_prefix(min(text.find_first_not_of(" "), text.size()));
+    while (!text.empty()) {
+        size_t pos = text.find(" ");
+        result.push_back(text.substr(0, pos));
+
+        if (pos == text.npos) {
+            text.remove_prefix(text.size());
+        }
+        else {
+            text.remove_prefix(pos);
+            text.remove_prefix(min(text.find_first_not_of(" "), text.size()));
+        }
+    }
+    return result;
+}
+
+void BenchmarkTokenizer(const vector<string>& documents) {
+    const int repeat_count = 20;
+    size_t word_count = 0;
+    {
+        LOG_DURATION("find + IsValidWord"s);
+        for (int i = 0; i < repeat_count; ++i) {
+            for (const string& document : documents) {
+                for (const string_view word : SplitIntoWordsByFind(document)) {
+                    word_count += none_of(word.begin(), word.end(), [](char c) {
+                        return c >= '\0' && c < ' ';
+                        });
+                }
+            }
+        }
+    }
+    vector<string_view> words;
+    {
+        LOG_DURATION("one-pass tokenizer"s);
+        for (int i = 0; i < repeat_count; ++i) {
+            for (const string& document : documents) {
+                word_count -= SplitIntoWords(document, words);
+            }
+        }
+    }
+    // оба способа должны насчитать одинаковое число верных слов
+    cout << word_count << endl;
+}
+
+// стоп-слова: поиск по string_view против std::set<string> с временной строкой на каждое слово
+void BenchmarkStopWords(mt19937& generator, const vector<string>& dictionary, const vector<string>& documents,
+    const vector<string>& queries, int stop_word_count) {
+    // в текстах встречаются только первые 10 стоп-слов, остальные лишь увеличивают словарь
+    set<string> string_set(dictionary.begin(), dictionary.begin() + 10);
+    const set<string> text_words(dictionary.begin(), dictionary.end());
+    while (static_cast<int>(string_set.size()) < stop_word_count) {
+        string word = GenerateWord(generator, 10);
+        if (text_words.count(word) == 0) {
+            string_set.insert(move(word));
+        }
+    }
+    const vector<string> stop_word_list(string_set.begin(), string_set.end());
+    const StopWords stop_words(string_set);
+    const string mark = to_string(string_set.size()) + " stop words"s;
+
+    vector<string_view> words;
+    size_t stop_count = 0;
+    {
+        LOG_DURATION(mark + ", std::set<string> lookup"s);
+        for (const string& document : documents) {
+            SplitIntoWords(document, words);
+            for (const string_view word : words) {
+                stop_count += string_set.count(string{ word });
+            }
+        }
+    }
+    {
+        LOG_DURATION(mark + ", StopWords lookup"s);
+        for (const string& document : documents) {
+            SplitIntoWords(document, words);
+            for (const string_view word : words) {
+                stop_count -= stop_words.Contains(word);
+            }
+        }
+    }
+    cout << stop_count << endl;
+
+    vector<NewDocument> batch;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        batch.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+    }
+    SearchServer search_server(stop_word_list);
+    {
+        LOG_DURATION(mark + ", ingest"s);
+        search_server.AddDocuments(batch);
+    }
+    Test(mark + ", queries"s, search_server, queries, execution::seq);
+}
+
+// пропускная способность запросов: новые буферы на каждый запрос против переиспользуемого контекста
+template <typename Query>
+void BenchmarkQueries(string_view mark, const vector<string>& queries, Query query, int repeat_count = 10) {
+    double total_relevance = 0;
+    const auto start = chrono::steady_clock::now();
+    for (int i = 0; i < repeat_count; ++i) {
+        for (const string& text : queries) {
+            for (const Document& document : query(text)) {
+                total_relevance += document.relevance;
+            }
+        }
+    }
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << mark << ": "s << static_cast<int64_t>(queries.size() * repeat_count / seconds) << " QPS"s << endl;
+    cout << total_relevance << endl;
+}
+
+void BenchmarkQueryContext(const SearchServer& search_server, const vector<string>& queries, string_view mark) {
+    BenchmarkQueries("FindTopDocuments, "s + string(mark), queries, [&search_server](const string& query) {
+        return search_server.FindTopDocuments(query);
+    });
+    QueryContext context;
+    BenchmarkQueries("FindTopDocuments with QueryContext, "s + string(mark), queries,
+        [&search_server, &context](const string& query) -> const vector<Document>& {
+            return search_server.FindTopDocuments(context, query);
+        });
+
+    // те же запросы через RequestQueue: куда уходит время и какой запрос самый медленный
+    RequestQueue request_queue(search_server);
+    for (const string& query : queries) {
+        request_queue.AddFindRequest(query);
+    }
+    const QueryStats& stats = request_queue.GetWindowStats();
+    const auto to_ms = [](chrono::nanoseconds time) {
+        return chrono::duration<double, milli>(time).count();
+    };
+    cerr << "RequestQueue window, "s << mark << ": postings "s << stats.postings_scanned << ", candidates "s << stats.candidates
+        << ", parse "s << to_ms(stats.parse_time) << " ms, minus "s << to_ms(stats.minus_filter_time) << " ms, scan "s
+        << to_ms(stats.scan_time) << " ms, top-K "s << to_ms(stats.top_k_time) << " ms"s << endl;
+    const auto slowest = request_queue.GetSlowestRequests(1);
+    cerr << "slowest query: "s << slowest[0].second.plus_terms << " plus and "s << slowest[0].second.minus_terms
+        << " minus terms, "s << slowest[0].second.postings_scanned << " postings, "s << to_ms(slowest[0].second.GetTotalTime())
+        << " ms"s << endl;
+}
+
+// поток запросов с распределением Ципфа: запрос с рангом k встречается с частотой ~ 1 / k^exponent
+vector<string> GenerateZipfQueries(mt19937& generator, const vector<string>& distinct_queries, int query_count, double exponent) {
+    vector<double> cumulative(distinct_queries.size());
+    double total = 0;
+    for (size_t rank = 0; rank < distinct_queries.size(); ++rank) {
+        total += 1.0 / pow(rank + 1, exponent);
+        cumulative[rank] = total;
+    }
+    vector<string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        const double point = uniform_real_distribution<>(0, total)(generator);
+        const size_t rank = lower_bound(cumulative.begin(), cumulative.end(), point) - cumulative.begin();
+        queries.push_back(distinct_queries[min(rank, distinct_queries.size() - 1)]);
+    }
+    return queries;
+}
+
+void BenchmarkQueryCache(mt19937& generator, const SearchServer& search_server, const vector<string>& dictionary) {
+    const auto distinct_queries = GenerateQueries(generator, dictionary, 100'000, 3);
+    const auto queries = GenerateZipfQueries(generator, distinct_queries, 20'000, 1.0);
+    BenchmarkQueries("Zipf queries without cache"s, queries, [&search_server](const string& query) {
+        return search_server.FindTopDocuments(query);
+    }, 1);
+    for (const size_t capacity : { 1'000, 10'000 }) {
+        QueryCache cache(search_server, capacity);
+        BenchmarkQueries("Zipf queries, cache of "s + to_string(capacity), queries, [&cache](const string& query) {
+            return cache.FindTopDocuments(query);
+        }, 1);
+        const auto stats = cache.GetStats();
+        cerr << "hits: "s << stats.hits << ", misses: "s << stats.misses << ", rejected: "s << stats.rejections << endl;
+    }
+}
+
+// масштабирование пакета из 10 000 запросов по числу потоков
+void BenchmarkQueryExecutor(mt19937& generator, const SearchServer& search_server, const vector<string>& dictionary) {
+    const auto queries = GenerateQueries(generator, dictionary, 10'000, 10);
+    const auto measure = [&queries](string_view mark, const auto& process) {
+        const auto start = chrono::steady_clock::now();
+        const size_t found_count = process().size();
+        const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cerr << mark << ": "s << static_cast<int64_t>(queries.size() / seconds) << " QPS"s << endl;
+        cout << found_count << endl;
+    };
+    measure("transform(par)"s, [&search_server, &queries] {
+        vector<vector<Document>> result(queries.size());
+        transform(execution::par, queries.begin(), queries.end(), result.begin(), [&search_server](const string& query) {
+            return search_server.FindTopDocuments(query);
+        });
+        return result;
+    });
+    const size_t max_thread_count = max(2u, thread::hardware_concurrency());
+    for (size_t thread_count = 1; thread_count <= max_thread_count; thread_count *= 2) {
+        for (const bool pin_threads : { false, true }) {
+            QueryExecutor::Options options;
+            options.thread_count = thread_count;
+            options.pin_threads = pin_threads;
+            QueryExecutor executor(options);
+            const string mark = "QueryExecutor, "s + to_string(thread_count) + " threads"s + (pin_threads ? ", pinned"s : ""s);
+            measure(mark, [&executor, &search_server, &queries] {
+                return executor.ProcessQueries(search_server, queries);
+            });
+            measure(mark + ", joined"s, [&executor, &search_server, &queries] {
+                return executor.ProcessQueriesJoined(search_server, queries);
+            });
+        }
+    }
+}
+
+// открытая нагрузка сверх пропускной способности: задержки принятых запросов и доля отказов
+void BenchmarkQueryDispatcher(mt19937& generator, const SearchServer& search_server, const vector<string>& dictionary) {
+    const auto queries = GenerateQueries(generator, dictionary, 10'000, 10);
+    double capacity = 0;
+    {
+        QueryContext context;
+        const auto start = chrono::steady_clock::now();
+        for (const string& query : queries) {
+            search_server.FindTopDocuments(context, query);
+        }
+        capacity = queries.size() / chrono::duration<double>(chrono::steady_clock::now() - start).count()
+            * max(1u, thread::hardware_concurrency());
+    }
+    const auto interval = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(0.5 / capacity));
+    for (const auto& [max_queue_depth, timeout_ms] : vector<pair<size_t, int>>{ { 100'000, 0 }, { 64, 0 }, { 64, 20 } }) {
+        vector<double> latencies(queries.size(), -1);
+        QueryDispatcher::Stats stats;
+        {
+            QueryDispatcher::Options options;
+            options.max_queue_depth = max_queue_depth;
+            QueryDispatcher dispatcher(search_server, options);
+            QueryOptions query_options;
+            query_options.timeout = chrono::milliseconds(timeout_ms);
+            auto next_arrival = chrono::steady_clock::now();
+            for (size_t i = 0; i < queries.size(); ++i) {
+                this_thread::sleep_until(next_arrival);
+                next_arrival += interval;
+                const auto submitted = chrono::steady_clock::now();
+                dispatcher.SubmitQuery(queries[i], query_options,
+                    [&latencies, i, submitted](vector<Document>, exception_ptr error) {
+                        if (!error) {
+                            latencies[i] = chrono::duration<double, milli>(chrono::steady_clock::now() - submitted).count();
+                        }
+                    });
+            }
+            while (dispatcher.GetQueueDepth() > 0) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+            stats = dispatcher.GetStats();
+        }
+        latencies.erase(remove(latencies.begin(), latencies.end(), -1), latencies.end());
+        sort(latencies.begin(), latencies.end());
+        const auto percentile = [&latencies](double share) {
+            return latencies.empty() ? 0.0 : latencies[static_cast<size_t>(share * (latencies.size() - 1))];
+        };
+        cerr << "QueryDispatcher at 2x capacity, queue depth "s << max_queue_depth
+            << (timeout_ms ? ", deadline "s + to_string(timeout_ms) + " ms"s : ""s)
+            << ": p50 "s << percentile(0.5) << " ms, p99 "s << percentile(0.99) << " ms, completed "s << latencies.size()
+            << ", rejected "s << stats.rejected << ", expired "s << stats.expired << endl;
+    }
+}
+
+// чтение во время записи: общий shared_mutex против публикации неизменяемых поколений
+template <typename Read, typename Write>
+void BenchmarkReadsDuringWrites(string_view mark, const vector<string>& queries, int max_write_count, Read read, Write write) {
+    const unsigned reader_count = max(2u, thread::hardware_concurrency());
+    atomic<unsigned> finished_readers = 0;
+    vector<thread> readers;
+    const auto start = chrono::steady_clock::now();
+    for (unsigned i = 0; i < reader_count; ++i) {
+        readers.emplace_back([&, i] {
+            QueryContext context;
+            for (size_t j = 0; j < queries.size() * 5; ++j) {
+                read(context, queries[(i + j) % queries.size()]);
+            }
+            ++finished_readers;
+        });
+    }
+    // пишем, пока читатели не закончат
+    int write_count = 0;
+    while (finished_readers < reader_count && write_count < max_write_count) {
+        write(write_count++);
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << mark << ": "s << static_cast<int64_t>(reader_count * queries.size() * 5 / seconds) << " reads/s, "s
+        << write_count / seconds << " writes/s"s << endl;
+}
+
+void BenchmarkVersionedSearchServer(mt19937& generator, const SearchServer& search_server, const vector<string>& dictionary) {
+    const auto queries = GenerateQueries(generator, dictionary, 1'000, 3);
+    const auto documents = GenerateQueries(generator, dictionary, 2'000, 70);
+    const int first_id = 1'000'000;
+    // каждая запись добавляет пакет из 10 документов
+    const auto make_batch = [&documents, first_id](int write) {
+        vector<NewDocument> batch;
+        for (int i = write * 10; i < write * 10 + 10; ++i) {
+            batch.push_back({ first_id + i, documents[i], DocumentStatus::ACTUAL, { 1 } });
+        }
+        return batch;
+    };
+    {
+        SearchServer locked = search_server;
+        shared_mutex mutex;
+        BenchmarkReadsDuringWrites("shared_mutex"s, queries, 200,
+            [&locked, &mutex](QueryContext& context, const string& query) {
+                shared_lock lock(mutex);
+                locked.FindTopDocuments(context, query);
+            },
+            [&locked, &mutex, &make_batch](int write) {
+                const auto batch = make_batch(write);
+                lock_guard guard(mutex);
+                locked.AddDocuments(batch);
+            });
+    }
+    {
+        VersionedSearchServer versioned(search_server);
+        BenchmarkReadsDuringWrites("VersionedSearchServer"s, queries, 200,
+            [&versioned](QueryContext& context, const string& query) {
+                versioned.GetSnapshot()->FindTopDocuments(context, query);
+            },
+            [&versioned, &make_batch](int write) {
+                versioned.AddDocuments(make_batch(write));
+            });
+    }
+}
+
+// непрерывная запись с параллельными запросами: одно поколение целиком против сегментов
+template <typename Index>
+void BenchmarkSustainedIngest(string_view mark, Index& index, const vector<string>& documents, const vector<string>& queries) {
+    atomic<bool> stop = false;
+    atomic<int64_t> read_count = 0;
+    thread reader([&index, &queries, &stop, &read_count] {
+        QueryContext context;
+        for (size_t i = 0; !stop; i = (i + 1) % queries.size()) {
+            if constexpr (is_same_v<Index, VersionedSearchServer>) {
+                index.GetSnapshot()->FindTopDocuments(context, queries[i]);
+            }
+            else {
+                index.FindTopDocuments(context, queries[i]);
+            }
+            ++read_count;
+        }
+    });
+    vector<double> latencies;
+    latencies.reserve(documents.size());
+    const auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const auto added = chrono::steady_clock::now();
+        index.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        latencies.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - added).count());
+    }
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    stop = true;
+    reader.join();
+    sort(latencies.begin(), latencies.end());
+    cerr << mark << ": "s << static_cast<int64_t>(documents.size() / seconds) << " documents/s, p99 "s
+        << latencies[latencies.size() * 99 / 100] << " ms, max "s << latencies.back() << " ms, "s
+        << static_cast<int64_t>(read_count / seconds) << " queries/s"s << endl;
+}
+
+void BenchmarkSegments(mt19937& generator, const vector<string>& dictionary) {
+    const auto documents = GenerateQueries(generator, dictionary, 20'000, 20);
+    const auto queries = GenerateQueries(generator, dictionary, 1'000, 3);
+    {
+        VersionedSearchServer index{ SearchServer(dictionary[0]) };
+        BenchmarkSustainedIngest("VersionedSearchServer, 20000 documents"s, index, documents, queries);
+    }
+    {
+        SegmentedSearchServer index(dictionary[0]);
+        BenchmarkSustainedIngest("SegmentedSearchServer, 20000 documents"s, index, documents, queries);
+        index.WaitForMerges();
+        cerr << "segments after merging: "s << index.GetSegmentCount() << endl;
+    }
+}
+
+// объём резидентной памяти процесса, 0 там, где его не узнать
+size_t GetResidentSetSize() {
+#if defined(__linux__)
+    ifstream statm("/proc/self/statm"s);
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+    statm >> total_pages >> resident_pages;
+    return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+// миллион циклов добавления и удаления: у каждого документа есть своё уникальное слово
+void BenchmarkChurn(mt19937& generator, const vector<string>& dictionary) {
+    const int window = 10'000;
+    const int cycle_count = 1'000'000;
+    SearchServer search_server(dictionary[0]);
+    LOG_DURATION("churn, "s + to_string(cycle_count) + " add/remove cycles"s);
+    string text;
+    for (int id = 0; id < cycle_count; ++id) {
+        text.clear();
+        for (int i = 0; i < 10; ++i) {
+            text += dictionary[uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)];
+            text += ' ';
+        }
+        text += "unique"s + to_string(id);
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+        if (id >= window) {
+            search_server.RemoveDocument(id - window);
+            // нигде не держим итераторов и строк индекса, уплотнять можно сразу
+            search_server.CompactIfSparse();
+        }
+        if ((id + 1) % 200'000 == 0) {
+            cerr << "churn, "s << id + 1 << " cycles: RSS "s << GetResidentSetSize() / 1024 << " KiB"s << endl;
+        }
+    }
+}
+
+// прежний поиск дубликатов: набор слов каждого документа копируется в set<string>
+vector<int> FindDuplicatesByWordSets(const SearchServer& search_server) {
+    vector<int> duplicates;
+    map<set<string>, int> unique_documents;
+    for (const int id : search_server) {
+        set<string> words;
+        for (const auto& [word, _] : search_server.GetWordFrequencies(id)) {
+            words.insert(string(word));
+        }
+        const auto [it, inserted] = unique_documents.insert({ move(words), id });
+        if (!inserted) {
+            duplicates.push_back(max(it->second, id));
+            it->second = min(it->second, id);
+        }
+    }
+    sort(duplicates.begin(), duplicates.end());
+    return duplicates;
+}
+
+// миллион документов: каждый десятый повторяет набор слов одного из прежних,
+// а ещё каждый десятый отличается от прежнего одним словом
+void BenchmarkDuplicates(mt19937& generator, const vector<string>& dictionary) {
+    const int document_count = 1'000'000;
+    const int word_count = 10;
+    vector<string> texts;
+    texts.reserve(document_count);
+    for (int id = 0; id < document_count; ++id) {
+        if (id % 10 == 3 || id % 10 == 7) {
+            vector<string_view> words = SplitIntoWords(texts[uniform_int_distribution(0, id - 1)(generator)]);
+            if (id % 10 == 3) {
+                shuffle(words.begin(), words.end(), generator);
+            }
+            else {
+                words.back() = dictionary[uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)];
+            }
+            string text;
+            for (const string_view word : words) {
+                text += word;
+                text += ' ';
+            }
+            texts.push_back(move(text));
+        }
+        else {
+            texts.push_back(GenerateQuery(generator, dictionary, word_count));
+        }
+    }
+    vector<NewDocument> batch;
+    for (int id = 0; id < document_count; ++id) {
+        batch.push_back({ id, texts[id], DocumentStatus::ACTUAL, { 1 } });
+    }
+    SearchServer search_server(dictionary[0]);
+    search_server.AddDocuments(execution::par, batch);
+
+    vector<int> duplicates;
+    {
+        LOG_DURATION("FindDuplicates, 1000000 documents"s);
+        duplicates = FindDuplicates(search_server);
+    }
+    cerr << "duplicates: "s << duplicates.size() << endl;
+    {
+        // дубликаты отбрасываются при добавлении, без отдельного прохода по индексу
+        LOG_DURATION("AddDocument with DuplicatePolicy::REJECT, 1000000 documents"s);
+        SearchServer deduplicated(dictionary[0]);
+        size_t rejected = 0;
+        for (int id = 0; id < document_count; ++id) {
+            rejected += deduplicated.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { 1 }, DuplicatePolicy::REJECT).has_value();
+        }
+        cerr << "rejected: "s << rejected << endl;
+    }
+    // освобождение миллиона set<string> замедляет то, что идёт следом, поэтому этот проход идёт после отпечатков
+    {
+        LOG_DURATION("duplicates by map<set<string>, int>, 1000000 documents"s);
+        duplicates = FindDuplicatesByWordSets(search_server);
+    }
+    cerr << "duplicates: "s << duplicates.size() << endl;
+    {
+        LOG_DURATION("FindNearDuplicates, 1000000 documents"s);
+        duplicates = FindNearDuplicates(search_server);
+    }
+    cerr << "near duplicates: "s << duplicates.size() << endl;
+    {
+        LOG_DURATION("RemoveDocuments of the near duplicates"s);
+        search_server.RemoveDocuments(execution::par, duplicates);
+    }
+}
+
+// холодный старт: повторное добавление всех документов против загрузки снимка
+void BenchmarkSnapshot(const vector<string>& dictionary, const vector<string>& documents) {
+    const string path = (filesystem::temp_directory_path() / "search_server_benchmark.snapshot"s).string();
+    {
+        LOG_DURATION("replay AddDocument, "s + to_string(documents.size()) + " documents"s);
+        SearchServer search_server(dictionary[0]);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+        search_server.SaveSnapshot(path);
+    }
+    {
+        LOG_DURATION("LoadSnapshot"s);
+        const SearchServer search_server = SearchServer::LoadSnapshot(path);
+        cout << search_server.GetDocumentCount() << endl;
+    }
+    {
+        LOG_DURATION("LoadSnapshot with every posting decoded"s);
+        const SearchServer search_server = SearchServer::LoadSnapshot(path, SnapshotCheck::FULL);
+        cout << search_server.GetDocumentCount() << endl;
+    }
+    filesystem::remove(path);
+}
+
+// набор бенчмарков на сгенерированных корпусах с отчётом в JSON:
+// main --benchmark [--seed N] [--documents N] [--repetitions N] [--output FILE]
+//      [--baseline FILE] [--threshold PERCENT]
+// Возвращает 1, если относительно baseline что-то ухудшилось больше чем на threshold процентов
+int RunBenchmarkSuite(const vector<string>& args) {
+    uint32_t seed = 1;
+    int document_count = 10'000;
+    BenchmarkOptions options;
+    string output_path;
+    string baseline_path;
+    double threshold_percent = 10;
+    try {
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (i + 1 == args.size()) {
+                throw invalid_argument("no value for "s + args[i]);
+            }
+            const string& value = args[++i];
+            if (args[i - 1] == "--seed"s) {
+                seed = static_cast<uint32_t>(stoul(value));
+            } else if (args[i - 1] == "--documents"s) {
+                document_count = stoi(value);
+            } else if (args[i - 1] == "--repetitions"s) {
+                options.repetitions = stoi(value);
+            } else if (args[i - 1] == "--output"s) {
+                output_path = value;
+            } else if (args[i - 1] == "--baseline"s) {
+                baseline_path = value;
+            } else if (args[i - 1] == "--threshold"s) {
+                threshold_percent = stod(value);
+            } else {
+                throw invalid_argument("unknown option "s + args[i - 1]);
+            }
+        }
+    } catch (const logic_error& e) {
+        cerr << e.what() << endl;
+        cerr << "usage: main --benchmark [--seed N] [--documents N] [--repetitions N] [--output FILE] "s
+            << "[--baseline FILE] [--threshold PERCENT]"s << endl;
+        return 2;
+    }
+    options.corpora = GetStandardCorpora(seed, document_count);
+
+    // baseline читается и сверяется с корпусами до прогона, чтобы не ждать его ради ошибки в файле
+    optional<BenchmarkReport> baseline;
+    if (!baseline_path.empty()) {
+        ifstream in(baseline_path);
+        if (!in) {
+            cerr << "cannot open "s << baseline_path << endl;
+            return 2;
+        }
+        try {
+            baseline = ReadBenchmarkReport(in);
+            FindRegressions(*baseline, { options.corpora, {} }, threshold_percent);
+        } catch (const invalid_argument& e) {
+            cerr << e.what() << endl;
+            return 2;
+        }
+    }
+
+    const BenchmarkReport report = RunBenchmarks(options, cerr);
+    if (output_path.empty()) {
+        WriteBenchmarkReport(cout, report);
+    } else {
+        ofstream out(output_path);
+        WriteBenchmarkReport(out, report);
+    }
+    if (!baseline) {
+        return 0;
+    }
+    const auto regressions = FindRegressions(*baseline, report, threshold_percent);
+    for (const auto& regression : regressions) {
+        cerr << "regression: "s << regression.name << " "s << regression.metric << " "s << regression.baseline
+            << " -> "s << regression.current << endl;
+    }
+    return regressions.empty() ? 0 : 1;
+}
+
+// ручные замеры сверх набора --benchmark, вместе они идут дольше десяти минут
+void RunExperiments(mt19937& generator, const vector<string>& dictionary, const vector<string>& documents,
+    const SearchServer& search_server, const vector<string>& queries) {
+    Test("daat"s, search_server, queries, query_policy::daat);
+#ifdef SEARCH_SERVER_TRACING
+    // длительности этапов запросов прогонов TEST(seq), TEST(par) и daat
+    Tracer::Dump(cerr);
+#endif
+
+    // короткие запросы: здесь document-at-a-time отсекает больше всего кандидатов
+    const auto short_queries = GenerateQueries(generator, dictionary, 1'000, 3);
+    Test("seq, 3-word queries"s, search_server, short_queries, execution::seq);
+    Test("daat, 3-word queries"s, search_server, short_queries, query_policy::daat);
+
+    BenchmarkQueryContext(search_server, queries, "70-word queries"s);
+    BenchmarkQueryContext(search_server, short_queries, "3-word queries"s);
+    BenchmarkQueryCache(generator, search_server, dictionary);
+    BenchmarkQueryExecutor(generator, search_server, dictionary);
+    BenchmarkQueryDispatcher(generator, search_server, dictionary);
+    BenchmarkVersionedSearchServer(generator, search_server, dictionary);
+    BenchmarkSegments(generator, dictionary);
+    BenchmarkChurn(generator, dictionary);
+    BenchmarkDuplicates(generator, dictionary);
+
+    BenchmarkCommonTerms(generator, dictionary);
+    BenchmarkAccumulators(generator, static_cast<int>(documents.size()));
+    BenchmarkTopK(generator);
+    BenchmarkSnapshot(dictionary, documents);
+    BenchmarkTokenizer(documents);
+    BenchmarkStopWords(generator, dictionary, documents, queries, 10);
+    BenchmarkStopWords(generator, dictionary, documents, queries, 10'000);
+    BenchmarkIngests(generator, dictionary, 10'000, 70);
+    BenchmarkIngests(generator, dictionary, 1'000'000, 20);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && argv[1] == "--benchmark"s) {
+        return RunBenchmarkSuite(vector<string>(argv + 2, argv + argc));
+    }
     TestSearchServer(); //общие тесты поисковой системы
     mt19937 generator;
 
@@ -85,4 +889,8 @@ int main() {
     //тест параллельности
     TEST(seq);
     TEST(par);
-}
\ No newline at end of file
+
+    if (argc > 1 && argv[1] == "--experiments"s) {
+        RunExperiments(generator, dictionary, documents, search_server, queries);
+    }
+}
@@ -1,6 +1,9 @@
 #pragma once
 #include <iostream>
-#include <vector>
+#include <iterator>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
 #include <algorithm>
 #include <cassert>
 #include "document.h"
@@ -10,8 +13,7 @@ class IteratorRange {
 public:
     IteratorRange(Iterator begin, Iterator end)
         : first_(begin)
-        , last_(end)
-        , size_(distance(first_, last_)) {
+        , last_(end) {
     }
     Iterator begin() const {
         return first_;
@@ -20,11 +22,10 @@ public:
         return last_;
     }
     size_t size() const {
-        return size_;
+        return distance(first_, last_);
     }
 private:
     Iterator first_, last_;
-    size_t size_;
 };
 
 template <typename Iterator>
@@ -35,30 +36,147 @@ std::ostream& operator<<(std::ostream& out, const IteratorRange<Iterator>& range
     return out;
 }
 
+// Appends the text operator<< prints for the documents of the page to the buffer
+template <typename Iterator>
+void AppendPage(std::string& buffer, const IteratorRange<Iterator>& page) {
+    for (Iterator it = page.begin(); it != page.end(); ++it) {
+        AppendDocument(buffer, *it);
+    }
+}
+
+// View of a random-access range as pages of page_size elements, the last one possibly
+// shorter. Pages are computed when asked for, so nothing is allocated or copied
 template <typename Iterator>
 class Paginator {
+    static_assert(std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>,
+        "Paginator computes page boundaries by iterator arithmetic");
 public:
-    Paginator(Iterator begin, Iterator end, size_t page_size) {
-        assert(end >= begin && page_size > 0);
-        for (size_t left = distance(begin, end); left > 0;) {
-            const size_t current_page_size = std::min(page_size, left);
-            const Iterator current_page_end = next(begin, current_page_size);
-            pages_.push_back({ begin, current_page_end });
-            left -= current_page_size;
-            begin = current_page_end;
+    using Page = IteratorRange<Iterator>;
+
+    // Yields pages by value; it keeps the bounds itself and outlives its Paginator
+    class PageIterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = Page;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Page;
+
+        PageIterator() = default;
+        PageIterator(Iterator begin, Iterator end, size_t page_size, size_t index)
+            : begin_(begin)
+            , end_(end)
+            , page_size_(page_size)
+            , index_(index) {
+        }
+
+        Page operator*() const {
+            return GetPage(begin_, end_, page_size_, index_);
+        }
+        Page operator[](difference_type offset) const {
+            return GetPage(begin_, end_, page_size_, index_ + offset);
+        }
+
+        PageIterator& operator++() {
+            ++index_;
+            return *this;
+        }
+        PageIterator operator++(int) {
+            PageIterator previous = *this;
+            ++index_;
+            return previous;
+        }
+        PageIterator& operator--() {
+            --index_;
+            return *this;
+        }
+        PageIterator operator--(int) {
+            PageIterator previous = *this;
+            --index_;
+            return previous;
+        }
+        PageIterator& operator+=(difference_type offset) {
+            index_ += offset;
+            return *this;
+        }
+        PageIterator& operator-=(difference_type offset) {
+            index_ -= offset;
+            return *this;
+        }
+        PageIterator operator+(difference_type offset) const {
+            return PageIterator(*this) += offset;
         }
+        PageIterator operator-(difference_type offset) const {
+            return PageIterator(*this) -= offset;
+        }
+        difference_type operator-(const PageIterator& other) const {
+            return static_cast<difference_type>(index_) - static_cast<difference_type>(other.index_);
+        }
+
+        bool operator==(const PageIterator& other) const {
+            return index_ == other.index_;
+        }
+        bool operator!=(const PageIterator& other) const {
+            return index_ != other.index_;
+        }
+        bool operator<(const PageIterator& other) const {
+            return index_ < other.index_;
+        }
+        bool operator>(const PageIterator& other) const {
+            return index_ > other.index_;
+        }
+        bool operator<=(const PageIterator& other) const {
+            return index_ <= other.index_;
+        }
+        bool operator>=(const PageIterator& other) const {
+            return index_ >= other.index_;
+        }
+
+    private:
+        Iterator begin_{};
+        Iterator end_{};
+        size_t page_size_ = 1;
+        size_t index_ = 0;
+    };
+
+    Paginator(Iterator begin, Iterator end, size_t page_size)
+        : begin_(begin)
+        , end_(end)
+        , page_size_(page_size) {
+        assert(end >= begin && page_size > 0);
     }
-    auto begin() const {
-        return pages_.begin();
+    PageIterator begin() const {
+        return { begin_, end_, page_size_, 0 };
     }
-    auto end() const {
-        return pages_.end();
+    PageIterator end() const {
+        return { begin_, end_, page_size_, size() };
     }
     size_t size() const {
-        return pages_.size();
+        return (static_cast<size_t>(end_ - begin_) + page_size_ - 1) / page_size_;
+    }
+    bool empty() const {
+        return begin_ == end_;
+    }
+    Page operator[](size_t index) const {
+        assert(index < size());
+        return GetPage(begin_, end_, page_size_, index);
+    }
+    // Throws out_of_range for an index past the last page
+    Page page(size_t index) const {
+        if (index >= size()) {
+            throw std::out_of_range("Page index is out of range");
+        }
+        return GetPage(begin_, end_, page_size_, index);
     }
 private:
-    std::vector<IteratorRange<Iterator>> pages_;
+    static Page GetPage(Iterator begin, Iterator end, size_t page_size, size_t index) {
+        const size_t total = end - begin;
+        const size_t first = std::min(index * page_size, total);
+        return { begin + first, begin + std::min(first + page_size, total) };
+    }
+
+    Iterator begin_, end_;
+    size_t page_size_;
 };
 
 template <typename Container>
@@ -0,0 +1,380 @@
+#include "posting_list.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+void WriteVarint(uint32_t value, vector<uint8_t>& out) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t ReadVarint(const uint8_t*& pos) {
+    uint32_t result = 0;
+    int shift = 0;
+    while (*pos & 0x80) {
+        result |= static_cast<uint32_t>(*pos++ & 0x7F) << shift;
+        shift += 7;
+    }
+    result |= static_cast<uint32_t>(*pos++) << shift;
+    return result;
+}
+
+// Same as ReadVarint, but returns false instead of reading past end or past five bytes
+bool ReadVarint(const uint8_t*& pos, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (pos == end) {
+            return false;
+        }
+        const uint8_t byte = *pos++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+PostingList::Cursor::Cursor(const PostingList& list)
+    : list_(&list) {
+    LoadBlock(0);
+}
+
+bool PostingList::Cursor::AtEnd() const {
+    return block_index_ >= list_->blocks_.size();
+}
+
+int PostingList::Cursor::GetDocumentId() const {
+    return current_.document_id;
+}
+
+uint32_t PostingList::Cursor::GetCount() const {
+    return current_.count;
+}
+
+void PostingList::Cursor::Next() {
+    if (--left_in_block_ == 0) {
+        LoadBlock(block_index_ + 1);
+    }
+    else {
+        Decode();
+    }
+}
+
+void PostingList::Cursor::Advance(int target) {
+    if (AtEnd() || current_.document_id >= target) {
+        return;
+    }
+    const auto& blocks = list_->blocks_;
+    if (blocks[block_index_].last_document_id < target) {
+        const auto next_block = lower_bound(blocks.begin() + block_index_ + 1, blocks.end(), target,
+            [](const Block& block, int id) {
+                return block.last_document_id < id;
+            });
+        LoadBlock(next_block - blocks.begin());
+    }
+    while (!AtEnd() && current_.document_id < target) {
+        Next();
+    }
+}
+
+int PostingList::Cursor::GetBlockLastDocumentId() const {
+    return list_->blocks_[block_index_].last_document_id;
+}
+
+double PostingList::Cursor::GetBlockMaxTermFreq() const {
+    return list_->blocks_[block_index_].max_term_freq;
+}
+
+double PostingList::Cursor::PeekBlockMaxTermFreq(int target) const {
+    const auto& blocks = list_->blocks_;
+    const auto block = lower_bound(blocks.begin() + block_index_, blocks.end(), target,
+        [](const Block& block, int id) {
+            return block.last_document_id < id;
+        });
+    return block == blocks.end() ? 0.0 : block->max_term_freq;
+}
+
+void PostingList::Cursor::LoadBlock(size_t block_index) {
+    block_index_ = block_index;
+    if (AtEnd()) {
+        return;
+    }
+    const Block& block = list_->blocks_[block_index];
+    pos_ = list_->data_.data() + block.offset;
+    left_in_block_ = block.size;
+    current_.document_id = block.first_document_id;
+    Decode();
+}
+
+void PostingList::Cursor::Decode() {
+    current_.document_id += ReadVarint(pos_);
+    current_.count = ReadVarint(pos_);
+}
+
+PostingList PostingList::View(const Block* blocks, size_t block_count, const uint8_t* data, size_t data_size,
+    size_t size, double max_term_freq) {
+    PostingList result;
+    result.blocks_ = CowVector<Block>::View(blocks, block_count);
+    result.data_ = CowVector<uint8_t>::View(data, data_size);
+    result.size_ = size;
+    result.max_term_freq_ = max_term_freq;
+    return result;
+}
+
+void PostingList::Add(int document_id, uint32_t count, double term_freq) {
+    max_term_freq_ = max(max_term_freq_, term_freq);
+    if (blocks_.empty() || document_id > blocks_.back().last_document_id) {
+        // documents usually arrive in increasing id order, so appending is the fast path
+        auto& blocks = blocks_.Mutable();
+        auto& data = data_.Mutable();
+        if (blocks.empty() || blocks.back().size == BLOCK_SIZE) {
+            blocks.push_back({ document_id, document_id, static_cast<uint32_t>(data.size()), 0, term_freq });
+        }
+        Block& block = blocks.back();
+        block.max_term_freq = max(block.max_term_freq, term_freq);
+        WriteVarint(document_id - block.last_document_id, data);
+        WriteVarint(count, data);
+        block.last_document_id = document_id;
+        ++block.size;
+        ++size_;
+        return;
+    }
+
+    const size_t block_index = FindBlock(document_id);
+    auto postings = DecodeBlock(block_index);
+    const auto it = lower_bound(postings.begin(), postings.end(), document_id,
+        [](const Posting& posting, int id) {
+            return posting.document_id < id;
+        });
+    if (it != postings.end() && it->document_id == document_id) {
+        it->count += count;
+    }
+    else {
+        postings.insert(it, { document_id, count });
+        ++size_;
+    }
+    ReplaceBlock(block_index, postings, max(blocks_[block_index].max_term_freq, term_freq));
+}
+
+bool PostingList::Erase(int document_id) {
+    const size_t block_index = FindBlock(document_id);
+    if (block_index == blocks_.size() || blocks_[block_index].first_document_id > document_id) {
+        return false;
+    }
+    auto postings = DecodeBlock(block_index);
+    const auto it = lower_bound(postings.begin(), postings.end(), document_id,
+        [](const Posting& posting, int id) {
+            return posting.document_id < id;
+        });
+    if (it == postings.end() || it->document_id != document_id) {
+        return false;
+    }
+    postings.erase(it);
+    // the block keeps its bound: it still holds for the remaining postings
+    ReplaceBlock(block_index, postings, blocks_[block_index].max_term_freq);
+    --size_;
+    return true;
+}
+
+size_t PostingList::Erase(const int* begin, const int* end) {
+    vector<Block> blocks;
+    vector<uint8_t> data;
+    blocks.reserve(blocks_.size());
+    data.reserve(data_.size());
+    size_t erased = 0;
+    for (size_t block_index = 0; block_index < blocks_.size(); ++block_index) {
+        const Block& block = blocks_[block_index];
+        begin = lower_bound(begin, end, block.first_document_id);
+        if (begin == end || *begin > block.last_document_id) {
+            const size_t block_end = block_index + 1 < blocks_.size() ? blocks_[block_index + 1].offset : data_.size();
+            blocks.push_back(block);
+            blocks.back().offset = static_cast<uint32_t>(data.size());
+            data.insert(data.end(), data_.data() + block.offset, data_.data() + block_end);
+            continue;
+        }
+        auto postings = DecodeBlock(block_index);
+        const auto kept_end = remove_if(postings.begin(), postings.end(), [&begin, end](const Posting& posting) {
+            while (begin != end && *begin < posting.document_id) {
+                ++begin;
+            }
+            return begin != end && *begin == posting.document_id;
+        });
+        erased += postings.end() - kept_end;
+        postings.erase(kept_end, postings.end());
+        if (!postings.empty()) {
+            // the block keeps its bound: it still holds for the remaining postings
+            blocks.push_back({ postings.front().document_id, postings.back().document_id,
+                static_cast<uint32_t>(data.size()), static_cast<uint32_t>(postings.size()), block.max_term_freq });
+            EncodePostings(postings.data(), postings.data() + postings.size(), data);
+        }
+    }
+    if (erased > 0) {
+        blocks_ = CowVector<Block>();
+        blocks_.Mutable() = move(blocks);
+        data_ = CowVector<uint8_t>();
+        data_.Mutable() = move(data);
+        size_ -= erased;
+    }
+    return erased;
+}
+
+uint32_t PostingList::GetCount(int document_id) const {
+    const size_t block_index = FindBlock(document_id);
+    if (block_index == blocks_.size()) {
+        return 0;
+    }
+    const Block& block = blocks_[block_index];
+    const uint8_t* pos = data_.data() + block.offset;
+    int current_id = block.first_document_id;
+    for (uint32_t i = 0; i < block.size; ++i) {
+        current_id += ReadVarint(pos);
+        const uint32_t count = ReadVarint(pos);
+        if (current_id >= document_id) {
+            return current_id == document_id ? count : 0;
+        }
+    }
+    return 0;
+}
+
+PostingList::Cursor PostingList::GetCursor() const {
+    return Cursor(*this);
+}
+
+double PostingList::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+size_t PostingList::size() const {
+    return size_;
+}
+
+bool PostingList::empty() const {
+    return size_ == 0;
+}
+
+size_t PostingList::GetMemoryUsage() const {
+    return sizeof(*this) + blocks_.GetMemoryUsage() + data_.GetMemoryUsage();
+}
+
+bool PostingList::HasWellFormedBlocks(int document_id_bound) const {
+    size_t posting_count = 0;
+    int64_t previous_id = -1;
+    for (size_t block_index = 0; block_index < blocks_.size(); ++block_index) {
+        const Block& block = blocks_[block_index];
+        const size_t block_end = block_index + 1 < blocks_.size() ? blocks_[block_index + 1].offset : data_.size();
+        if (block.size == 0 || block.size > BLOCK_SIZE || block.offset > block_end || block_end > data_.size()
+            || block.first_document_id <= previous_id || block.last_document_id < block.first_document_id
+            || block.last_document_id >= document_id_bound) {
+            return false;
+        }
+        previous_id = block.last_document_id;
+        posting_count += block.size;
+    }
+    return posting_count == size_;
+}
+
+bool PostingList::IsWellFormed(int document_id_bound) const {
+    if (!HasWellFormedBlocks(document_id_bound)) {
+        return false;
+    }
+    for (size_t block_index = 0; block_index < blocks_.size(); ++block_index) {
+        const Block& block = blocks_[block_index];
+        const size_t block_end = block_index + 1 < blocks_.size() ? blocks_[block_index + 1].offset : data_.size();
+        // the first posting of a block has a zero delta
+        const uint8_t* pos = data_.data() + block.offset;
+        const uint8_t* end = data_.data() + block_end;
+        int64_t document_id = block.first_document_id;
+        for (uint32_t i = 0; i < block.size; ++i) {
+            uint32_t delta = 0;
+            uint32_t count = 0;
+            if (!ReadVarint(pos, end, delta) || !ReadVarint(pos, end, count) || (delta == 0) != (i == 0)) {
+                return false;
+            }
+            document_id += delta;
+            if (document_id > block.last_document_id) {
+                return false;
+            }
+        }
+        if (pos != end || document_id != block.last_document_id) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const CowVector<PostingList::Block>& PostingList::GetBlocks() const {
+    return blocks_;
+}
+
+const CowVector<uint8_t>& PostingList::GetData() const {
+    return data_;
+}
+
+size_t PostingList::FindBlock(int document_id) const {
+    return lower_bound(blocks_.begin(), blocks_.end(), document_id,
+        [](const Block& block, int id) {
+            return block.last_document_id < id;
+        }) - blocks_.begin();
+}
+
+vector<PostingList::Posting> PostingList::DecodeBlock(size_t block_index) const {
+    const Block& block = blocks_[block_index];
+    vector<Posting> postings;
+    postings.reserve(block.size + 1);
+    const uint8_t* pos = data_.data() + block.offset;
+    int current_id = block.first_document_id;
+    for (uint32_t i = 0; i < block.size; ++i) {
+        current_id += ReadVarint(pos);
+        postings.push_back({ current_id, ReadVarint(pos) });
+    }
+    return postings;
+}
+
+// Re-encodes one block from the given postings. An overflowing block is split
+// in two and an empty one is dropped; offsets of the following blocks are shifted.
+// Term frequencies are not stored per posting, so the new blocks take the given bound.
+void PostingList::ReplaceBlock(size_t block_index, const vector<Posting>& postings, double max_term_freq) {
+    auto& blocks = blocks_.Mutable();
+    auto& data = data_.Mutable();
+    const size_t old_begin = blocks[block_index].offset;
+    const size_t old_end = block_index + 1 < blocks.size() ? blocks[block_index + 1].offset : data.size();
+
+    const size_t block_count = (postings.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    vector<uint8_t> encoded;
+    vector<Block> new_blocks;
+    for (size_t i = 0; i < block_count; ++i) {
+        const Posting* begin = postings.data() + postings.size() * i / block_count;
+        const Posting* end = postings.data() + postings.size() * (i + 1) / block_count;
+        new_blocks.push_back({ begin->document_id, (end - 1)->document_id,
+            static_cast<uint32_t>(old_begin + encoded.size()), static_cast<uint32_t>(end - begin), max_term_freq });
+        EncodePostings(begin, end, encoded);
+    }
+
+    const auto shift = static_cast<int64_t>(encoded.size()) - static_cast<int64_t>(old_end - old_begin);
+    data.erase(data.begin() + old_begin, data.begin() + old_end);
+    data.insert(data.begin() + old_begin, encoded.begin(), encoded.end());
+
+    blocks.erase(blocks.begin() + block_index);
+    blocks.insert(blocks.begin() + block_index, new_blocks.begin(), new_blocks.end());
+    for (size_t i = block_index + new_blocks.size(); i < blocks.size(); ++i) {
+        blocks[i].offset = static_cast<uint32_t>(blocks[i].offset + shift);
+    }
+}
+
+void PostingList::EncodePostings(const Posting* begin, const Posting* end, vector<uint8_t>& out) {
+    int previous_id = begin->document_id;
+    for (const Posting* posting = begin; posting != end; ++posting) {
+        WriteVarint(posting->document_id - previous_id, out);
+        WriteVarint(posting->count, out);
+        previous_id = posting->document_id;
+    }
+}
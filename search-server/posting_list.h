@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cow_vector.h"
+
+// Sorted list of (document id, occurrence count) pairs for one term.
+// Postings are packed into blocks of up to BLOCK_SIZE entries: ids are stored
+// as varint deltas followed by the varint count, so a scan reads one
+// contiguous byte buffer. The term frequency of a posting is count / document length.
+// Every block records its last id and an upper bound of its term frequencies,
+// which lets the search skip blocks that cannot reach the top results.
+class PostingList {
+public:
+    static const size_t BLOCK_SIZE = 128;
+
+    struct Posting {
+        int document_id;
+        uint32_t count;
+    };
+
+    // Offsets are relative to the start of the list's byte buffer
+    struct Block {
+        int first_document_id;
+        int last_document_id;
+        uint32_t offset;
+        uint32_t size;
+        double max_term_freq;
+    };
+
+    PostingList() = default;
+
+    // List over blocks and bytes owned by someone else, e.g. a mapped snapshot.
+    // The memory is copied only if the list is modified
+    static PostingList View(const Block* blocks, size_t block_count, const uint8_t* data, size_t data_size,
+        size_t size, double max_term_freq);
+
+    // Forward iterator over the postings in document id order
+    class Cursor {
+    public:
+        explicit Cursor(const PostingList& list);
+
+        bool AtEnd() const;
+        int GetDocumentId() const;
+        uint32_t GetCount() const;
+
+        void Next();
+        // Moves to the first posting with document id >= target, skipping whole blocks
+        void Advance(int target);
+
+        // Metadata of the block holding the current posting
+        int GetBlockLastDocumentId() const;
+        double GetBlockMaxTermFreq() const;
+        // Term frequency bound of the block that would hold target, without moving the cursor.
+        // Returns 0 if the list has no block at or after target
+        double PeekBlockMaxTermFreq(int target) const;
+
+    private:
+        void LoadBlock(size_t block_index);
+        void Decode();
+
+        const PostingList* list_;
+        size_t block_index_ = 0;
+        const uint8_t* pos_ = nullptr;
+        uint32_t left_in_block_ = 0;
+        Posting current_ = { 0, 0 };
+    };
+
+    // Adds occurrences of the term in the document, merging with an existing posting.
+    // term_freq is the resulting frequency of the term in the document
+    void Add(int document_id, uint32_t count, double term_freq);
+    bool Erase(int document_id);
+    // Erases the documents of the sorted range in one pass over the list and returns
+    // how many were found; blocks without any of them are copied as they are
+    size_t Erase(const int* begin, const int* end);
+
+    // Returns 0 if the document is not in the list
+    uint32_t GetCount(int document_id) const;
+
+    Cursor GetCursor() const;
+
+    // Upper bound of the term frequency over the list. It is not lowered by Erase,
+    // so it may overestimate but never underestimates
+    double GetMaxTermFreq() const;
+    size_t size() const;
+    bool empty() const;
+
+    size_t GetMemoryUsage() const;
+
+    // Whether the block table is consistent: blocks lie back to back inside the byte buffer,
+    // hold size() postings in total and have increasing id ranges below document_id_bound.
+    // Costs O(blocks); the posting bytes themselves are not read
+    bool HasWellFormedBlocks(int document_id_bound) const;
+    // Also decodes every posting and checks it against the block metadata. Checks a list
+    // viewing memory that cannot be trusted, such as a loaded snapshot, without reading
+    // outside of it
+    bool IsWellFormed(int document_id_bound) const;
+
+    const CowVector<Block>& GetBlocks() const;
+    const CowVector<uint8_t>& GetData() const;
+
+private:
+    size_t FindBlock(int document_id) const;
+    std::vector<Posting> DecodeBlock(size_t block_index) const;
+    void ReplaceBlock(size_t block_index, const std::vector<Posting>& postings, double max_term_freq);
+    static void EncodePostings(const Posting* begin, const Posting* end, std::vector<uint8_t>& out);
+
+    CowVector<Block> blocks_;
+    CowVector<uint8_t> data_;
+    size_t size_ = 0;
+    double max_term_freq_ = 0.0;
+};
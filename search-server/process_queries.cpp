@@ -1,28 +1,25 @@
 #include "process_queries.h"
+#include "query_executor.h"
+
+namespace {
+
+QueryExecutor& GetDefaultExecutor() {
+    static QueryExecutor executor;
+    return executor;
+}
+
+} // namespace
 
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
 
-    std::vector<std::vector<Document>> result(queries.size());
-    std::transform(
-        std::execution::par,
-        queries.begin(), queries.end(),
-        result.begin(),
-        [&search_server](const std::string& query) {
-            return search_server.FindTopDocuments(query);
-        }
-    );
-    return result;
+    return GetDefaultExecutor().ProcessQueries(search_server, queries);
 }
 
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
 
-    std::vector<Document> documents;
-    for (const auto& item : ProcessQueries(search_server, queries)) {
-        documents.insert(documents.end(), item.begin(), item.end());
-    }
-    return documents;
-}
\ No newline at end of file
+    return GetDefaultExecutor().ProcessQueriesJoined(search_server, queries);
+}
@@ -1,8 +1,6 @@
 #pragma once
 #include <vector>
 #include <string>
-#include <algorithm>
-#include <execution>
 
 #include "document.h"
 #include "search_server.h"
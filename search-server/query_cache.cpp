@@ -0,0 +1,135 @@
+#include "query_cache.h"
+
+#include <algorithm>
+
+using namespace std;
+
+FrequencySketch::FrequencySketch(size_t capacity)
+    : sample_size_(max<size_t>(capacity, 1) * 10) {
+    size_t width = 16;
+    while (width < capacity * 4) {
+        width *= 2;
+    }
+    counters_.assign(width * DEPTH, 0);
+    mask_ = width - 1;
+}
+
+void FrequencySketch::Increment(uint64_t hash) {
+    for (int row = 0; row < DEPTH; ++row) {
+        uint8_t& counter = counters_[GetIndex(hash, row)];
+        if (counter < MAX_COUNT) {
+            ++counter;
+        }
+    }
+    if (++additions_ == sample_size_) {
+        for (uint8_t& counter : counters_) {
+            counter /= 2;
+        }
+        additions_ /= 2;
+    }
+}
+
+int FrequencySketch::Estimate(uint64_t hash) const {
+    int result = MAX_COUNT;
+    for (int row = 0; row < DEPTH; ++row) {
+        result = min<int>(result, counters_[GetIndex(hash, row)]);
+    }
+    return result;
+}
+
+size_t FrequencySketch::GetIndex(uint64_t hash, int row) const {
+    static const uint64_t SEEDS[DEPTH] = {
+        0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull };
+    const uint64_t mixed = (hash + SEEDS[row]) * SEEDS[(row + 1) % DEPTH];
+    return row * (mask_ + 1) + ((mixed >> 32) & mask_);
+}
+
+QueryCache::Shard::Shard(size_t capacity)
+    : sketch(capacity) {
+}
+
+QueryCache::QueryCache(const SearchServer& search_server, size_t capacity)
+    : search_server_(search_server) {
+    const size_t shard_count = clamp<size_t>(capacity / MIN_SHARD_CAPACITY, 1, MAX_SHARD_COUNT);
+    shard_capacity_ = max<size_t>(1, capacity / shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.push_back(make_unique<Shard>(shard_capacity_));
+    }
+}
+
+vector<Document> QueryCache::FindTopDocuments(string_view raw_query, DocumentStatus status, size_t max_result_count) {
+    const char tag[] = { 's', static_cast<char>('0' + static_cast<int>(status)) };
+    return FindTopDocuments(raw_query, string_view(tag, sizeof(tag)),
+        [status](int document_id, DocumentStatus document_status, int rating) {
+            return document_status == status;
+        }, max_result_count);
+}
+
+vector<Document> QueryCache::FindTopDocuments(string_view raw_query) {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+QueryCache::Stats QueryCache::GetStats() const {
+    return { hits_.load(), misses_.load(), rejections_.load() };
+}
+
+size_t QueryCache::size() const {
+    size_t result = 0;
+    for (const auto& shard : shards_) {
+        lock_guard guard(shard->mutex);
+        result += shard->entries.size();
+    }
+    return result;
+}
+
+string QueryCache::MakeKey(string_view raw_query, string_view predicate_tag, size_t max_result_count) const {
+    string key = search_server_.NormalizeQuery(raw_query);
+    key += '\0';
+    key += predicate_tag;
+    key += '\0';
+    key += to_string(max_result_count);
+    return key;
+}
+
+QueryCache::Shard& QueryCache::GetShard(uint64_t hash) {
+    return *shards_[hash % shards_.size()];
+}
+
+bool QueryCache::Find(const string& key, uint64_t hash, vector<Document>& documents) {
+    Shard& shard = GetShard(hash);
+    lock_guard guard(shard.mutex);
+    shard.sketch.Increment(hash);
+    if (shard.generation != search_server_.GetGeneration()) {
+        shard.index.clear();
+        shard.entries.clear();
+        shard.generation = search_server_.GetGeneration();
+        return false;
+    }
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        return false;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    documents = it->second->documents;
+    return true;
+}
+
+void QueryCache::Insert(string key, uint64_t hash, const vector<Document>& documents) {
+    Shard& shard = GetShard(hash);
+    lock_guard guard(shard.mutex);
+    if (shard.generation != search_server_.GetGeneration() || shard.index.count(key) > 0) {
+        // the index changed or another thread has cached the same query meanwhile
+        return;
+    }
+    if (shard.entries.size() >= shard_capacity_) {
+        const Entry& victim = shard.entries.back();
+        if (shard.sketch.Estimate(hash) <= shard.sketch.Estimate(victim.hash)) {
+            ++rejections_;
+            return;
+        }
+        shard.index.erase(victim.key);
+        shard.entries.pop_back();
+    }
+    shard.entries.push_front({ move(key), hash, documents });
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+}
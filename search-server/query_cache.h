@@ -0,0 +1,116 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Approximate request counts of recent keys: a count-min sketch of 4-bit saturating
+// counters that are halved every sample_size increments, so old popularity fades
+class FrequencySketch {
+public:
+    explicit FrequencySketch(size_t capacity);
+
+    void Increment(uint64_t hash);
+    int Estimate(uint64_t hash) const;
+
+private:
+    static const int DEPTH = 4;
+    static const uint8_t MAX_COUNT = 15;
+
+    size_t GetIndex(uint64_t hash, int row) const;
+
+    std::vector<uint8_t> counters_;
+    size_t mask_;
+    size_t sample_size_;
+    size_t additions_ = 0;
+};
+
+// Bounded thread-safe cache of FindTopDocuments results in front of a SearchServer.
+// Queries are keyed by their normalised form, the predicate tag and the result size.
+// Every shard evicts its least recently used entry, but admits a new query into a full
+// shard only if the TinyLFU sketch rates it above the entry it would evict, so one-off
+// queries do not wash out popular ones. Entries are computed for one index generation:
+// the first lookup after AddDocument or RemoveDocument drops the shard's old entries.
+// Lookups may run in parallel; changing the server while the cache is in use may not.
+class QueryCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        // misses whose results were not admitted into the cache
+        uint64_t rejections = 0;
+    };
+
+    QueryCache(const SearchServer& search_server, size_t capacity);
+
+    // predicate_tag identifies the predicate: results are shared between calls with equal tags
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, std::string_view predicate_tag,
+        DocumentPredicate document_predicate, size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT);
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+        size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT);
+    std::vector<Document> FindTopDocuments(std::string_view raw_query);
+
+    Stats GetStats() const;
+    size_t size() const;
+
+private:
+    static const size_t MAX_SHARD_COUNT = 16;
+    // small caches get fewer shards so every sketch still sees enough requests
+    static const size_t MIN_SHARD_CAPACITY = 64;
+
+    struct Entry {
+        std::string key;
+        uint64_t hash;
+        std::vector<Document> documents;
+    };
+
+    struct Shard {
+        explicit Shard(size_t capacity);
+
+        std::mutex mutex;
+        // most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+        FrequencySketch sketch;
+        uint64_t generation = 0;
+    };
+
+    std::string MakeKey(std::string_view raw_query, std::string_view predicate_tag, size_t max_result_count) const;
+    Shard& GetShard(uint64_t hash);
+    bool Find(const std::string& key, uint64_t hash, std::vector<Document>& documents);
+    void Insert(std::string key, uint64_t hash, const std::vector<Document>& documents);
+
+    const SearchServer& search_server_;
+    size_t shard_capacity_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<uint64_t> hits_{ 0 };
+    std::atomic<uint64_t> misses_{ 0 };
+    std::atomic<uint64_t> rejections_{ 0 };
+};
+
+template <typename DocumentPredicate>
+std::vector<Document> QueryCache::FindTopDocuments(std::string_view raw_query, std::string_view predicate_tag,
+    DocumentPredicate document_predicate, size_t max_result_count) {
+    std::string key = MakeKey(raw_query, predicate_tag, max_result_count);
+    const uint64_t hash = std::hash<std::string>{}(key);
+    std::vector<Document> documents;
+    if (Find(key, hash, documents)) {
+        ++hits_;
+        return documents;
+    }
+    ++misses_;
+    documents = search_server_.FindTopDocuments(raw_query, document_predicate, max_result_count);
+    Insert(std::move(key), hash, documents);
+    return documents;
+}
@@ -0,0 +1,78 @@
+#include "query_context.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void QueryContext::SetDeadline(chrono::steady_clock::time_point deadline) {
+    deadline_ = deadline;
+    has_deadline_ = true;
+}
+
+void QueryContext::ClearDeadline() {
+    has_deadline_ = false;
+}
+
+chrono::nanoseconds QueryStats::GetTotalTime() const {
+    return parse_time + minus_filter_time + scan_time + top_k_time;
+}
+
+QueryStats& QueryStats::operator+=(const QueryStats& other) {
+    plus_terms += other.plus_terms;
+    minus_terms += other.minus_terms;
+    postings_scanned += other.postings_scanned;
+    predicate_rejections += other.predicate_rejections;
+    minus_rejections += other.minus_rejections;
+    candidates += other.candidates;
+    parse_time += other.parse_time;
+    minus_filter_time += other.minus_filter_time;
+    scan_time += other.scan_time;
+    top_k_time += other.top_k_time;
+    return *this;
+}
+
+QueryStats& QueryStats::operator-=(const QueryStats& other) {
+    plus_terms -= other.plus_terms;
+    minus_terms -= other.minus_terms;
+    postings_scanned -= other.postings_scanned;
+    predicate_rejections -= other.predicate_rejections;
+    minus_rejections -= other.minus_rejections;
+    candidates -= other.candidates;
+    parse_time -= other.parse_time;
+    minus_filter_time -= other.minus_filter_time;
+    scan_time -= other.scan_time;
+    top_k_time -= other.top_k_time;
+    return *this;
+}
+
+void QueryContext::EnableStats(bool enabled) {
+    stats_enabled_ = enabled;
+}
+
+const QueryStats& QueryContext::GetStats() const {
+    return stats_;
+}
+
+void QueryContext::Begin(size_t document_count, size_t max_result_count) {
+    if (scores_.size() < document_count) {
+        scores_.resize(document_count);
+        scored_epochs_.resize(document_count, epoch_);
+        excluded_epochs_.resize(document_count, epoch_);
+    }
+    if (++epoch_ == 0) {
+        // stamps of a wrapped epoch could be mistaken for the new query's ones
+        fill(scored_epochs_.begin(), scored_epochs_.end(), 0);
+        fill(excluded_epochs_.begin(), excluded_epochs_.end(), 0);
+        epoch_ = 1;
+    }
+    words_.clear();
+    plus_terms_.clear();
+    minus_terms_.clear();
+    scored_ordinals_.clear();
+    top_documents_.Reset(max_result_count);
+    stats_ = {};
+    if (stats_enabled_) {
+        phase_start_ = chrono::steady_clock::now();
+    }
+    CheckDeadline();
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "document.h"
+#include "term_dictionary.h"
+#include "top_documents.h"
+
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+// Thrown by a query whose context deadline has passed while it was being scored
+class QueryDeadlineError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// What a query did: counters and time spent per phase, or their sums over several queries
+struct QueryStats {
+    // query words found in the index
+    size_t plus_terms = 0;
+    size_t minus_terms = 0;
+    // postings of the plus and minus terms read, or lists probed by MatchDocument
+    size_t postings_scanned = 0;
+    // plus postings skipped because their document failed the predicate or has a minus-word
+    size_t predicate_rejections = 0;
+    size_t minus_rejections = 0;
+    // documents scored
+    size_t candidates = 0;
+    std::chrono::nanoseconds parse_time{ 0 };
+    std::chrono::nanoseconds minus_filter_time{ 0 };
+    std::chrono::nanoseconds scan_time{ 0 };
+    std::chrono::nanoseconds top_k_time{ 0 };
+
+    std::chrono::nanoseconds GetTotalTime() const;
+
+    QueryStats& operator+=(const QueryStats& other);
+    QueryStats& operator-=(const QueryStats& other);
+};
+
+// Scratch buffers for SearchServer::FindTopDocuments. A caller keeps one context per
+// thread and passes it to every query: the buffers grow to the largest query and index
+// seen, after which a query allocates nothing. A context must not be shared between
+// threads running at the same time, but may be used with different servers.
+class QueryContext {
+public:
+    QueryContext() = default;
+
+    // Queries run with this context throw QueryDeadlineError once the deadline has passed.
+    // The clock is read between terms and every DEADLINE_CHECK_INTERVAL postings
+    void SetDeadline(std::chrono::steady_clock::time_point deadline);
+    void ClearDeadline();
+
+    static constexpr uint32_t DEADLINE_CHECK_INTERVAL = 1024;
+
+    // Queries run with this context record their QueryStats. Off by default: the phase
+    // times read the clock four times a query
+    void EnableStats(bool enabled);
+    // Stats of the last query run with stats enabled
+    const QueryStats& GetStats() const;
+
+private:
+    friend class SearchServer;
+
+    // Starts a query over an index of document_count ordinals
+    void Begin(size_t document_count, size_t max_result_count);
+
+    void CheckDeadline() {
+        if (has_deadline_ && std::chrono::steady_clock::now() >= deadline_) {
+            throw QueryDeadlineError("Query deadline exceeded");
+        }
+    }
+    void CheckDeadlineEveryInterval() {
+        if (has_deadline_ && ++deadline_ticks_ % DEADLINE_CHECK_INTERVAL == 0) {
+            CheckDeadline();
+        }
+    }
+
+    // Adds the time since the previous phase ended to the given one
+    void EndPhase(std::chrono::nanoseconds QueryStats::* phase_time) {
+        if (stats_enabled_) {
+            const auto now = std::chrono::steady_clock::now();
+            stats_.*phase_time += now - phase_start_;
+            phase_start_ = now;
+        }
+    }
+
+    std::chrono::steady_clock::time_point deadline_;
+    bool has_deadline_ = false;
+    uint32_t deadline_ticks_ = 0;
+
+    std::vector<std::string_view> words_;
+    std::vector<TermId> plus_terms_;
+    std::vector<TermId> minus_terms_;
+
+    // an ordinal is scored (excluded) in the current query when its stamp equals epoch_,
+    // so nothing has to be cleared between queries
+    std::vector<double> scores_;
+    std::vector<uint32_t> scored_epochs_;
+    std::vector<uint32_t> excluded_epochs_;
+    std::vector<uint32_t> scored_ordinals_;
+    uint32_t epoch_ = 0;
+
+    TopDocuments top_documents_{ 0 };
+    std::vector<Document> result_;
+
+    // the counters are filled for every query, they cost nothing next to the scan
+    bool stats_enabled_ = false;
+    QueryStats stats_;
+    std::chrono::steady_clock::time_point phase_start_;
+};
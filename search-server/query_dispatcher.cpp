@@ -0,0 +1,119 @@
+#include "query_dispatcher.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+using namespace std;
+
+QueryDispatcher::QueryDispatcher(const SearchServer& search_server)
+    : QueryDispatcher(search_server, Options{}) {
+}
+
+QueryDispatcher::QueryDispatcher(const SearchServer& search_server, const Options& options)
+    : search_server_(search_server)
+    , queue_(max<size_t>(1, options.max_queue_depth)) {
+    const size_t thread_count = options.thread_count == 0
+        ? max<size_t>(1, thread::hardware_concurrency())
+        : options.thread_count;
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.emplace_back(&QueryDispatcher::WorkerLoop, this);
+    }
+}
+
+QueryDispatcher::~QueryDispatcher() {
+    queue_.Close();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+future<vector<Document>> QueryDispatcher::SubmitQuery(string raw_query, const QueryOptions& options) {
+    // std::function needs a copyable callable, so the promise is shared
+    auto promise = make_shared<std::promise<vector<Document>>>();
+    auto result = promise->get_future();
+    const bool accepted = SubmitQuery(move(raw_query), options,
+        [promise](vector<Document> documents, exception_ptr error) {
+            if (error) {
+                promise->set_exception(error);
+            }
+            else {
+                promise->set_value(move(documents));
+            }
+        });
+    if (!accepted) {
+        promise->set_exception(make_exception_ptr(QueryOverloadError("Query queue is full")));
+    }
+    return result;
+}
+
+bool QueryDispatcher::SubmitQuery(string raw_query, const QueryOptions& options, Callback callback) {
+    Request request{ move(raw_query), options, {}, move(callback) };
+    if (options.timeout.count() > 0) {
+        request.deadline = chrono::steady_clock::now() + options.timeout;
+    }
+    if (!queue_.TryPush(move(request))) {
+        ++rejected_;
+        return false;
+    }
+    return true;
+}
+
+QueryDispatcher::Stats QueryDispatcher::GetStats() const {
+    return { completed_.load(), rejected_.load(), expired_.load(), failed_.load() };
+}
+
+int QueryDispatcher::GetNoResultRequests() const {
+    lock_guard guard(request_window_mutex_);
+    return request_window_.GetNoResultRequests();
+}
+
+QueryStats QueryDispatcher::GetWindowStats() const {
+    lock_guard guard(request_window_mutex_);
+    return request_window_.GetWindowStats();
+}
+
+vector<pair<string, QueryStats>> QueryDispatcher::GetSlowestRequests(size_t count) const {
+    lock_guard guard(request_window_mutex_);
+    return request_window_.GetSlowestRequests(count);
+}
+
+size_t QueryDispatcher::GetQueueDepth() const {
+    return queue_.size();
+}
+
+void QueryDispatcher::WorkerLoop() {
+    QueryContext context;
+    context.EnableStats(true);
+    Request request;
+    while (queue_.Pop(request)) {
+        Answer(context, request);
+    }
+}
+
+void QueryDispatcher::Answer(QueryContext& context, Request& request) {
+    vector<Document> documents;
+    exception_ptr error;
+    try {
+        if (request.options.timeout.count() > 0) {
+            context.SetDeadline(request.deadline);
+        }
+        else {
+            context.ClearDeadline();
+        }
+        documents = search_server_.FindTopDocuments(context, request.raw_query,
+            request.options.status, request.options.max_result_count);
+        ++completed_;
+        lock_guard guard(request_window_mutex_);
+        request_window_.AddRequest(request.raw_query, static_cast<int>(documents.size()), context.GetStats());
+    }
+    catch (const QueryDeadlineError&) {
+        ++expired_;
+        error = current_exception();
+    }
+    catch (...) {
+        ++failed_;
+        error = current_exception();
+    }
+    request.callback(move(documents), error);
+}
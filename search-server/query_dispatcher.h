@@ -0,0 +1,99 @@
+#pragma once
+
+#include "bounded_queue.h"
+#include "document.h"
+#include "request_queue.h"
+#include "search_server.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Thrown (or stored in the future) for a query refused because the queue is full
+class QueryOverloadError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+struct QueryOptions {
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT;
+    // Counted from submission, so it covers the time spent in the queue; zero means none
+    std::chrono::steady_clock::duration timeout{};
+};
+
+// Answers queries asynchronously on a fixed pool of worker threads. Submitted queries
+// wait in a bounded queue; a query arriving when the queue is full is rejected at once
+// instead of adding to the backlog. A query whose deadline passes is abandoned, whether
+// it is still queued or already being scored, and fails with QueryDeadlineError.
+// Answered queries are accounted in a RequestWindow, which keeps the no-result count.
+class QueryDispatcher {
+public:
+    // Called on a worker thread with the documents or with the error of the query;
+    // must not throw
+    using Callback = std::function<void(std::vector<Document> documents, std::exception_ptr error)>;
+
+    struct Options {
+        // 0 means one worker per hardware thread
+        size_t thread_count = 0;
+        size_t max_queue_depth = 1024;
+    };
+
+    struct Stats {
+        uint64_t completed = 0;
+        uint64_t rejected = 0;
+        uint64_t expired = 0;
+        uint64_t failed = 0;
+    };
+
+    explicit QueryDispatcher(const SearchServer& search_server);
+    QueryDispatcher(const SearchServer& search_server, const Options& options);
+    // Answers the queries that are already queued before returning
+    ~QueryDispatcher();
+
+    QueryDispatcher(const QueryDispatcher&) = delete;
+    QueryDispatcher& operator=(const QueryDispatcher&) = delete;
+
+    // A rejected query gets a future holding QueryOverloadError
+    std::future<std::vector<Document>> SubmitQuery(std::string raw_query, const QueryOptions& options = {});
+    // Returns false without calling back if the query is rejected
+    bool SubmitQuery(std::string raw_query, const QueryOptions& options, Callback callback);
+
+    Stats GetStats() const;
+    int GetNoResultRequests() const;
+    // Both cover the completed queries of the last RequestWindow
+    QueryStats GetWindowStats() const;
+    std::vector<std::pair<std::string, QueryStats>> GetSlowestRequests(size_t count) const;
+    size_t GetQueueDepth() const;
+
+private:
+    struct Request {
+        std::string raw_query;
+        QueryOptions options;
+        std::chrono::steady_clock::time_point deadline;
+        Callback callback;
+    };
+
+    void WorkerLoop();
+    void Answer(QueryContext& context, Request& request);
+
+    const SearchServer& search_server_;
+    BoundedQueue<Request> queue_;
+    std::vector<std::thread> workers_;
+
+    mutable std::mutex request_window_mutex_;
+    RequestWindow request_window_;
+
+    std::atomic<uint64_t> completed_{ 0 };
+    std::atomic<uint64_t> rejected_{ 0 };
+    std::atomic<uint64_t> expired_{ 0 };
+    std::atomic<uint64_t> failed_{ 0 };
+};
@@ -0,0 +1,183 @@
+#include "query_executor.h"
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+void PinCurrentThread(size_t cpu) {
+#if defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu % max<size_t>(1, thread::hardware_concurrency()), &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+}
+
+} // namespace
+
+QueryExecutor::QueryExecutor()
+    : QueryExecutor(Options{}) {
+}
+
+QueryExecutor::QueryExecutor(const Options& options)
+    : options_(options) {
+    if (options_.thread_count == 0) {
+        options_.thread_count = max<size_t>(1, thread::hardware_concurrency());
+    }
+    options_.chunk_size = max<size_t>(1, options_.chunk_size);
+    for (size_t i = 0; i < options_.thread_count; ++i) {
+        workers_.push_back(make_unique<Worker>());
+    }
+    for (size_t i = 0; i < options_.thread_count; ++i) {
+        workers_[i]->thread = thread(&QueryExecutor::WorkerLoop, this, i);
+    }
+}
+
+QueryExecutor::~QueryExecutor() {
+    {
+        lock_guard guard(state_mutex_);
+        stopping_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker->thread.join();
+    }
+}
+
+vector<vector<Document>> QueryExecutor::ProcessQueries(const SearchServer& search_server,
+    const vector<string>& queries) {
+    vector<vector<Document>> result(queries.size());
+    Run(queries.size(), [&search_server, &queries, &result](QueryContext& context, size_t index) {
+        const auto& found = search_server.FindTopDocuments(context, queries[index]);
+        TRACE_SPAN(SERIALIZE);
+        result[index] = found;
+    });
+    return result;
+}
+
+vector<Document> QueryExecutor::ProcessQueriesJoined(const SearchServer& search_server,
+    const vector<string>& queries) {
+    vector<Document> documents(queries.size() * MAX_RESULT_DOCUMENT_COUNT);
+    vector<size_t> counts(queries.size());
+    Run(queries.size(), [&search_server, &queries, &documents, &counts](QueryContext& context, size_t index) {
+        const auto& found = search_server.FindTopDocuments(context, queries[index]);
+        TRACE_SPAN(SERIALIZE);
+        copy(found.begin(), found.end(), documents.begin() + index * MAX_RESULT_DOCUMENT_COUNT);
+        counts[index] = found.size();
+    });
+    TRACE_SPAN(SERIALIZE);
+    size_t size = 0;
+    for (size_t index = 0; index < queries.size(); ++index) {
+        const auto slot = documents.begin() + index * MAX_RESULT_DOCUMENT_COUNT;
+        // the target never runs ahead of the source, so moving forward is safe
+        copy(slot, slot + counts[index], documents.begin() + size);
+        size += counts[index];
+    }
+    documents.resize(size);
+    return documents;
+}
+
+size_t QueryExecutor::GetThreadCount() const {
+    return workers_.size();
+}
+
+void QueryExecutor::Run(size_t task_count, Task task) {
+    if (task_count == 0) {
+        return;
+    }
+    lock_guard batch_guard(batch_mutex_);
+    task_ = move(task);
+    error_ = nullptr;
+    const size_t chunk_size = options_.chunk_size;
+    const size_t chunk_count = (task_count + chunk_size - 1) / chunk_size;
+    remaining_chunks_ = chunk_count;
+    // every worker starts with a contiguous run of chunks
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        Worker& worker = *workers_[chunk * workers_.size() / chunk_count];
+        lock_guard guard(worker.mutex);
+        worker.chunks.push_back({ chunk * chunk_size, min(task_count, (chunk + 1) * chunk_size) });
+    }
+    {
+        unique_lock lock(state_mutex_);
+        ++batch_id_;
+        start_cv_.notify_all();
+        done_cv_.wait(lock, [this] {
+            return remaining_chunks_ == 0;
+        });
+    }
+    task_ = nullptr;
+    if (error_) {
+        rethrow_exception(error_);
+    }
+}
+
+void QueryExecutor::WorkerLoop(size_t index) {
+    if (options_.pin_threads) {
+        PinCurrentThread(index);
+    }
+    uint64_t seen_batch_id = 0;
+    while (true) {
+        {
+            unique_lock lock(state_mutex_);
+            start_cv_.wait(lock, [this, seen_batch_id] {
+                return stopping_ || batch_id_ != seen_batch_id;
+            });
+            if (stopping_) {
+                return;
+            }
+            seen_batch_id = batch_id_;
+        }
+        RunChunks(index);
+    }
+}
+
+void QueryExecutor::RunChunks(size_t index) {
+    Worker& worker = *workers_[index];
+    pair<size_t, size_t> chunk;
+    while (TakeChunk(index, chunk)) {
+        for (size_t task = chunk.first; task < chunk.second; ++task) {
+            try {
+                task_(worker.context, task);
+            }
+            catch (...) {
+                lock_guard guard(state_mutex_);
+                if (!error_) {
+                    error_ = current_exception();
+                }
+            }
+        }
+        if (remaining_chunks_.fetch_sub(1) == 1) {
+            lock_guard guard(state_mutex_);
+            done_cv_.notify_all();
+        }
+    }
+}
+
+bool QueryExecutor::TakeChunk(size_t index, pair<size_t, size_t>& chunk) {
+    {
+        Worker& own = *workers_[index];
+        lock_guard guard(own.mutex);
+        if (!own.chunks.empty()) {
+            chunk = own.chunks.back();
+            own.chunks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        Worker& victim = *workers_[(index + i) % workers_.size()];
+        lock_guard guard(victim.mutex);
+        if (!victim.chunks.empty()) {
+            chunk = victim.chunks.front();
+            victim.chunks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
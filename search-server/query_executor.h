@@ -0,0 +1,79 @@
+#pragma once
+
+#include "document.h"
+#include "query_context.h"
+#include "search_server.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fixed pool of worker threads running batches of queries. A batch is cut into chunks
+// that are dealt out to per-worker deques: a worker takes chunks from the back of its
+// own deque and, once it is empty, steals from the front of the others. Every worker
+// keeps its own QueryContext between batches, so steady-state queries do not allocate.
+// One batch runs at a time; concurrent callers wait for their turn.
+class QueryExecutor {
+public:
+    struct Options {
+        // 0 means one worker per hardware thread
+        size_t thread_count = 0;
+        // binds worker i to CPU i modulo the number of CPUs (Linux only)
+        bool pin_threads = false;
+        size_t chunk_size = 16;
+    };
+
+    QueryExecutor();
+    explicit QueryExecutor(const Options& options);
+    ~QueryExecutor();
+
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+
+    // The first exception thrown by a query is rethrown after the batch has finished
+    std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server,
+        const std::vector<std::string>& queries);
+    // Every query writes its results straight into its slots of one preallocated buffer,
+    // which is compacted in place afterwards
+    std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server,
+        const std::vector<std::string>& queries);
+
+    size_t GetThreadCount() const;
+
+private:
+    using Task = std::function<void(QueryContext& context, size_t index)>;
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::pair<size_t, size_t>> chunks;
+        QueryContext context;
+        std::thread thread;
+    };
+
+    void Run(size_t task_count, Task task);
+    void WorkerLoop(size_t index);
+    void RunChunks(size_t index);
+    bool TakeChunk(size_t index, std::pair<size_t, size_t>& chunk);
+
+    Options options_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    std::mutex batch_mutex_;
+    std::mutex state_mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    uint64_t batch_id_ = 0;
+    bool stopping_ = false;
+    Task task_;
+    std::atomic<size_t> remaining_chunks_{ 0 };
+    std::exception_ptr error_;
+};
@@ -1,35 +1,166 @@
 #include "remove_duplicates.h"
-#include "log_duration.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <limits>
+#include <numeric>
+#include <utility>
 
 using namespace std;
 
-void RemoveDuplicates(SearchServer& search_server) {
-	
-	set<int> duplicate_documents_ids;
-	map<set<string>, int> unique_documents;
-	for (const auto& id : search_server) {
-		set<string> set_of_words;
-		const auto& doc_to_check = search_server.GetWordFrequencies(id);
-		for (const auto& [words, _] : doc_to_check) {
-			set_of_words.insert(string(words));
-		}				
-		if (unique_documents.empty()) {
-			unique_documents.insert({ set_of_words, id });
-		}
-		else {
-			if (unique_documents.count(set_of_words)) {
-				duplicate_documents_ids.insert(id);
-			}
-			else {
-				unique_documents.insert({ set_of_words, id });
-			}
-		}
-	}
-	if (!duplicate_documents_ids.empty()) {
-		for (const auto& id : duplicate_documents_ids) {
-			cout << "Found duplicate document id "s << id << endl;
-			search_server.RemoveDocument(id);
-		}
-	}
+namespace {
+
+uint64_t Mix(uint64_t value) {
+    // finaliser of splitmix64
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+void GetTerms(const SearchServer& search_server, int document_id, vector<TermId>& terms) {
+    terms.clear();
+    search_server.ForEachDocumentTerm(document_id, [&terms](TermId term, uint32_t) {
+        terms.push_back(term);
+    });
+}
+
+double ComputeJaccard(const vector<TermId>& lhs, const vector<TermId>& rhs) {
+    if (lhs.empty() && rhs.empty()) {
+        return 1.0;
+    }
+    size_t common = 0;
+    for (auto left = lhs.begin(), right = rhs.begin(); left != lhs.end() && right != rhs.end();) {
+        if (*left < *right) {
+            ++left;
+        }
+        else if (*right < *left) {
+            ++right;
+        }
+        else {
+            ++common;
+            ++left;
+            ++right;
+        }
+    }
+    return static_cast<double>(common) / (lhs.size() + rhs.size() - common);
+}
+
+// Positions of the documents sorted by key, then by id; equal keys form one bucket
+vector<size_t> SortByKey(const vector<int>& ids, const vector<uint64_t>& keys) {
+    vector<size_t> order(ids.size());
+    iota(order.begin(), order.end(), 0);
+    sort(execution::par, order.begin(), order.end(), [&ids, &keys](size_t lhs, size_t rhs) {
+        return pair(keys[lhs], ids[lhs]) < pair(keys[rhs], ids[rhs]);
+    });
+    return order;
+}
+
+class DisjointSets {
+public:
+    explicit DisjointSets(size_t size)
+        : parents_(size) {
+        iota(parents_.begin(), parents_.end(), 0);
+    }
+
+    size_t Find(size_t element) {
+        while (parents_[element] != element) {
+            parents_[element] = parents_[parents_[element]];
+            element = parents_[element];
+        }
+        return element;
+    }
+
+    void Unite(size_t lhs, size_t rhs) {
+        parents_[Find(lhs)] = Find(rhs);
+    }
+
+private:
+    vector<size_t> parents_;
+};
+
+} // namespace
+
+vector<int> FindDuplicates(const SearchServer& search_server) {
+    return search_server.GetDuplicateIds();
 }
 
+vector<int> FindNearDuplicates(const SearchServer& search_server, const NearDuplicateOptions& options) {
+    const vector<int> ids(search_server.begin(), search_server.end());
+    vector<size_t> documents(ids.size());
+    iota(documents.begin(), documents.end(), 0);
+    // bands are hashed one at a time, so only one key per document is kept
+    vector<uint64_t> band_keys(ids.size());
+    vector<pair<size_t, size_t>> candidates;
+    for (size_t band = 0; band < options.band_count; ++band) {
+        for_each(execution::par, documents.begin(), documents.end(), [&](size_t document) {
+            uint64_t key = band;
+            for (size_t row = 0; row < options.rows_per_band; ++row) {
+                const uint64_t seed = Mix(band * options.rows_per_band + row + 1);
+                uint64_t min_hash = numeric_limits<uint64_t>::max();
+                search_server.ForEachDocumentTerm(ids[document], [seed, &min_hash](TermId term, uint32_t) {
+                    min_hash = min(min_hash, Mix(term ^ seed));
+                });
+                key = Mix(key ^ min_hash);
+            }
+            band_keys[document] = key;
+        });
+        // members of a bucket are compared with its smallest id only: the work stays
+        // linear and similar documents are chained through it
+        const auto order = SortByKey(ids, band_keys);
+        for (size_t begin = 0, end = 0; begin < order.size(); begin = end) {
+            while (end < order.size() && band_keys[order[end]] == band_keys[order[begin]]) {
+                ++end;
+            }
+            for (size_t i = begin + 1; i < end; ++i) {
+                candidates.push_back({ order[begin], order[i] });
+            }
+        }
+    }
+    sort(execution::par, candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+    vector<uint8_t> similar(candidates.size());
+    transform(execution::par, candidates.begin(), candidates.end(), similar.begin(),
+        [&search_server, &ids, threshold = options.jaccard_threshold](const pair<size_t, size_t>& candidate) {
+            vector<TermId> lhs;
+            vector<TermId> rhs;
+            GetTerms(search_server, ids[candidate.first], lhs);
+            GetTerms(search_server, ids[candidate.second], rhs);
+            return static_cast<uint8_t>(ComputeJaccard(lhs, rhs) >= threshold);
+        });
+
+    DisjointSets groups(ids.size());
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (similar[i]) {
+            groups.Unite(candidates[i].first, candidates[i].second);
+        }
+    }
+    vector<int> smallest_ids(ids.size(), numeric_limits<int>::max());
+    for (size_t document = 0; document < ids.size(); ++document) {
+        int& smallest_id = smallest_ids[groups.Find(document)];
+        smallest_id = min(smallest_id, ids[document]);
+    }
+    vector<int> duplicates;
+    for (size_t document = 0; document < ids.size(); ++document) {
+        if (smallest_ids[groups.Find(document)] != ids[document]) {
+            duplicates.push_back(ids[document]);
+        }
+    }
+    sort(duplicates.begin(), duplicates.end());
+    return duplicates;
+}
+
+vector<int> RemoveDuplicates(SearchServer& search_server) {
+    auto duplicates = FindDuplicates(search_server);
+    search_server.RemoveDocuments(execution::par, duplicates);
+    return duplicates;
+}
+
+vector<int> RemoveNearDuplicates(SearchServer& search_server, const NearDuplicateOptions& options) {
+    auto duplicates = FindNearDuplicates(search_server, options);
+    search_server.RemoveDocuments(execution::par, duplicates);
+    return duplicates;
+}
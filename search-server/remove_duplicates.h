@@ -1,11 +1,29 @@
 #pragma once
 
-#include <map>
-#include <string>
-#include <set>
-#include <iostream>
-#include <algorithm>
+#include <vector>
 
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
+struct NearDuplicateOptions {
+    // documents whose word sets have at least this Jaccard similarity are duplicates
+    double jaccard_threshold = 0.8;
+    // MinHash signatures have band_count * rows_per_band values; documents agreeing on
+    // all rows of some band are compared exactly. More rows per band mean fewer pairs
+    // compared and more pairs missed near the threshold
+    size_t band_count = 16;
+    size_t rows_per_band = 4;
+};
+
+// Ids of documents with the same set of words as a document with a smaller id, in
+// increasing order. The server keeps word set fingerprints up to date as documents are
+// added and removed, so only documents sharing a fingerprint are compared
+std::vector<int> FindDuplicates(const SearchServer& search_server);
+
+// Ids of documents similar to a document with a smaller id, in increasing order.
+// Candidates come from MinHash with LSH banding, so a pair close to the threshold may
+// be missed; similar pairs are chained, so a group keeps only its smallest id
+std::vector<int> FindNearDuplicates(const SearchServer& search_server, const NearDuplicateOptions& options = {});
+
+// Both remove what the search above finds in one batch and return the removed ids
+std::vector<int> RemoveDuplicates(SearchServer& search_server);
+std::vector<int> RemoveNearDuplicates(SearchServer& search_server, const NearDuplicateOptions& options = {});
@@ -1,29 +1,53 @@
 #include "request_queue.h"
+
+#include <algorithm>
+
 using namespace std;
 
 RequestQueue::RequestQueue(const SearchServer& search_server)
-    : search_server_(search_server)
-    , no_results_requests_(0)
-    , current_time_(0) {
+    : search_server_(search_server) {
+    context_.EnableStats(true);
 }
 
 vector<Document> RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) {
-    const auto result = search_server_.FindTopDocuments(raw_query, status);
-    AddRequest(result.size());
-    return result;
+    return AddFindRequest(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    });
 }
 
 vector<Document> RequestQueue::AddFindRequest(const string& raw_query) {
-    const auto result = search_server_.FindTopDocuments(raw_query);
-    AddRequest(result.size());
-    return result;
+    return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
 }
 
 int RequestQueue::GetNoResultRequests() const {
-    return no_results_requests_;
+    return window_.GetNoResultRequests();
 }
 
 void RequestQueue::AddRequest(int results_num) {
+    window_.AddRequest(results_num);
+}
+
+void RequestQueue::AddRequest(const string& raw_query, int results_num, const QueryStats& stats) {
+    window_.AddRequest(raw_query, results_num, stats);
+}
+
+const QueryStats& RequestQueue::GetWindowStats() const {
+    return window_.GetWindowStats();
+}
+
+vector<pair<string, QueryStats>> RequestQueue::GetSlowestRequests(size_t count) const {
+    return window_.GetSlowestRequests(count);
+}
+
+int RequestWindow::GetNoResultRequests() const {
+    return no_results_requests_;
+}
+
+void RequestWindow::AddRequest(int results_num) {
+    AddRequest({}, results_num, {});
+}
+
+void RequestWindow::AddRequest(const string& raw_query, int results_num, const QueryStats& stats) {
     // новый запрос - новая секунда
     ++current_time_;
     // удаляем все результаты поиска, которые устарели
@@ -31,11 +55,33 @@ void RequestQueue::AddRequest(int results_num) {
         if (0 == requests_.front().results) {
             --no_results_requests_;
         }
+        window_stats_ -= requests_.front().stats;
         requests_.pop_front();
     }
     // сохраняем новый результат поиска
-    requests_.push_back({ current_time_, results_num });
+    requests_.push_back({ current_time_, results_num, raw_query, stats });
     if (0 == results_num) {
         ++no_results_requests_;
     }
-}
\ No newline at end of file
+    window_stats_ += stats;
+}
+
+const QueryStats& RequestWindow::GetWindowStats() const {
+    return window_stats_;
+}
+
+vector<pair<string, QueryStats>> RequestWindow::GetSlowestRequests(size_t count) const {
+    vector<const QueryResult*> slowest;
+    for (const QueryResult& request : requests_) {
+        slowest.push_back(&request);
+    }
+    count = min(count, slowest.size());
+    partial_sort(slowest.begin(), slowest.begin() + count, slowest.end(), [](const QueryResult* lhs, const QueryResult* rhs) {
+        return lhs->stats.GetTotalTime() > rhs->stats.GetTotalTime();
+    });
+    vector<pair<string, QueryStats>> result;
+    for (size_t i = 0; i < count; ++i) {
+        result.push_back({ slowest[i]->raw_query, slowest[i]->stats });
+    }
+    return result;
+}
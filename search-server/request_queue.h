@@ -2,9 +2,38 @@
 #include <deque>
 #include <vector>
 #include <string>
+#include <utility>
 #include "document.h"
 #include "search_server.h"
 
+// Accounts the requests of the last day (one request per minute): how many found
+// nothing and how long they took. Holds no query state of its own, so requests
+// answered elsewhere, e.g. by QueryDispatcher, are accounted with AddRequest.
+class RequestWindow {
+public:
+    int GetNoResultRequests() const;
+    void AddRequest(int results_num);
+    void AddRequest(const std::string& raw_query, int results_num, const QueryStats& stats);
+
+    // Sum of the stats of the requests in the window
+    const QueryStats& GetWindowStats() const;
+    // Up to count requests of the window that took the longest, slowest first
+    std::vector<std::pair<std::string, QueryStats>> GetSlowestRequests(size_t count) const;
+
+private:
+    struct QueryResult {
+        uint64_t timestamp;
+        int results;
+        std::string raw_query;
+        QueryStats stats;
+    };
+    std::deque<QueryResult> requests_;
+    int no_results_requests_ = 0;
+    uint64_t current_time_ = 0;
+    QueryStats window_stats_;
+    const static int min_in_day_ = 1440;
+};
+
 class RequestQueue {
 public:
     explicit RequestQueue(const SearchServer& search_server);
@@ -15,24 +44,22 @@ public:
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
     std::vector<Document> AddFindRequest(const std::string& raw_query);
     int GetNoResultRequests() const;
+    void AddRequest(int results_num);
+    void AddRequest(const std::string& raw_query, int results_num, const QueryStats& stats);
+
+    const QueryStats& GetWindowStats() const;
+    std::vector<std::pair<std::string, QueryStats>> GetSlowestRequests(size_t count) const;
 
 private:
-    struct QueryResult {
-        uint64_t timestamp;
-        int results;
-    };
-    std::deque<QueryResult> requests_;
     const SearchServer& search_server_;
-    int no_results_requests_;
-    uint64_t current_time_;
-    const static int min_in_day_ = 1440;
-
-    void AddRequest(int results_num);
+    QueryContext context_;
+    RequestWindow window_;
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-    const auto result = search_server_.FindTopDocuments(raw_query, document_predicate);
-    AddRequest(result.size());
+    const auto& found = search_server_.FindTopDocuments(context_, raw_query, document_predicate);
+    std::vector<Document> result(found.begin(), found.end());
+    AddRequest(raw_query, result.size(), context_.GetStats());
     return result;
-}
\ No newline at end of file
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Relevance accumulator for the parallel search, indexed by document ordinal.
+// Threads add scores with a CAS loop on atomic doubles and mark documents in
+// atomic bitmaps, so no locks are taken per posting.
+class ConcurrentScoreAccumulator {
+public:
+    explicit ConcurrentScoreAccumulator(size_t document_count)
+        : scores_(document_count)
+        , scored_((document_count + 63) / 64)
+        , excluded_((document_count + 63) / 64) {
+    }
+
+    void Add(size_t ordinal, double value) {
+        auto& score = scores_[ordinal];
+        double current = score.load(std::memory_order_relaxed);
+        while (!score.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {
+        }
+        SetBit(scored_, ordinal);
+    }
+
+    // Excluded documents are skipped by ForEachScored even if they were scored
+    void Exclude(size_t ordinal) {
+        SetBit(excluded_, ordinal);
+    }
+
+    bool IsExcluded(size_t ordinal) const {
+        return (excluded_[ordinal / 64].load(std::memory_order_relaxed) >> (ordinal % 64)) & 1;
+    }
+
+    // Must be called after all updates have finished
+    template <typename Func>
+    void ForEachScored(Func func) const {
+        for (size_t word = 0; word < scored_.size(); ++word) {
+            uint64_t bits = scored_[word].load(std::memory_order_relaxed) & ~excluded_[word].load(std::memory_order_relaxed);
+            while (bits != 0) {
+                const size_t ordinal = word * 64 + CountTrailingZeros(bits);
+                func(ordinal, scores_[ordinal].load(std::memory_order_relaxed));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+private:
+    static size_t CountTrailingZeros(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(bits);
+#else
+        size_t count = 0;
+        for (; (bits & 1) == 0; bits >>= 1) {
+            ++count;
+        }
+        return count;
+#endif
+    }
+
+    static void SetBit(std::vector<std::atomic<uint64_t>>& bitmap, size_t ordinal) {
+        const uint64_t mask = uint64_t{ 1 } << (ordinal % 64);
+        auto& word = bitmap[ordinal / 64];
+        if ((word.load(std::memory_order_relaxed) & mask) == 0) {
+            word.fetch_or(mask, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<std::atomic<double>> scores_;
+    std::vector<std::atomic<uint64_t>> scored_;
+    std::vector<std::atomic<uint64_t>> excluded_;
+};
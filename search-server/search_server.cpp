@@ -1,5 +1,6 @@
 #include "search_server.h"
 #include "string_processing.h"
+#include "snapshot.h"
 #include <fstream>
 
 using namespace std;
@@ -15,101 +16,310 @@ SearchServer::SearchServer(const std::string_view stop_words_text)
 {
 }
 
+SearchServer::SearchServer(const StopWords& stop_words)
+    : stop_words_(stop_words) {
+}
+
+SearchServer SearchServer::MakeEmpty() const {
+    return SearchServer(stop_words_);
+}
+
 void SearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status,
     const vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    AddDocument(document_id, document, status, ratings, DuplicatePolicy::ADD);
+}
+
+optional<int> SearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status,
+    const vector<int>& ratings, DuplicatePolicy duplicate_policy) {
+    if ((document_id < 0) || (FindOrdinal(document_id) >= 0)) {
         throw invalid_argument("Invalid document_id"s);
     }
-    const auto words = SplitIntoWordsNoStop(document);
+    vector<string_view> words;
+    SplitIntoWordsNoStop(document, words);
     const double inv_word_count = 1.0 / words.size();
+    // words are looked up without interning first: a word the index has never seen rules
+    // out a duplicate, so a rejected document leaves the dictionary untouched
+    map<TermId, uint32_t> term_counts;
+    bool has_new_words = false;
     for (const string_view word : words) {
-        storage.emplace(storage.begin(), word);
-        word_to_document_freqs_[storage.front()][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][storage.front()] += inv_word_count;
+        const TermId term = terms_.Find(word);
+        if (term == TermDictionary::NO_TERM) {
+            has_new_words = true;
+            break;
+        }
+        ++term_counts[term];
+    }
+    if (has_new_words) {
+        term_counts.clear();
+        for (const string_view word : words) {
+            ++term_counts[terms_.Intern(word)];
+        }
+        word_to_document_freqs_.resize(terms_.size());
+    }
+    vector<DocumentTerm> terms;
+    terms.reserve(term_counts.size());
+    for (const auto [term, count] : term_counts) {
+        terms.push_back({ term, count });
+    }
+    const uint64_t fingerprint = ComputeFingerprint(terms.data(), terms.data() + terms.size());
+    const int duplicate_ordinal = has_new_words ? -1
+        : FindDuplicateOrdinal(terms.data(), terms.data() + terms.size(), fingerprint);
+    const optional<int> duplicate_id = duplicate_ordinal < 0 ? nullopt : optional(document_ids_[duplicate_ordinal]);
+    if (duplicate_id && duplicate_policy == DuplicatePolicy::REJECT) {
+        return duplicate_id;
+    }
+
+    // ordinals only grow, so every posting below is appended to the end of its list
+    const int ordinal = static_cast<int>(document_ids_.size());
+    auto& document_terms = document_terms_.Mutable();
+    for (const auto [term, count] : terms) {
+        document_terms.push_back({ term, count });
+        word_to_document_freqs_[term].Add(ordinal, count, count * inv_word_count);
+    }
+    document_term_ends_.Mutable().push_back(document_terms.size());
+    document_ordinals_.emplace(document_id, ordinal);
+    document_ids_.Mutable().push_back(document_id);
+    document_ratings_.Mutable().push_back(ComputeAverageRating(ratings));
+    document_statuses_.Mutable().push_back(status);
+    document_inv_word_counts_.Mutable().push_back(inv_word_count);
+    document_removed_.Mutable().push_back(false);
+    InsertFingerprint(ordinal, fingerprint);
+    ++document_count_;
+    ++generation_;
+    return duplicate_id;
+}
+
+void SearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    AddDocuments(execution::seq, documents);
+}
+
+SearchServer::TokenizedBatch SearchServer::TokenizeDocuments(vector<NewDocument> documents) const {
+    TokenizedBatch batch;
+    batch.documents_ = move(documents);
+    // the batch is tokenised on the calling thread, so one chunk avoids interning a word per chunk
+    TokenizeBatch(execution::seq, batch.documents_, 1, batch.state_);
+    return batch;
+}
+
+void SearchServer::AddTokenizedDocuments(TokenizedBatch batch) {
+    ValidateNewDocumentIds(batch.documents_);
+    ApplyBatch(execution::seq, batch.documents_, batch.state_);
+}
+
+void SearchServer::ValidateNewDocumentIds(const vector<NewDocument>& documents) const {
+    vector<int> ids;
+    ids.reserve(documents.size());
+    for (const NewDocument& document : documents) {
+        if ((document.id < 0) || (FindOrdinal(document.id) >= 0)) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+        ids.push_back(document.id);
+    }
+    sort(ids.begin(), ids.end());
+    if (adjacent_find(ids.begin(), ids.end()) != ids.end()) {
+        throw invalid_argument("Invalid document_id"s);
     }
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
-    document_ids_.insert(document_id);
 }
 
-vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status) const {
+void SearchServer::TokenizeBatchChunk(const vector<NewDocument>& documents, BatchChunk& chunk,
+    vector<vector<DocumentTerm>>& document_terms, vector<double>& inv_word_counts) const {
+    vector<uint32_t> local_ids;
+    vector<string_view> words;
+    for (size_t i = chunk.begin; i < chunk.end; ++i) {
+        try {
+            SplitIntoWordsNoStop(documents[i].text, words);
+        }
+        catch (const invalid_argument& error) {
+            // exceptions must not escape a parallel algorithm, the caller rethrows
+            chunk.error = error.what();
+            return;
+        }
+        local_ids.clear();
+        for (const string_view word : words) {
+            const auto [it, inserted] = chunk.local_ids.emplace(word, static_cast<uint32_t>(chunk.words.size()));
+            if (inserted) {
+                chunk.words.push_back(word);
+                chunk.postings.emplace_back();
+            }
+            local_ids.push_back(it->second);
+        }
+        sort(local_ids.begin(), local_ids.end());
+        auto& terms = document_terms[i];
+        for (size_t begin = 0, end = 0; begin < local_ids.size(); begin = end) {
+            while (end < local_ids.size() && local_ids[end] == local_ids[begin]) {
+                ++end;
+            }
+            const uint32_t count = static_cast<uint32_t>(end - begin);
+            terms.push_back({ local_ids[begin], count });
+            chunk.postings[local_ids[begin]].push_back({ static_cast<int>(i), count });
+        }
+        inv_word_counts[i] = 1.0 / words.size();
+    }
+}
+
+vector<SearchServer::BatchTerm> SearchServer::InternBatch(vector<BatchChunk>& chunks) {
+    vector<BatchTerm> batch_terms;
+    // position of a term in batch_terms, only for the terms of this batch
+    unordered_map<TermId, size_t> positions;
+    for (BatchChunk& chunk : chunks) {
+        chunk.term_ids.reserve(chunk.words.size());
+        for (size_t local_id = 0; local_id < chunk.words.size(); ++local_id) {
+            const TermId term = terms_.Intern(chunk.words[local_id]);
+            chunk.term_ids.push_back(term);
+            const auto [it, inserted] = positions.emplace(term, batch_terms.size());
+            if (inserted) {
+                batch_terms.push_back({ term, {} });
+            }
+            batch_terms[it->second].postings.push_back(&chunk.postings[local_id]);
+        }
+    }
+    word_to_document_freqs_.resize(terms_.size());
+    return batch_terms;
+}
+
+void SearchServer::AppendBatchColumns(const vector<NewDocument>& documents,
+    const vector<vector<DocumentTerm>>& document_terms, const vector<double>& inv_word_counts) {
+    auto& all_terms = document_terms_.Mutable();
+    auto& term_ends = document_term_ends_.Mutable();
+    auto& ids = document_ids_.Mutable();
+    auto& ratings = document_ratings_.Mutable();
+    auto& statuses = document_statuses_.Mutable();
+    auto& document_inv_word_counts = document_inv_word_counts_.Mutable();
+    auto& removed = document_removed_.Mutable();
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const DocumentTerm* terms = document_terms[i].data();
+        InsertFingerprint(static_cast<int>(ids.size()), ComputeFingerprint(terms, terms + document_terms[i].size()));
+        all_terms.insert(all_terms.end(), document_terms[i].begin(), document_terms[i].end());
+        term_ends.push_back(all_terms.size());
+        document_ordinals_.emplace(documents[i].id, static_cast<int>(ids.size()));
+        ids.push_back(documents[i].id);
+        ratings.push_back(ComputeAverageRating(documents[i].ratings));
+        statuses.push_back(documents[i].status);
+        document_inv_word_counts.push_back(inv_word_counts[i]);
+        removed.push_back(false);
+    }
+    document_count_ += static_cast<int>(documents.size());
+    ++generation_;
+}
+
+vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status,
+    size_t max_result_count) const {
     return FindTopDocuments(
         raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
             return document_status == status;
-        });
+        }, max_result_count);
 }
 
 vector<Document> SearchServer::FindTopDocuments(const string_view raw_query) const {
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
+const vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, const string_view raw_query,
+    DocumentStatus status, size_t max_result_count) const {
+    return FindTopDocuments(
+        context, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+            return document_status == status;
+        }, max_result_count);
+}
+
+const vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, const string_view raw_query) const {
+    return FindTopDocuments(context, raw_query, DocumentStatus::ACTUAL);
+}
+
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return document_count_;
+}
+
+uint64_t SearchServer::GetGeneration() const {
+    return generation_;
+}
+
+string SearchServer::NormalizeQuery(const string_view raw_query) const {
+    const auto query = ParseQueryPar(execution::seq, raw_query);
+    string result;
+    for (const string_view word : query.plus_words) {
+        result += word;
+        result += ' ';
+    }
+    for (const string_view word : query.minus_words) {
+        result += '-';
+        result += word;
+        result += ' ';
+    }
+    return result;
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view raw_query,
     int document_id) const {
 
-    if (document_ids_.count(document_id) == 0) {
+    const int ordinal = FindOrdinal(document_id);
+    if (ordinal < 0) {
         throw out_of_range("out_of_range");
     }
 
     const auto query = ParseQuery(raw_query);
 
     for (const string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+        const auto* word_documents = FindWordDocuments(word);
+        if (word_documents == nullptr) {
             continue;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            return { {}, documents_.at(document_id).status };
+        if (word_documents->GetCount(ordinal)) {
+            return { vector<string_view>{}, document_statuses_[ordinal] };
         }
     }
 
     vector<string_view> matched_words;
     for (const string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+        const auto* word_documents = FindWordDocuments(word);
+        if (word_documents == nullptr) {
             continue;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
+        if (word_documents->GetCount(ordinal)) {
             matched_words.push_back(word);
         }
     }
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, document_statuses_[ordinal] };
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(execution::sequenced_policy,
     const string_view raw_query,
     int document_id) const {
 
-    if (document_ids_.count(document_id) == 0) {
+    const int ordinal = FindOrdinal(document_id);
+    if (ordinal < 0) {
         throw out_of_range("out_of_range");
     }
 
     const auto query = ParseQueryPar(execution::seq, raw_query);
     for (const string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+        const auto* word_documents = FindWordDocuments(word);
+        if (word_documents == nullptr) {
             continue;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            return { {}, documents_.at(document_id).status };
+        if (word_documents->GetCount(ordinal)) {
+            return { vector<string_view>{}, document_statuses_[ordinal] };
         }
     }
 
     vector<string_view> matched_words;
     for (const string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+        const auto* word_documents = FindWordDocuments(word);
+        if (word_documents == nullptr) {
             continue;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
+        if (word_documents->GetCount(ordinal)) {
             matched_words.push_back(word);
         }
     }
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, document_statuses_[ordinal] };
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(execution::parallel_policy,
     const string_view raw_query,
     int document_id) const {
 
-    if (document_ids_.count(document_id) == 0) {
+    const int ordinal = FindOrdinal(document_id);
+    if (ordinal < 0) {
         throw out_of_range("out_of_range");
     }
 
@@ -118,13 +328,14 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(execution
     bool statement = any_of(
         execution::par,
         query.minus_words.begin(), query.minus_words.end(),
-        [&freqs = word_to_document_freqs_, document_id](const string_view word) {
-            return (freqs.count(word) && freqs.at(word).count(document_id));
+        [this, ordinal](const string_view word) {
+            const auto* word_documents = FindWordDocuments(word);
+            return (word_documents && word_documents->GetCount(ordinal));
         }
     );
 
     if (statement) {
-        return { {}, documents_.at(document_id).status };
+        return { vector<string_view>{}, document_statuses_[ordinal] };
     }
 
     vector<string_view> matched_words(query.plus_words.size());
@@ -132,8 +343,9 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(execution
         execution::par,
         query.plus_words.begin(), query.plus_words.end(),
         matched_words.begin(),
-        [&freqs = word_to_document_freqs_, document_id](const string_view word) {
-            return (freqs.count(word) && freqs.at(word).count(document_id));
+        [this, ordinal](const string_view word) {
+            const auto* word_documents = FindWordDocuments(word);
+            return (word_documents && word_documents->GetCount(ordinal));
         }
     );
 
@@ -141,11 +353,61 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(execution
     auto unique_words_end = unique(execution::par, matched_words.begin(), matched_end);
     matched_words.erase(unique_words_end, matched_words.end());
 
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, document_statuses_[ordinal] };
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view raw_query, int document_id,
+    QueryStats& stats) const {
+
+    const int ordinal = FindOrdinal(document_id);
+    if (ordinal < 0) {
+        throw out_of_range("out_of_range");
+    }
+
+    stats = {};
+    auto phase_start = chrono::steady_clock::now();
+    const auto end_phase = [&phase_start](chrono::nanoseconds& phase_time) {
+        const auto now = chrono::steady_clock::now();
+        phase_time += now - phase_start;
+        phase_start = now;
+    };
+
+    const auto query = ParseQueryPar(execution::seq, raw_query);
+    end_phase(stats.parse_time);
+    for (const string_view word : query.minus_words) {
+        const auto* word_documents = FindWordDocuments(word);
+        if (word_documents == nullptr) {
+            continue;
+        }
+        ++stats.minus_terms;
+        ++stats.postings_scanned;
+        if (word_documents->GetCount(ordinal)) {
+            ++stats.minus_rejections;
+            end_phase(stats.minus_filter_time);
+            return { vector<string_view>{}, document_statuses_[ordinal] };
+        }
+    }
+    end_phase(stats.minus_filter_time);
+
+    vector<string_view> matched_words;
+    for (const string_view word : query.plus_words) {
+        const auto* word_documents = FindWordDocuments(word);
+        if (word_documents == nullptr) {
+            continue;
+        }
+        ++stats.plus_terms;
+        ++stats.postings_scanned;
+        if (word_documents->GetCount(ordinal)) {
+            matched_words.push_back(word);
+        }
+    }
+    stats.candidates = matched_words.empty() ? 0 : 1;
+    end_phase(stats.scan_time);
+    return { matched_words, document_statuses_[ordinal] };
 }
 
 bool SearchServer::IsStopWord(const string_view word) const {
-    return stop_words_.count(string{ word }) > 0;
+    return stop_words_.Contains(word);
 }
 bool SearchServer::IsValidWord(const string_view word) {
     // A valid word must not contain special characters
@@ -153,17 +415,20 @@ bool SearchServer::IsValidWord(const string_view word) {
         return c >= '\0' && c < ' ';
         });
 }
-vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-    vector<string_view> words;
-    for (const string_view word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw invalid_argument("Word "s + string{ word } + " is invalid"s);
-        }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
+void SearchServer::SplitIntoWordsNoStop(string_view text, vector<string_view>& words) const {
+    const size_t invalid_word = SplitIntoWords(text, words);
+    if (invalid_word < words.size()) {
+        throw invalid_argument("Word "s + string{ words[invalid_word] } + " is invalid"s);
+    }
+    words.erase(remove_if(words.begin(), words.end(), [this](const string_view word) {
+        return IsStopWord(word);
+        }), words.end());
+}
+void SearchServer::SplitQueryIntoWords(string_view text, vector<string_view>& words) {
+    const size_t invalid_word = SplitIntoWords(text, words);
+    if (invalid_word < words.size()) {
+        throw invalid_argument("Query word "s + string{ words[invalid_word] } + " is invalid");
     }
-    return words;
 }
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     if (ratings.empty())
@@ -181,15 +446,19 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const string_view text) con
         is_minus = true;
         word = word.substr(1);
     }
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+    // control characters are rejected by SplitQueryIntoWords
+    if (word.empty() || word[0] == '-') {
         throw invalid_argument("Query word "s + string{ text } + " is invalid");
     }
     return { word, is_minus, IsStopWord(word) };
 }
 
 SearchServer::Query SearchServer::ParseQuery(string_view text) const {
+    TRACE_SPAN(PARSE);
     Query result;
-    for (const string_view word : SplitIntoWords(text)) {
+    vector<string_view> words;
+    SplitQueryIntoWords(text, words);
+    for (const string_view word : words) {
         const auto query_word = ParseQueryWord(word);
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
@@ -204,8 +473,10 @@ SearchServer::Query SearchServer::ParseQuery(string_view text) const {
 }
 
 SearchServer::ParQuery SearchServer::ParseQueryPar(execution::sequenced_policy, string_view text) const {
+    TRACE_SPAN(PARSE);
     ParQuery result;
-    vector<string_view> words = SplitIntoWords(text);
+    vector<string_view> words;
+    SplitQueryIntoWords(text, words);
 
     sort(words.begin(), words.end());
     auto iter_words = unique(words.begin(), words.end());
@@ -226,9 +497,12 @@ SearchServer::ParQuery SearchServer::ParseQueryPar(execution::sequenced_policy,
 }
 
 SearchServer::ParQuery SearchServer::ParseQueryPar(execution::parallel_policy, string_view text) const {
+    TRACE_SPAN(PARSE);
     ParQuery result;
+    vector<string_view> words;
+    SplitQueryIntoWords(text, words);
 
-    for (const string_view word : SplitIntoWords(text)) {
+    for (const string_view word : words) {
         const auto query_word = ParseQueryWord(word);
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
@@ -242,38 +516,550 @@ SearchServer::ParQuery SearchServer::ParseQueryPar(execution::parallel_policy, s
     return result;
 }
 
+void SearchServer::ParseQueryTerms(QueryContext& context, string_view text) const {
+    TRACE_SPAN(PARSE);
+    auto& words = context.words_;
+    SplitQueryIntoWords(text, words);
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+
+    for (const string_view word : words) {
+        const auto query_word = ParseQueryWord(word);
+        if (query_word.is_stop) {
+            continue;
+        }
+        const TermId term = terms_.Find(query_word.data);
+        if (term == TermDictionary::NO_TERM || word_to_document_freqs_[term].empty()) {
+            continue;
+        }
+        (query_word.is_minus ? context.minus_terms_ : context.plus_terms_).push_back(term);
+    }
+}
+
+bool SearchServer::IsWorthPruning(const ParQuery& query) const {
+    // score bound and length of the list of every plus-term
+    vector<pair<double, size_t>> terms;
+    for (const string_view word : query.plus_words) {
+        if (const auto* word_documents = FindWordDocuments(word)) {
+            terms.push_back({ word_documents->GetMaxTermFreq() * ComputeWordInverseDocumentFreq(*word_documents),
+                word_documents->size() });
+        }
+    }
+    if (terms.size() > MAX_PRUNED_QUERY_TERMS) {
+        return false;
+    }
+    // the top documents score at least as high as the strongest term alone can, so the weakest
+    // terms whose bounds add up to less than that are expected to become non-essential: only
+    // the lists of the other terms are scanned
+    sort(terms.begin(), terms.end());
+    const double strongest = terms.empty() ? 0.0 : terms.back().first;
+    double bound = 0.0;
+    size_t scanned_postings = 0;
+    for (const auto [max_score, posting_count] : terms) {
+        bound += max_score;
+        if (bound >= strongest) {
+            scanned_postings += posting_count;
+        }
+    }
+    return scanned_postings * MIN_DOCUMENTS_PER_SCANNED_POSTING <= static_cast<size_t>(GetDocumentCount());
+}
+
+const PostingList* SearchServer::FindWordDocuments(const string_view word) const {
+    const TermId term = terms_.Find(word);
+    if (term == TermDictionary::NO_TERM || word_to_document_freqs_[term].empty()) {
+        return nullptr;
+    }
+    return &word_to_document_freqs_[term];
+}
+
 // Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(const string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+bool SearchServer::ContainsDocument(int document_id) const {
+    return FindOrdinal(document_id) >= 0;
+}
+
+size_t SearchServer::GetVocabularySize() const {
+    return terms_.size();
+}
+
+size_t SearchServer::GetTermStorageCapacity() const {
+    return terms_.GetArenaCapacity();
 }
 
-set<int>::iterator SearchServer::begin() {
-    return document_ids_.begin();
+size_t SearchServer::GetDocumentFrequency(const string_view word) const {
+    const auto* word_documents = FindWordDocuments(word);
+    return word_documents == nullptr ? 0 : word_documents->size();
 }
 
-set<int>::iterator SearchServer::end() {
-    return document_ids_.end();
+double SearchServer::ComputeWordInverseDocumentFreq(const PostingList& word_documents) const {
+    return log(GetDocumentCount() * 1.0 / word_documents.size());
 }
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static const map<string_view, double> word_frequencies;
-    if (document_to_word_freqs_.count(document_id)) {
-        return document_to_word_freqs_.at(document_id);
+SearchServer::DocumentIdIterator::DocumentIdIterator(const SearchServer& server, size_t ordinal)
+    : server_(&server)
+    , ordinal_(ordinal) {
+    SkipRemoved();
+}
+
+SearchServer::DocumentIdIterator::reference SearchServer::DocumentIdIterator::operator*() const {
+    return server_->document_ids_[ordinal_];
+}
+
+SearchServer::DocumentIdIterator& SearchServer::DocumentIdIterator::operator++() {
+    ++ordinal_;
+    SkipRemoved();
+    return *this;
+}
+
+bool SearchServer::DocumentIdIterator::operator==(const DocumentIdIterator& other) const {
+    return ordinal_ == other.ordinal_;
+}
+
+bool SearchServer::DocumentIdIterator::operator!=(const DocumentIdIterator& other) const {
+    return !(*this == other);
+}
+
+void SearchServer::DocumentIdIterator::SkipRemoved() {
+    while (ordinal_ < server_->document_removed_.size() && server_->document_removed_[ordinal_]) {
+        ++ordinal_;
+    }
+}
+
+SearchServer::DocumentIdIterator SearchServer::begin() const {
+    return DocumentIdIterator(*this, 0);
+}
+
+SearchServer::DocumentIdIterator SearchServer::end() const {
+    return DocumentIdIterator(*this, document_ids_.size());
+}
+
+map<string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    map<string_view, double> word_frequencies;
+    const int ordinal = FindOrdinal(document_id);
+    if (ordinal >= 0) {
+        const auto [terms_begin, terms_end] = GetDocumentTerms(ordinal);
+        for (auto it = terms_begin; it != terms_end; ++it) {
+            word_frequencies.emplace(terms_.GetTerm(it->term), it->count * document_inv_word_counts_[ordinal]);
+        }
     }
     return word_frequencies;
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    if (document_to_word_freqs_.count(document_id)) {
-        for (const auto& [target_word, _] : document_to_word_freqs_.at(document_id)) {
-            auto& doc_by_target_word = word_to_document_freqs_.at(target_word);
-            doc_by_target_word.erase(document_id);
-            if (doc_by_target_word.empty())
-                word_to_document_freqs_.erase(target_word);
+    const int ordinal = FindOrdinal(document_id);
+    if (ordinal < 0) {
+        return;
+    }
+    const auto [terms_begin, terms_end] = GetDocumentTerms(ordinal);
+    for (auto it = terms_begin; it != terms_end; ++it) {
+        ErasePosting(it->term, ordinal);
+    }
+    EraseDocumentColumns(ordinal);
+}
+
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    RemoveDocuments(execution::seq, document_ids);
+}
+
+int SearchServer::FindOrdinal(int document_id) const {
+    if (const auto it = document_ordinals_.find(document_id); it != document_ordinals_.end()) {
+        return it->second;
+    }
+    const auto it = lower_bound(snapshot_ordinals_.begin(), snapshot_ordinals_.end(), document_id,
+        [](const DocumentOrdinal& entry, int id) {
+            return entry.document_id < id;
+        });
+    // documents removed after loading stay in the snapshot list and are told apart by the tombstone
+    if (it != snapshot_ordinals_.end() && it->document_id == document_id && !document_removed_[it->ordinal]) {
+        return it->ordinal;
+    }
+    return -1;
+}
+
+void SearchServer::AddDocumentFrom(const SearchServer& source, int source_ordinal) {
+    const int document_id = source.document_ids_[source_ordinal];
+    if (FindOrdinal(document_id) >= 0) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    const auto [terms_begin, terms_end] = source.GetDocumentTerms(source_ordinal);
+    vector<DocumentTerm> terms;
+    terms.reserve(terms_end - terms_begin);
+    for (auto it = terms_begin; it != terms_end; ++it) {
+        terms.push_back({ terms_.Intern(source.terms_.GetTerm(it->term)), it->count });
+    }
+    // the terms have other ids here, so their order changes
+    sort(terms.begin(), terms.end(), [](const DocumentTerm& lhs, const DocumentTerm& rhs) {
+        return lhs.term < rhs.term;
+    });
+    const double inv_word_count = source.document_inv_word_counts_[source_ordinal];
+    const int ordinal = static_cast<int>(document_ids_.size());
+    word_to_document_freqs_.resize(terms_.size());
+    auto& document_terms = document_terms_.Mutable();
+    for (const auto [term, count] : terms) {
+        document_terms.push_back({ term, count });
+        word_to_document_freqs_[term].Add(ordinal, count, count * inv_word_count);
+    }
+    document_term_ends_.Mutable().push_back(document_terms.size());
+    document_ordinals_.emplace(document_id, ordinal);
+    document_ids_.Mutable().push_back(document_id);
+    document_ratings_.Mutable().push_back(source.document_ratings_[source_ordinal]);
+    document_statuses_.Mutable().push_back(source.document_statuses_[source_ordinal]);
+    document_inv_word_counts_.Mutable().push_back(inv_word_count);
+    document_removed_.Mutable().push_back(false);
+    InsertFingerprint(ordinal, ComputeFingerprint(terms.data(), terms.data() + terms.size()));
+    ++document_count_;
+    ++generation_;
+}
+
+pair<const SearchServer::DocumentTerm*, const SearchServer::DocumentTerm*> SearchServer::GetDocumentTerms(int ordinal) const {
+    const uint64_t begin = ordinal == 0 ? 0 : document_term_ends_[ordinal - 1];
+    return { document_terms_.data() + begin, document_terms_.data() + document_term_ends_[ordinal] };
+}
+
+namespace {
+
+uint64_t Mix(uint64_t value) {
+    // finaliser of splitmix64
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+} // namespace
+
+uint64_t SearchServer::ComputeFingerprint(const DocumentTerm* terms_begin, const DocumentTerm* terms_end) {
+    // a sum does not depend on the order of the terms, which changes with their ids
+    uint64_t fingerprint = 0;
+    for (auto it = terms_begin; it != terms_end; ++it) {
+        fingerprint += Mix(it->term + uint64_t{ 1 });
+    }
+    return fingerprint;
+}
+
+int SearchServer::FindDuplicateOrdinal(const DocumentTerm* terms_begin, const DocumentTerm* terms_end,
+    uint64_t fingerprint) const {
+    const auto same_term = [](const DocumentTerm& lhs, const DocumentTerm& rhs) {
+        return lhs.term == rhs.term;
+    };
+    int duplicate_ordinal = -1;
+    const auto [begin, end] = fingerprint_ordinals_.equal_range(fingerprint);
+    for (auto it = begin; it != end; ++it) {
+        // different sets rarely share a fingerprint, but the terms decide
+        const auto [other_begin, other_end] = GetDocumentTerms(it->second);
+        if (equal(terms_begin, terms_end, other_begin, other_end, same_term)
+            && (duplicate_ordinal < 0 || document_ids_[it->second] < document_ids_[duplicate_ordinal])) {
+            duplicate_ordinal = it->second;
+        }
+    }
+    return duplicate_ordinal;
+}
+
+void SearchServer::InsertFingerprint(int ordinal, uint64_t fingerprint) {
+    document_fingerprints_.Mutable().push_back(fingerprint);
+    fingerprint_ordinals_.emplace(fingerprint, ordinal);
+    if (fingerprint_ordinals_.count(fingerprint) == 2) {
+        shared_fingerprints_.insert(fingerprint);
+    }
+}
+
+void SearchServer::EraseFingerprint(int ordinal) {
+    const uint64_t fingerprint = document_fingerprints_[ordinal];
+    const auto [begin, end] = fingerprint_ordinals_.equal_range(fingerprint);
+    fingerprint_ordinals_.erase(find_if(begin, end, [ordinal](const pair<const uint64_t, int>& entry) {
+        return entry.second == ordinal;
+    }));
+    if (fingerprint_ordinals_.count(fingerprint) == 1) {
+        shared_fingerprints_.erase(fingerprint);
+    }
+}
+
+vector<int> SearchServer::GetDuplicateIds() const {
+    vector<int> duplicates;
+    vector<int> ordinals;
+    // different term sets met under the current fingerprint; the smallest id of each is kept
+    vector<int> originals;
+    for (const uint64_t fingerprint : shared_fingerprints_) {
+        ordinals.clear();
+        const auto [begin, end] = fingerprint_ordinals_.equal_range(fingerprint);
+        for (auto it = begin; it != end; ++it) {
+            ordinals.push_back(it->second);
+        }
+        sort(ordinals.begin(), ordinals.end(), [this](int lhs, int rhs) {
+            return document_ids_[lhs] < document_ids_[rhs];
+        });
+        originals.clear();
+        for (const int ordinal : ordinals) {
+            const auto [terms_begin, terms_end] = GetDocumentTerms(ordinal);
+            const bool is_duplicate = any_of(originals.begin(), originals.end(), [&](int original) {
+                const auto [original_begin, original_end] = GetDocumentTerms(original);
+                return equal(terms_begin, terms_end, original_begin, original_end,
+                    [](const DocumentTerm& lhs, const DocumentTerm& rhs) {
+                        return lhs.term == rhs.term;
+                    });
+            });
+            if (is_duplicate) {
+                duplicates.push_back(document_ids_[ordinal]);
+            }
+            else {
+                originals.push_back(ordinal);
+            }
+        }
+    }
+    sort(duplicates.begin(), duplicates.end());
+    return duplicates;
+}
+
+void SearchServer::ErasePosting(TermId term, int ordinal) {
+    PostingList& word_documents = word_to_document_freqs_[term];
+    word_documents.Erase(ordinal);
+    if (word_documents.empty()) {
+        word_documents = PostingList();
+    }
+}
+
+void SearchServer::ErasePostings(TermId term, const vector<int>& sorted_ordinals) {
+    PostingList& word_documents = word_to_document_freqs_[term];
+    word_documents.Erase(sorted_ordinals.data(), sorted_ordinals.data() + sorted_ordinals.size());
+    if (word_documents.empty()) {
+        word_documents = PostingList();
+    }
+}
+
+void SearchServer::CompactIfSparse() {
+    const size_t garbage = document_ids_.size() - document_count_;
+    if (garbage >= MIN_COMPACTION_GARBAGE && garbage >= static_cast<size_t>(document_count_)) {
+        Compact();
+    }
+}
+
+// Re-adds the live documents to an empty index and takes over its storage. Only the
+// terms in use are interned into the new dictionary, so the old arena, columns and any
+// snapshot mapping are released with the old storage
+void SearchServer::Compact() {
+    SearchServer compacted(stop_words_);
+    compacted.AddDocumentsFrom(*this, [](int) {
+        return true;
+    });
+    terms_ = move(compacted.terms_);
+    word_to_document_freqs_ = move(compacted.word_to_document_freqs_);
+    document_term_ends_ = move(compacted.document_term_ends_);
+    document_terms_ = move(compacted.document_terms_);
+    document_ordinals_ = move(compacted.document_ordinals_);
+    snapshot_ordinals_ = move(compacted.snapshot_ordinals_);
+    document_ids_ = move(compacted.document_ids_);
+    document_ratings_ = move(compacted.document_ratings_);
+    document_statuses_ = move(compacted.document_statuses_);
+    document_inv_word_counts_ = move(compacted.document_inv_word_counts_);
+    document_removed_ = move(compacted.document_removed_);
+    document_fingerprints_ = move(compacted.document_fingerprints_);
+    fingerprint_ordinals_ = move(compacted.fingerprint_ordinals_);
+    shared_fingerprints_ = move(compacted.shared_fingerprints_);
+    snapshot_.reset();
+    ++generation_;
+}
+
+// Everything a query or a change may index by is checked: term ids, ordinals, posting
+// block tables and the id lookup table. Posting bytes are covered by the checksum and are
+// decoded only for SnapshotCheck::FULL, since that is a pass over every posting. Values
+// like ratings and statuses are read as they are
+void SearchServer::ValidateSnapshotColumns(SnapshotCheck check) const {
+    const size_t document_count = document_ids_.size();
+    for (const DocumentTerm& document_term : document_terms_) {
+        if (document_term.term >= terms_.size()) {
+            throw SnapshotError("Snapshot document has an unknown term"s);
+        }
+    }
+    for (const PostingList& word_documents : word_to_document_freqs_) {
+        const int document_id_bound = static_cast<int>(document_count);
+        if (check == SnapshotCheck::FULL ? !word_documents.IsWellFormed(document_id_bound)
+                : !word_documents.HasWellFormedBlocks(document_id_bound)) {
+            throw SnapshotError("Snapshot posting list is corrupted"s);
+        }
+    }
+    // the live documents sorted by id, each exactly once
+    const size_t live_count = count(document_removed_.begin(), document_removed_.end(), uint8_t{ 0 });
+    if (snapshot_ordinals_.size() != live_count) {
+        throw SnapshotError("Snapshot document ids are corrupted"s);
+    }
+    for (size_t i = 0; i < snapshot_ordinals_.size(); ++i) {
+        const auto [document_id, ordinal] = snapshot_ordinals_[i];
+        if (ordinal < 0 || static_cast<size_t>(ordinal) >= document_count || document_removed_[ordinal]
+            || document_ids_[ordinal] != document_id || document_id < 0
+            || (i > 0 && snapshot_ordinals_[i - 1].document_id >= document_id)) {
+            throw SnapshotError("Snapshot document ids are corrupted"s);
+        }
+    }
+}
+
+// Postings of the document must already be erased
+void SearchServer::EraseDocumentColumns(int ordinal) {
+    document_ordinals_.erase(document_ids_[ordinal]);
+    EraseFingerprint(ordinal);
+    document_removed_.Mutable()[ordinal] = true;
+    --document_count_;
+    ++generation_;
+}
+
+namespace {
+
+struct SnapshotPostingHead {
+    uint64_t block_begin;
+    uint64_t block_count;
+    uint64_t data_begin;
+    uint64_t data_size;
+    uint64_t size;
+    double max_term_freq;
+};
+
+static_assert(sizeof(DocumentStatus) == sizeof(int32_t));
+
+template <typename T>
+void WriteSection(SnapshotWriter& writer, const CowVector<T>& values) {
+    writer.BeginSection();
+    writer.Write(values.data(), values.size());
+    writer.EndSection();
+}
+
+template <typename T>
+CowVector<T> ViewSection(const MappedSnapshot& snapshot, size_t& section, size_t expected_size) {
+    const auto [data, size] = snapshot.GetSection<T>(section);
+    if (size != expected_size) {
+        throw SnapshotError("Snapshot section has unexpected size"s);
+    }
+    return CowVector<T>::View(data, size);
+}
+
+} // namespace
+
+// Sections follow in the order they are read by LoadSnapshot
+void SearchServer::SaveSnapshot(const string& path) const {
+    SnapshotWriter writer(path);
+
+    writer.BeginSection();
+    for (const string& word : stop_words_) {
+        // stop words are valid words, so they never contain '\0'
+        writer.Write(word.data(), word.size() + 1);
+    }
+    writer.EndSection();
+
+    terms_.Save(writer);
+
+    vector<SnapshotPostingHead> heads;
+    heads.reserve(terms_.size());
+    uint64_t block_begin = 0;
+    uint64_t data_begin = 0;
+    for (TermId term = 0; term < terms_.size(); ++term) {
+        // terms interned by a failed AddDocument may have no list yet
+        const PostingList empty_list;
+        const PostingList& list = term < word_to_document_freqs_.size() ? word_to_document_freqs_[term] : empty_list;
+        heads.push_back({ block_begin, list.GetBlocks().size(), data_begin, list.GetData().size(),
+            list.size(), list.GetMaxTermFreq() });
+        block_begin += list.GetBlocks().size();
+        data_begin += list.GetData().size();
+    }
+    writer.BeginSection();
+    writer.Write(heads.data(), heads.size());
+    writer.EndSection();
+    writer.BeginSection();
+    for (const PostingList& list : word_to_document_freqs_) {
+        writer.Write(list.GetBlocks().data(), list.GetBlocks().size());
+    }
+    writer.EndSection();
+    writer.BeginSection();
+    for (const PostingList& list : word_to_document_freqs_) {
+        writer.Write(list.GetData().data(), list.GetData().size());
+    }
+    writer.EndSection();
+
+    WriteSection(writer, document_term_ends_);
+    WriteSection(writer, document_terms_);
+    WriteSection(writer, document_ids_);
+    WriteSection(writer, document_ratings_);
+    WriteSection(writer, document_statuses_);
+    WriteSection(writer, document_inv_word_counts_);
+    WriteSection(writer, document_removed_);
+    WriteSection(writer, document_fingerprints_);
+
+    vector<DocumentOrdinal> ordinals;
+    ordinals.reserve(document_count_);
+    for (int ordinal = 0; ordinal < static_cast<int>(document_ids_.size()); ++ordinal) {
+        if (!document_removed_[ordinal]) {
+            ordinals.push_back({ document_ids_[ordinal], ordinal });
+        }
+    }
+    sort(ordinals.begin(), ordinals.end(), [](const DocumentOrdinal& lhs, const DocumentOrdinal& rhs) {
+        return lhs.document_id < rhs.document_id;
+    });
+    writer.BeginSection();
+    writer.Write(ordinals.data(), ordinals.size());
+    writer.EndSection();
+
+    writer.Finish();
+}
+
+SearchServer SearchServer::LoadSnapshot(const string& path, SnapshotCheck check) {
+    auto snapshot = MappedSnapshot::Open(path);
+    size_t section = 0;
+
+    const auto [stop_words_data, stop_words_size] = snapshot->GetSection<char>(section);
+    if (stop_words_size > 0 && stop_words_data[stop_words_size - 1] != '\0') {
+        throw SnapshotError("Snapshot stop words are not terminated"s);
+    }
+    vector<string_view> stop_words;
+    for (size_t begin = 0; begin < stop_words_size;) {
+        const string_view word(stop_words_data + begin);
+        stop_words.push_back(word);
+        begin += word.size() + 1;
+    }
+    SearchServer server(stop_words);
+
+    server.terms_ = TermDictionary::Load(*snapshot, section);
+    const auto [heads, head_count] = snapshot->GetSection<SnapshotPostingHead>(section);
+    const auto [blocks, block_count] = snapshot->GetSection<PostingList::Block>(section);
+    const auto [data, data_size] = snapshot->GetSection<uint8_t>(section);
+    if (head_count != server.terms_.size()) {
+        throw SnapshotError("Snapshot posting lists do not match the dictionary"s);
+    }
+    server.word_to_document_freqs_.reserve(head_count);
+    for (size_t term = 0; term < head_count; ++term) {
+        const SnapshotPostingHead& head = heads[term];
+        if (head.block_begin > block_count || head.block_count > block_count - head.block_begin
+            || head.data_begin > data_size || head.data_size > data_size - head.data_begin) {
+            throw SnapshotError("Snapshot posting list is out of bounds"s);
+        }
+        server.word_to_document_freqs_.push_back(PostingList::View(blocks + head.block_begin, head.block_count,
+            data + head.data_begin, head.data_size, head.size, head.max_term_freq));
+    }
+
+    const auto [term_ends, document_count] = snapshot->GetSection<uint64_t>(section);
+    if (document_count > static_cast<size_t>(numeric_limits<int>::max())
+        || !is_sorted(term_ends, term_ends + document_count)) {
+        throw SnapshotError("Snapshot documents are corrupted"s);
+    }
+    server.document_term_ends_ = CowVector<uint64_t>::View(term_ends, document_count);
+    server.document_terms_ = ViewSection<DocumentTerm>(*snapshot, section,
+        document_count == 0 ? 0 : term_ends[document_count - 1]);
+    server.document_ids_ = ViewSection<int>(*snapshot, section, document_count);
+    server.document_ratings_ = ViewSection<int>(*snapshot, section, document_count);
+    server.document_statuses_ = ViewSection<DocumentStatus>(*snapshot, section, document_count);
+    server.document_inv_word_counts_ = ViewSection<double>(*snapshot, section, document_count);
+    server.document_removed_ = ViewSection<uint8_t>(*snapshot, section, document_count);
+    server.document_fingerprints_ = ViewSection<uint64_t>(*snapshot, section, document_count);
+    const auto [ordinals, live_count] = snapshot->GetSection<DocumentOrdinal>(section);
+    server.snapshot_ordinals_ = CowVector<DocumentOrdinal>::View(ordinals, live_count);
+    server.ValidateSnapshotColumns(check);
+    server.document_count_ = static_cast<int>(live_count);
+    // the fingerprint table is not mapped, it is rebuilt from the column
+    server.fingerprint_ordinals_.reserve(live_count);
+    for (size_t i = 0; i < live_count; ++i) {
+        const uint64_t fingerprint = server.document_fingerprints_[ordinals[i].ordinal];
+        server.fingerprint_ordinals_.emplace(fingerprint, ordinals[i].ordinal);
+        if (server.fingerprint_ordinals_.count(fingerprint) == 2) {
+            server.shared_fingerprints_.insert(fingerprint);
         }
     }
 
-    documents_.erase(document_id);
-    document_to_word_freqs_.erase(document_id);
-    document_ids_.erase(document_id);
+    server.snapshot_ = move(snapshot);
+    return server;
 }
\ No newline at end of file
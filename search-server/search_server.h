@@ -1,7 +1,15 @@
 #pragma once
 #include "document.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
+#include "score_accumulator.h"
+#include "term_dictionary.h"
+#include "posting_list.h"
+#include "top_documents.h"
+#include "cow_vector.h"
+#include "stop_words.h"
+#include "query_context.h"
+#include "snapshot.h"
+#include "trace.h"
 #include <string>
 #include <vector>
 #include <set>
@@ -13,10 +21,37 @@
 #include <numeric>
 #include <iterator>
 #include <execution>
-#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <limits>
+#include <thread>
+#include <memory>
+#include <optional>
+
+class MappedSnapshot;
+
+// Passed to FindTopDocuments in place of an execution policy to evaluate the query
+// document-at-a-time with MaxScore pruning instead of scoring every posting. Queries
+// with too many terms or postings for pruning to pay off are scored exhaustively
+namespace query_policy {
+    struct DocumentAtATimePolicy {};
+    inline constexpr DocumentAtATimePolicy daat{};
+}
+
+// One document of a batch passed to SearchServer::AddDocuments
+struct NewDocument {
+    int id;
+    std::string_view text;
+    DocumentStatus status;
+    std::vector<int> ratings;
+};
 
-const int MAX_RESULT_DOCUMENT_COUNT = 5;
-const double ACCURACY = 1e-6;
+// What SearchServer::AddDocument does with a document whose set of words equals that
+// of a live document
+enum class DuplicatePolicy {
+    ADD,
+    REJECT,
+};
 
 class SearchServer {
 
@@ -26,54 +61,282 @@ public:
 
     explicit SearchServer(const std::string& stop_words_text);
     explicit SearchServer(const std::string_view stop_words_text);
+    // An index with the same stop words and no documents
+    SearchServer MakeEmpty() const;
 
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
-
+    // Looks the word set up among the fingerprints of the live documents in O(words).
+    // Returns the smallest id of a live document with the same set of words, if any;
+    // with DuplicatePolicy::REJECT such a document is not added
+    std::optional<int> AddDocument(int document_id, const std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings, DuplicatePolicy duplicate_policy);
+
+    // Adds the whole batch or nothing: an invalid or repeated id or an invalid word anywhere
+    // throws invalid_argument before the index is changed. Texts are tokenised chunk by chunk
+    // under the policy and the chunk indexes are merged into the posting lists in one pass
+    void AddDocuments(const std::vector<NewDocument>& documents);
+    template <typename Policy>
+    void AddDocuments(Policy& policy, const std::vector<NewDocument>& documents);
+
+    class TokenizedBatch;
+    // AddDocuments in two steps. TokenizeDocuments reads nothing but the stop words, so
+    // batches can be tokenised on other threads while AddTokenizedDocuments adds earlier
+    // ones. Invalid words throw invalid_argument when tokenising, invalid or repeated ids
+    // when adding; the texts must stay alive until the batch is added
+    TokenizedBatch TokenizeDocuments(std::vector<NewDocument> documents) const;
+    void AddTokenizedDocuments(TokenizedBatch batch);
+
+    // Copies the documents of another index whose ids pass keep(document_id), as if they
+    // were added again with their texts. Throws invalid_argument for an id already present
+    template <typename Keep>
+    void AddDocumentsFrom(const SearchServer& source, Keep keep);
+
+    // max_result_count bounds the result size; only that many candidates are kept while ranking
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const;
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+        size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
     std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
 
     template <typename Policy, typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename Policy>
-    std::vector<Document> FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentStatus status,
+        size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename Policy>
     std::vector<Document> FindTopDocuments(Policy& policy, const std::string_view raw_query) const;
 
+    // Scores the query with the context's buffers instead of allocating its own. The returned
+    // documents live in the context and stay valid until it is used for the next query
+    template <typename DocumentPredicate>
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, const std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, const std::string_view raw_query, DocumentStatus status,
+        size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, const std::string_view raw_query) const;
+
+    // Scores the query as one segment of a larger index: idf(word) gives the inverse
+    // document frequency of every query word instead of this index's own statistics
+    template <typename DocumentPredicate, typename InverseDocumentFreq>
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, const std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t max_result_count, InverseDocumentFreq idf) const;
+
     int GetDocumentCount() const;
+    bool ContainsDocument(int document_id) const;
+    // Calls visit(term_id, count) for every distinct non-stop word of the document in
+    // increasing term id order. Ids are dense and stable until the next compaction
+    template <typename Visit>
+    void ForEachDocumentTerm(int document_id, Visit visit) const;
+    // Number of documents containing the word
+    size_t GetDocumentFrequency(const std::string_view word) const;
+    // Distinct words in the dictionary; words of removed documents stay until compaction
+    size_t GetVocabularySize() const;
+    // Bytes reserved for the words of the dictionary
+    size_t GetTermStorageCapacity() const;
+    // Ids of documents with the same set of words as a document with a smaller id, in
+    // increasing order. Only documents sharing a word set fingerprint are read
+    std::vector<int> GetDuplicateIds() const;
+    // Grows with every change of the indexed documents
+    uint64_t GetGeneration() const;
+
+    // Non-stop query words in a canonical order: sorted unique plus-words, then sorted
+    // unique minus-words with their '-'. Queries with equal forms have equal results.
+    // Throws invalid_argument for invalid queries like FindTopDocuments
+    std::string NormalizeQuery(const std::string_view raw_query) const;
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy, const std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy, const std::string_view raw_query, int document_id) const;
+    // Also fills stats: the words found in the index, the posting lists probed for the
+    // document and the phase times. Minus-words after the first one matched are not looked up
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id,
+        QueryStats& stats) const;
+
+    // Iterates external ids of the live documents in the order they were added
+    class DocumentIdIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = int;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const int*;
+        using reference = const int&;
+
+        DocumentIdIterator(const SearchServer& server, size_t ordinal);
+
+        reference operator*() const;
+        DocumentIdIterator& operator++();
+        bool operator==(const DocumentIdIterator& other) const;
+        bool operator!=(const DocumentIdIterator& other) const;
+
+    private:
+        void SkipRemoved();
+
+        const SearchServer* server_;
+        size_t ordinal_;
+    };
 
-    std::set<int>::iterator begin();
-    std::set<int>::iterator end();
+    DocumentIdIterator begin() const;
+    DocumentIdIterator end() const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Views point into the term dictionary and stay valid until the next Compact()
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+    // Removal costs O(words in the document) and only tombstones the document, so
+    // iterators and views stay valid. A posting list left empty is released at once
     void RemoveDocument(int document_id);
 
     template<typename Policy>
     void RemoveDocument(Policy policy_, int document_id);
 
+    // Unknown and repeated ids are skipped. Every posting list is updated by one task
+    void RemoveDocuments(const std::vector<int>& document_ids);
+    template <typename Policy>
+    void RemoveDocuments(Policy& policy, const std::vector<int>& document_ids);
+
+    // Re-adds the live documents so that removed ones stop taking memory. Ordinals and
+    // term ids are renumbered and terms no document uses leave the dictionary, so
+    // iterators are invalidated. The dictionary is rebuilt from the terms in use and the
+    // old one is freed, so views of terms taken before the call are invalidated too
+    void Compact();
+    // Compacts when removed documents outnumber the live ones
+    void CompactIfSparse();
+
+    // Writes the whole index to a versioned binary file
+    void SaveSnapshot(const std::string& path) const;
+    // Maps the snapshot file into memory and serves queries straight from it. The index
+    // stays modifiable: changed parts are copied out of the mapping on first write.
+    // Sizes, offsets, posting block tables, term ids, ordinals and the checksum are always
+    // checked, so a truncated or damaged file throws SnapshotError, an invalid_argument,
+    // instead of being read out of bounds. SnapshotCheck::FULL also decodes every posting
+    static SearchServer LoadSnapshot(const std::string& path, SnapshotCheck check = SnapshotCheck::CHECKSUM);
+
 private:
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
+    struct DocumentTerm {
+        TermId term;
+        uint32_t count;
     };
 
-    const std::set<std::string> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
-    std::set<int> document_ids_;
-    std::list<std::string> storage; //основное хранилище для строк!
+    struct DocumentOrdinal {
+        int document_id;
+        int ordinal;
+    };
+
+    const StopWords stop_words_;
+    TermDictionary terms_; //основное хранилище для строк!
+    std::vector<PostingList> word_to_document_freqs_; // indexed by TermId, postings hold ordinals
+    // terms of a document sorted by id, the document ordinal owns the range
+    // [document_term_ends_[ordinal - 1], document_term_ends_[ordinal])
+    CowVector<uint64_t> document_term_ends_;
+    CowVector<DocumentTerm> document_terms_;
+
+    // AddDocument maps every external id to a dense ordinal. Document attributes are kept
+    // in flat columns indexed by that ordinal; removed ordinals are tombstoned and never reused.
+    std::unordered_map<int, int> document_ordinals_;
+    // ids of a loaded snapshot sorted for binary search; document_ordinals_ holds the rest
+    CowVector<DocumentOrdinal> snapshot_ordinals_;
+    CowVector<int> document_ids_;
+    CowVector<int> document_ratings_;
+    CowVector<DocumentStatus> document_statuses_;
+    CowVector<double> document_inv_word_counts_;
+    CowVector<uint8_t> document_removed_;
+    // order-independent hash of the document's term ids
+    CowVector<uint64_t> document_fingerprints_;
+    // ordinals of the live documents by fingerprint, and the fingerprints with more than one
+    std::unordered_multimap<uint64_t, int> fingerprint_ordinals_;
+    std::unordered_set<uint64_t> shared_fingerprints_;
+    int document_count_ = 0;
+    uint64_t generation_ = 0;
+    // keeps the mapped memory alive while the columns above view it
+    std::shared_ptr<const MappedSnapshot> snapshot_;
+
+    // Partial inverted index of a contiguous part of an AddDocuments batch.
+    // Words get local ids first and are interned only when the chunks are merged
+    struct BatchChunk {
+        size_t begin = 0;
+        size_t end = 0;
+        std::unordered_map<std::string_view, uint32_t> local_ids;
+        std::vector<std::string_view> words;
+        // by local id, document_id holds the index in the batch
+        std::vector<std::vector<PostingList::Posting>> postings;
+        std::vector<TermId> term_ids;
+        std::string error;
+    };
+
+    // Terms of a batch with their chunk postings, in batch order
+    struct BatchTerm {
+        TermId term;
+        std::vector<const std::vector<PostingList::Posting>*> postings;
+    };
+
+    // Tokenised batch whose words are not interned yet
+    struct BatchState {
+        std::vector<BatchChunk> chunks;
+        // by index in the batch, with local ids of the chunk
+        std::vector<std::vector<DocumentTerm>> document_terms;
+        std::vector<double> inv_word_counts;
+    };
+
+public:
+    class TokenizedBatch {
+    public:
+        const std::vector<NewDocument>& GetDocuments() const {
+            return documents_;
+        }
+
+    private:
+        friend class SearchServer;
+        std::vector<NewDocument> documents_;
+        BatchState state_;
+    };
+
+private:
+
+    // Returns -1 if there is no such document
+    int FindOrdinal(int document_id) const;
+    void ValidateNewDocumentIds(const std::vector<NewDocument>& documents) const;
+    // Fills the terms (with local ids) and inverse lengths of the chunk's documents
+    void TokenizeBatchChunk(const std::vector<NewDocument>& documents, BatchChunk& chunk,
+        std::vector<std::vector<DocumentTerm>>& document_terms, std::vector<double>& inv_word_counts) const;
+    // Throws invalid_argument for the first invalid word of the batch
+    template <typename Policy>
+    void TokenizeBatch(Policy& policy, const std::vector<NewDocument>& documents, size_t chunk_count,
+        BatchState& state) const;
+    // Interns the words and appends the documents; ids must have been validated
+    template <typename Policy>
+    void ApplyBatch(Policy& policy, const std::vector<NewDocument>& documents, BatchState& state);
+    std::vector<BatchTerm> InternBatch(std::vector<BatchChunk>& chunks);
+    void AppendBatchColumns(const std::vector<NewDocument>& documents,
+        const std::vector<std::vector<DocumentTerm>>& document_terms, const std::vector<double>& inv_word_counts);
+    void AddDocumentFrom(const SearchServer& source, int source_ordinal);
+    std::pair<const DocumentTerm*, const DocumentTerm*> GetDocumentTerms(int ordinal) const;
+    static uint64_t ComputeFingerprint(const DocumentTerm* terms_begin, const DocumentTerm* terms_end);
+    // Returns -1 if no live document has the same term ids
+    int FindDuplicateOrdinal(const DocumentTerm* terms_begin, const DocumentTerm* terms_end, uint64_t fingerprint) const;
+    void InsertFingerprint(int ordinal, uint64_t fingerprint);
+    void EraseFingerprint(int ordinal);
+    void EraseDocumentColumns(int ordinal);
+    // Throws SnapshotError if the columns of a loaded snapshot do not fit together
+    void ValidateSnapshotColumns(SnapshotCheck check) const;
+    // Both release the list's memory once it is empty
+    void ErasePosting(TermId term, int ordinal);
+    void ErasePostings(TermId term, const std::vector<int>& sorted_ordinals);
+
+    // compaction waits for at least this many removed documents
+    static const size_t MIN_COMPACTION_GARBAGE = 1024;
+    // query_policy::daat scores exhaustively above this many plus-terms found in the index,
+    // or when fewer than this many documents fall to each posting it expects to scan
+    static const size_t MAX_PRUNED_QUERY_TERMS = 16;
+    static const size_t MIN_DOCUMENTS_PER_SCANNED_POSTING = 8;
 
     bool IsStopWord(const std::string_view word) const;
     static bool IsValidWord(const std::string_view word);
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+    // Both fill the caller's buffer and throw invalid_argument for a word with control characters
+    void SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const;
+    static void SplitQueryIntoWords(std::string_view text, std::vector<std::string_view>& words);
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
     struct QueryWord {
@@ -84,6 +347,9 @@ private:
 
     QueryWord ParseQueryWord(const std::string_view text) const;
 
+    // An empty index with the same stop words
+    explicit SearchServer(const StopWords& stop_words);
+
     struct Query {
         std::set<std::string_view> plus_words;
         std::set<std::string_view> minus_words;
@@ -100,14 +366,31 @@ private:
 
     template <typename Policy>
     ParQuery ParseQueryTop(Policy& policy, std::string_view text) const;
+    // Fills the context with the ids of the query terms that occur in some document
+    void ParseQueryTerms(QueryContext& context, std::string_view text) const;
+
+    // Returns nullptr if no document contains the word
+    const PostingList* FindWordDocuments(const std::string_view word) const;
+    double ComputeWordInverseDocumentFreq(const PostingList& word_documents) const;
 
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const;
+    // term_idf(term, postings) gives the inverse document frequency of a query term
+    template <typename DocumentPredicate, typename TermInverseDocumentFreq>
+    const std::vector<Document>& ScoreQuery(QueryContext& context, const std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t max_result_count, TermInverseDocumentFreq term_idf) const;
 
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
 
     template <typename Policy, typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(Policy& policy, const ParQuery& query, DocumentPredicate document_predicate) const;
+
+    // Whether MaxScore is expected to beat scoring every posting. It only skips postings of
+    // terms whose score bounds are low next to the others; with many terms or with long lists
+    // of comparable terms the merge of the cursors costs more than the accumulator it replaces
+    bool IsWorthPruning(const ParQuery& query) const;
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsAtATime(const ParQuery& query, DocumentPredicate document_predicate,
+        size_t max_result_count) const;
 };
 
 template <typename StringContainer>
@@ -122,105 +405,343 @@ SearchServer::SearchServer(const StringContainer& stop_words)
 
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query,
-    DocumentPredicate document_predicate) const {
+    DocumentPredicate document_predicate, size_t max_result_count) const {
+    TRACE_SPAN(QUERY);
     const auto query = ParseQuery(raw_query);
 
-    auto matched_documents = FindAllDocuments(query, document_predicate);
+    const auto matched_documents = FindAllDocuments(query, document_predicate);
+
+    TRACE_SPAN(TOP_K);
+    return SelectTopDocuments(matched_documents, max_result_count);
+}
+
+template <typename DocumentPredicate>
+const std::vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, const std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t max_result_count) const {
+    return ScoreQuery(context, raw_query, document_predicate, max_result_count,
+        [this](TermId, const PostingList& word_documents) {
+            return ComputeWordInverseDocumentFreq(word_documents);
+        });
+}
 
-    sort(matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            return lhs.relevance > rhs.relevance
-                || (std::abs(lhs.relevance - rhs.relevance) < ACCURACY && lhs.rating > rhs.rating);
+template <typename DocumentPredicate, typename InverseDocumentFreq>
+const std::vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, const std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t max_result_count, InverseDocumentFreq idf) const {
+    return ScoreQuery(context, raw_query, document_predicate, max_result_count,
+        [this, &idf](TermId term, const PostingList&) {
+            return idf(terms_.GetTerm(term));
         });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+}
+
+template <typename Visit>
+void SearchServer::ForEachDocumentTerm(int document_id, Visit visit) const {
+    const int ordinal = FindOrdinal(document_id);
+    if (ordinal < 0) {
+        return;
+    }
+    const auto [terms_begin, terms_end] = GetDocumentTerms(ordinal);
+    for (auto it = terms_begin; it != terms_end; ++it) {
+        visit(it->term, it->count);
     }
-    return matched_documents;
+}
+
+template <typename Keep>
+void SearchServer::AddDocumentsFrom(const SearchServer& source, Keep keep) {
+    for (size_t ordinal = 0; ordinal < source.document_ids_.size(); ++ordinal) {
+        if (!source.document_removed_[ordinal] && keep(source.document_ids_[ordinal])) {
+            AddDocumentFrom(source, static_cast<int>(ordinal));
+        }
+    }
+}
+
+template <typename DocumentPredicate, typename TermInverseDocumentFreq>
+const std::vector<Document>& SearchServer::ScoreQuery(QueryContext& context, const std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t max_result_count, TermInverseDocumentFreq term_idf) const {
+    TRACE_SPAN(QUERY);
+    context.Begin(document_ids_.size(), max_result_count);
+    ParseQueryTerms(context, raw_query);
+    const uint32_t epoch = context.epoch_;
+    QueryStats& stats = context.stats_;
+    stats.plus_terms = context.plus_terms_.size();
+    stats.minus_terms = context.minus_terms_.size();
+    context.EndPhase(&QueryStats::parse_time);
+
+    {
+        TRACE_SPAN(MINUS_FILTER);
+        for (const TermId term : context.minus_terms_) {
+            context.CheckDeadline();
+            stats.postings_scanned += word_to_document_freqs_[term].size();
+            for (auto cursor = word_to_document_freqs_[term].GetCursor(); !cursor.AtEnd(); cursor.Next()) {
+                context.CheckDeadlineEveryInterval();
+                context.excluded_epochs_[cursor.GetDocumentId()] = epoch;
+            }
+        }
+    }
+    context.EndPhase(&QueryStats::minus_filter_time);
+    // kept in locals: the loop calls the predicate, which could otherwise alias the stats
+    size_t minus_rejections = 0;
+    size_t predicate_rejections = 0;
+    {
+        TRACE_SPAN(POSTING_SCAN);
+        for (const TermId term : context.plus_terms_) {
+            context.CheckDeadline();
+            const PostingList& word_documents = word_to_document_freqs_[term];
+            const double inverse_document_freq = term_idf(term, word_documents);
+            stats.postings_scanned += word_documents.size();
+            for (auto cursor = word_documents.GetCursor(); !cursor.AtEnd(); cursor.Next()) {
+                context.CheckDeadlineEveryInterval();
+                const int ordinal = cursor.GetDocumentId();
+                if (context.excluded_epochs_[ordinal] == epoch) {
+                    ++minus_rejections;
+                    continue;
+                }
+                if (!document_predicate(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal])) {
+                    ++predicate_rejections;
+                    continue;
+                }
+                if (context.scored_epochs_[ordinal] != epoch) {
+                    context.scored_epochs_[ordinal] = epoch;
+                    context.scores_[ordinal] = 0.0;
+                    context.scored_ordinals_.push_back(ordinal);
+                }
+                const double term_freq = cursor.GetCount() * document_inv_word_counts_[ordinal];
+                context.scores_[ordinal] += term_freq * inverse_document_freq;
+            }
+        }
+    }
+    stats.minus_rejections = minus_rejections;
+    stats.predicate_rejections = predicate_rejections;
+    stats.candidates = context.scored_ordinals_.size();
+    context.EndPhase(&QueryStats::scan_time);
+
+    TRACE_SPAN(TOP_K);
+    for (const uint32_t ordinal : context.scored_ordinals_) {
+        context.top_documents_.Add({ document_ids_[ordinal], context.scores_[ordinal], document_ratings_[ordinal] });
+    }
+    context.top_documents_.ExtractTo(context.result_);
+    context.EndPhase(&QueryStats::top_k_time);
+    return context.result_;
 }
 
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
     std::map<int, double> document_to_relevance;
-    for (const std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+    {
+        TRACE_SPAN(POSTING_SCAN);
+        for (const std::string_view word : query.plus_words) {
+            const auto* word_documents = FindWordDocuments(word);
+            if (word_documents == nullptr) {
+                continue;
+            }
+            const double inverse_document_freq = ComputeWordInverseDocumentFreq(*word_documents);
+            for (auto cursor = word_documents->GetCursor(); !cursor.AtEnd(); cursor.Next()) {
+                const int ordinal = cursor.GetDocumentId();
+                if (document_predicate(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal])) {
+                    const double term_freq = cursor.GetCount() * document_inv_word_counts_[ordinal];
+                    document_to_relevance[ordinal] += term_freq * inverse_document_freq;
+                }
             }
         }
     }
-    for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+    {
+        TRACE_SPAN(MINUS_FILTER);
+        for (const std::string_view word : query.minus_words) {
+            const auto* word_documents = FindWordDocuments(word);
+            if (word_documents == nullptr) {
+                continue;
+            }
+            for (auto cursor = word_documents->GetCursor(); !cursor.AtEnd(); cursor.Next()) {
+                document_to_relevance.erase(cursor.GetDocumentId());
+            }
         }
     }
 
+    TRACE_SPAN(COLLECT);
     std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
+    for (const auto [ordinal, relevance] : document_to_relevance) {
         matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+            { document_ids_[ordinal], relevance, document_ratings_[ordinal] });
     }
     return matched_documents;    
 }
 
+template <typename Policy>
+void SearchServer::AddDocuments(Policy& policy, const std::vector<NewDocument>& documents) {
+    ValidateNewDocumentIds(documents);
+    const size_t chunk_count = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency() * 4,
+        documents.size() / 256));
+    BatchState state;
+    TokenizeBatch(policy, documents, chunk_count, state);
+    ApplyBatch(policy, documents, state);
+}
+
+template <typename Policy>
+void SearchServer::TokenizeBatch(Policy& policy, const std::vector<NewDocument>& documents, size_t chunk_count,
+    BatchState& state) const {
+    auto& chunks = state.chunks;
+    chunks.resize(chunk_count);
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        chunks[chunk].begin = documents.size() * chunk / chunk_count;
+        chunks[chunk].end = documents.size() * (chunk + 1) / chunk_count;
+    }
+    state.document_terms.resize(documents.size());
+    state.inv_word_counts.resize(documents.size());
+    std::for_each(
+        policy,
+        chunks.begin(), chunks.end(),
+        [this, &documents, &state](BatchChunk& chunk) {
+            TokenizeBatchChunk(documents, chunk, state.document_terms, state.inv_word_counts);
+        }
+    );
+    // chunks go in batch order, so this reports the first invalid document
+    for (const BatchChunk& chunk : chunks) {
+        if (!chunk.error.empty()) {
+            throw std::invalid_argument(chunk.error);
+        }
+    }
+}
+
+template <typename Policy>
+void SearchServer::ApplyBatch(Policy& policy, const std::vector<NewDocument>& documents, BatchState& state) {
+    auto& chunks = state.chunks;
+    auto& document_terms = state.document_terms;
+    const auto& inv_word_counts = state.inv_word_counts;
+    const int first_ordinal = static_cast<int>(document_ids_.size());
+    const std::vector<BatchTerm> batch_terms = InternBatch(chunks);
+    // every term owns its own posting list, and ordinals of the batch follow the existing ones,
+    // so each list is only appended to
+    std::for_each(
+        policy,
+        batch_terms.begin(), batch_terms.end(),
+        [&freqs = word_to_document_freqs_, &inv_word_counts, first_ordinal](const BatchTerm& batch_term) {
+            PostingList& list = freqs[batch_term.term];
+            for (const auto* postings : batch_term.postings) {
+                for (const PostingList::Posting& posting : *postings) {
+                    list.Add(first_ordinal + posting.document_id, posting.count,
+                        posting.count * inv_word_counts[posting.document_id]);
+                }
+            }
+        }
+    );
+    std::for_each(
+        policy,
+        chunks.begin(), chunks.end(),
+        [&document_terms](const BatchChunk& chunk) {
+            for (size_t i = chunk.begin; i < chunk.end; ++i) {
+                for (DocumentTerm& document_term : document_terms[i]) {
+                    document_term.term = chunk.term_ids[document_term.term];
+                }
+                std::sort(document_terms[i].begin(), document_terms[i].end(),
+                    [](const DocumentTerm& lhs, const DocumentTerm& rhs) {
+                        return lhs.term < rhs.term;
+                    });
+            }
+        }
+    );
+    AppendBatchColumns(documents, document_terms, inv_word_counts);
+}
+
 template<typename Policy>
 void SearchServer::RemoveDocument(Policy policy_, int document_id) {
-    if (document_to_word_freqs_.count(document_id)) {
+    const int ordinal = FindOrdinal(document_id);
+    if (ordinal >= 0) {
 
-        std::vector<const std::string*> to_delete(document_to_word_freqs_.at(document_id).size());
+        const auto [terms_begin, terms_end] = GetDocumentTerms(ordinal);
+        std::vector<TermId> to_delete(terms_end - terms_begin);
         std::transform(
             policy_,
-            document_to_word_freqs_.at(document_id).begin(), document_to_word_freqs_.at(document_id).end(),
+            terms_begin, terms_end,
             to_delete.begin(),
-            [](const std::pair<const std::string, double>& doc) {
-                return &doc.first;
+            [](const DocumentTerm& doc) {
+                return doc.term;
             }
         );
+        // every term owns its own posting map, so the erasures never touch the same container
         for_each(
             policy_,
             to_delete.begin(), to_delete.end(),
-            [&freqs = word_to_document_freqs_, document_id](const std::string* doc) {
-                freqs.at(*doc).erase(document_id);
+            [this, ordinal](const TermId term) {
+                ErasePosting(term, ordinal);
             }
         );
+        EraseDocumentColumns(ordinal);
+    }
+}
+
+template <typename Policy>
+void SearchServer::RemoveDocuments(Policy& policy, const std::vector<int>& document_ids) {
+    std::vector<int> ordinals;
+    ordinals.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        if (const int ordinal = FindOrdinal(document_id); ordinal >= 0) {
+            ordinals.push_back(ordinal);
+        }
+    }
+    std::sort(ordinals.begin(), ordinals.end());
+    ordinals.erase(std::unique(ordinals.begin(), ordinals.end()), ordinals.end());
+
+    // postings to erase grouped by term, each group handled by one task
+    std::vector<std::pair<TermId, int>> postings;
+    for (const int ordinal : ordinals) {
+        const auto [terms_begin, terms_end] = GetDocumentTerms(ordinal);
+        for (auto it = terms_begin; it != terms_end; ++it) {
+            postings.push_back({ it->term, ordinal });
+        }
+    }
+    std::sort(policy, postings.begin(), postings.end());
+    std::vector<std::pair<size_t, size_t>> groups;
+    for (size_t begin = 0, end = 0; begin < postings.size(); begin = end) {
+        while (end < postings.size() && postings[end].first == postings[begin].first) {
+            ++end;
+        }
+        groups.push_back({ begin, end });
     }
+    std::for_each(policy, groups.begin(), groups.end(), [this, &postings](const std::pair<size_t, size_t>& group) {
+        std::vector<int> group_ordinals;
+        group_ordinals.reserve(group.second - group.first);
+        for (size_t i = group.first; i < group.second; ++i) {
+            group_ordinals.push_back(postings[i].second);
+        }
+        ErasePostings(postings[group.first].first, group_ordinals);
+    });
 
-    documents_.erase(document_id);
-    document_to_word_freqs_.erase(document_id);
-    document_ids_.erase(document_id);
+    for (const int ordinal : ordinals) {
+        EraseDocumentColumns(ordinal);
+    }
 }
 
 template <typename Policy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate) const {
-    const auto query = ParseQueryTop(policy, raw_query);
+std::vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t max_result_count) const {
+    TRACE_SPAN(QUERY);
+    if constexpr (std::is_same_v<std::decay_t<Policy>, query_policy::DocumentAtATimePolicy>) {
+        const auto query = ParseQueryPar(std::execution::seq, raw_query);
+        if (IsWorthPruning(query)) {
+            return FindTopDocumentsAtATime(query, document_predicate, max_result_count);
+        }
+        const auto matched_documents = FindAllDocuments(std::execution::seq, query, document_predicate);
 
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+        TRACE_SPAN(TOP_K);
+        return SelectTopDocuments(matched_documents, max_result_count);
+    }
+    else {
+        const auto query = ParseQueryTop(policy, raw_query);
 
-    sort(policy, matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            return lhs.relevance > rhs.relevance
-                || (std::abs(lhs.relevance - rhs.relevance) < ACCURACY && lhs.rating > rhs.rating);
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+        const auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+
+        TRACE_SPAN(TOP_K);
+        return SelectTopDocuments(policy, matched_documents, max_result_count);
     }
-    return matched_documents;
 }
 
 template <typename Policy>
-std::vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentStatus status) const {
+std::vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentStatus status,
+    size_t max_result_count) const {
     return FindTopDocuments(
         policy,
         raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
             return document_status == status;
-        });
+        }, max_result_count);
 }
 
 template <typename Policy>
@@ -231,63 +752,209 @@ std::vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::
 template <typename Policy, typename DocumentPredicate>
 std::vector<Document> SearchServer::FindAllDocuments(Policy& policy, const ParQuery& query, DocumentPredicate document_predicate) const {
 
-    ConcurrentMap<int, double> document_to_relevance(10); 
+    ConcurrentScoreAccumulator document_to_relevance(document_ids_.size());
 
+    {
+        TRACE_SPAN(MINUS_FILTER);
+        // minus-words go first so their documents are never scored
+        std::for_each(
+            policy,
+            query.minus_words.begin(), query.minus_words.end(),
+            [this, &document_to_relevance](const std::string_view word) {
+                if (const auto* word_documents = FindWordDocuments(word)) {
+                    for (auto cursor = word_documents->GetCursor(); !cursor.AtEnd(); cursor.Next()) {
+                        document_to_relevance.Exclude(cursor.GetDocumentId());
+                    }
+                }
+            }
+        );
+    }
+    {
+        TRACE_SPAN(POSTING_SCAN);
         std::for_each(
             policy,
             query.plus_words.begin(), query.plus_words.end(),
-            [this, &document_to_relevance, &document_predicate, &policy](const std::string_view word) {
-                if (word_to_document_freqs_.count(word)) {
-                    const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                    std::for_each(
-                        policy,
-                        word_to_document_freqs_.at(word).begin(), word_to_document_freqs_.at(word).end(),
-                        [this, &document_to_relevance, &document_predicate, &inverse_document_freq](const auto& pair_) {
-                            const auto& document_data = documents_.at(pair_.first);
-                            if (document_predicate(pair_.first, document_data.status, document_data.rating)) {
-                                document_to_relevance[pair_.first].ref_to_value += pair_.second * inverse_document_freq;
-                            }
+            [this, &document_to_relevance, &document_predicate](const std::string_view word) {
+                if (const auto* word_documents = FindWordDocuments(word)) {
+                    const double inverse_document_freq = ComputeWordInverseDocumentFreq(*word_documents);
+                    for (auto cursor = word_documents->GetCursor(); !cursor.AtEnd(); cursor.Next()) {
+                        const int ordinal = cursor.GetDocumentId();
+                        if (!document_to_relevance.IsExcluded(ordinal)
+                            && document_predicate(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal])) {
+                            const double term_freq = cursor.GetCount() * document_inv_word_counts_[ordinal];
+                            document_to_relevance.Add(ordinal, term_freq * inverse_document_freq);
                         }
-                    );
+                    }
                 }
             }
-        );  
+        );
+    }
 
-    std::for_each(
-        policy,
-        query.minus_words.begin(), query.minus_words.end(),
-        [this, &document_to_relevance, &policy](const std::string_view word) {
-            if (word_to_document_freqs_.count(word)) {
-                std::for_each(
-                    policy,
-                    word_to_document_freqs_.at(word).begin(), word_to_document_freqs_.at(word).end(),
-                    [&document_to_relevance](const auto& pair_) {
-                        document_to_relevance.erase(pair_.first);
-                    }
-                );
-            }
+    TRACE_SPAN(COLLECT);
+    std::vector<Document> matched_documents;
+    document_to_relevance.ForEachScored(
+        [this, &matched_documents](size_t ordinal, double relevance) {
+            matched_documents.push_back({ document_ids_[ordinal], relevance, document_ratings_[ordinal] });
         }
     );
+    return matched_documents;
+}
+
+// MaxScore: terms are ordered by their score upper bound. Terms whose bounds together
+// cannot reach the current top-K threshold are non-essential: they only score candidates
+// found through the essential terms and are skipped as soon as the candidate cannot win.
+// Block-max bounds refine this: a range of documents covered by the current blocks of the
+// essential cursors is skipped whole when those blocks cannot reach the threshold, and a
+// candidate is dropped before decoding non-essential blocks whose bounds are too low.
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsAtATime(const ParQuery& query, DocumentPredicate document_predicate,
+    size_t max_result_count) const {
+    // terms are scanned, pruned and ranked together, so the whole search is one span
+    TRACE_SPAN(POSTING_SCAN);
+    struct ScoredTerm {
+        PostingList::Cursor cursor;
+        double inverse_document_freq;
+        double max_score;
+    };
 
-    auto result = document_to_relevance.BuildOrdinaryMap();
-    std::vector<Document> matched_documents(result.size());
+    std::vector<ScoredTerm> terms;
+    for (const std::string_view word : query.plus_words) {
+        if (const auto* word_documents = FindWordDocuments(word)) {
+            const double inverse_document_freq = ComputeWordInverseDocumentFreq(*word_documents);
+            terms.push_back({ word_documents->GetCursor(), inverse_document_freq,
+                word_documents->GetMaxTermFreq() * inverse_document_freq });
+        }
+    }
+    std::vector<PostingList::Cursor> minus_cursors;
+    for (const std::string_view word : query.minus_words) {
+        if (const auto* word_documents = FindWordDocuments(word)) {
+            minus_cursors.push_back(word_documents->GetCursor());
+        }
+    }
 
-    std::atomic_int num = 0;
-    std::for_each(
-        policy,
-        result.begin(), result.end(),
-        [this, &matched_documents, &num](const auto& pair_) {
-            matched_documents[num++] = Document{ pair_.first, pair_.second, documents_.at(pair_.first).rating };
+    std::sort(terms.begin(), terms.end(), [](const ScoredTerm& lhs, const ScoredTerm& rhs) {
+        return lhs.max_score < rhs.max_score;
+    });
+    // bounds[i] is the best score a document can get from terms [0, i]
+    std::vector<double> bounds(terms.size());
+    std::transform_inclusive_scan(terms.begin(), terms.end(), bounds.begin(), std::plus<>{},
+        [](const ScoredTerm& term) {
+            return term.max_score;
+        });
+
+    TopDocuments top_documents(max_result_count);
+    // a document scoring below the threshold cannot displace the worst kept one, even by rating
+    const auto get_threshold = [&top_documents]() {
+        return top_documents.IsFull() ? top_documents.GetWorst().relevance - ACCURACY : -1.0;
+    };
+    // essential cursors that are not exhausted, as a min-heap by current document
+    std::vector<size_t> essential;
+    const auto later_document = [&terms](size_t lhs, size_t rhs) {
+        return terms[lhs].cursor.GetDocumentId() > terms[rhs].cursor.GetDocumentId();
+    };
+    const auto rebuild_essential = [&](size_t first) {
+        essential.clear();
+        for (size_t i = first; i < terms.size(); ++i) {
+            if (!terms[i].cursor.AtEnd()) {
+                essential.push_back(i);
+            }
+        }
+        std::make_heap(essential.begin(), essential.end(), later_document);
+    };
+    size_t first_essential = 0;
+    rebuild_essential(first_essential);
+    // documents up to this ordinal already passed the block range check
+    int checked_until = -1;
+    while (max_result_count > 0 && !essential.empty()) {
+        const double threshold = get_threshold();
+        if (first_essential < terms.size() && bounds[first_essential] < threshold) {
+            while (first_essential < terms.size() && bounds[first_essential] < threshold) {
+                ++first_essential;
+            }
+            rebuild_essential(first_essential);
+            if (essential.empty()) {
+                break;
+            }
         }
-    );
 
-    return matched_documents;
+        const int ordinal = terms[essential.front()].cursor.GetDocumentId();
+        if (top_documents.IsFull() && ordinal > checked_until) {
+            double range_bound = first_essential > 0 ? bounds[first_essential - 1] : 0.0;
+            int range_end = std::numeric_limits<int>::max();
+            for (const size_t i : essential) {
+                range_bound += terms[i].cursor.GetBlockMaxTermFreq() * terms[i].inverse_document_freq;
+                range_end = std::min(range_end, terms[i].cursor.GetBlockLastDocumentId());
+            }
+            if (range_bound < threshold && range_end < std::numeric_limits<int>::max()) {
+                for (const size_t i : essential) {
+                    terms[i].cursor.Advance(range_end + 1);
+                }
+                rebuild_essential(first_essential);
+                continue;
+            }
+            checked_until = range_end;
+        }
+
+        const bool accepted = document_predicate(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal]);
+        double relevance = 0.0;
+        while (!essential.empty() && terms[essential.front()].cursor.GetDocumentId() == ordinal) {
+            std::pop_heap(essential.begin(), essential.end(), later_document);
+            auto& term = terms[essential.back()];
+            relevance += term.cursor.GetCount() * document_inv_word_counts_[ordinal] * term.inverse_document_freq;
+            term.cursor.Next();
+            if (term.cursor.AtEnd()) {
+                essential.pop_back();
+            }
+            else {
+                std::push_heap(essential.begin(), essential.end(), later_document);
+            }
+        }
+        if (!accepted) {
+            continue;
+        }
+
+        double block_bound = relevance;
+        for (size_t i = 0; i < first_essential; ++i) {
+            block_bound += terms[i].cursor.PeekBlockMaxTermFreq(ordinal) * terms[i].inverse_document_freq;
+        }
+        if (block_bound < threshold) {
+            continue;
+        }
+
+        bool pruned = false;
+        for (size_t i = first_essential; i-- > 0;) {
+            if (relevance + bounds[i] < threshold) {
+                pruned = true;
+                break;
+            }
+            auto& cursor = terms[i].cursor;
+            cursor.Advance(ordinal);
+            if (!cursor.AtEnd() && cursor.GetDocumentId() == ordinal) {
+                relevance += cursor.GetCount() * document_inv_word_counts_[ordinal] * terms[i].inverse_document_freq;
+            }
+        }
+        if (pruned || relevance < threshold) {
+            continue;
+        }
+
+        const bool excluded = std::any_of(minus_cursors.begin(), minus_cursors.end(),
+            [ordinal](PostingList::Cursor& cursor) {
+                cursor.Advance(ordinal);
+                return !cursor.AtEnd() && cursor.GetDocumentId() == ordinal;
+            });
+        if (!excluded) {
+            top_documents.Add({ document_ids_[ordinal], relevance, document_ratings_[ordinal] });
+        }
+    }
+    return top_documents.Extract();
 }
 
 template<typename Policy>
 SearchServer::ParQuery SearchServer::ParseQueryTop(Policy& policy, std::string_view text) const {
+    TRACE_SPAN(PARSE);
     ParQuery result;
-    std::vector<std::string_view> words = SplitIntoWords(text);
+    std::vector<std::string_view> words;
+    SplitQueryIntoWords(text, words);
 
     std::sort(policy, words.begin(), words.end());
     auto iter_words = unique(words.begin(), words.end());
@@ -0,0 +1,255 @@
+#include "segmented_search_server.h"
+
+#include <algorithm>
+
+using namespace std;
+
+SegmentedSearchServer::SegmentedSearchServer(const string& stop_words_text)
+    : SegmentedSearchServer(stop_words_text, Options{}) {
+}
+
+SegmentedSearchServer::SegmentedSearchServer(const string& stop_words_text, const Options& options)
+    : options_({ max<size_t>(1, options.seal_threshold), max<size_t>(2, options.merge_factor),
+        max<size_t>(1, options.refresh_threshold) })
+    , empty_segment_(stop_words_text) {
+    pending_.active = make_shared<const SearchServer>(empty_segment_);
+    pending_.removed_word_freqs = make_shared<const WordCounts>();
+    active_ = make_shared<SearchServer>(empty_segment_);
+    state_ = make_shared<const State>(pending_);
+    merge_thread_ = thread(&SegmentedSearchServer::MergeLoop, this);
+}
+
+SegmentedSearchServer::~SegmentedSearchServer() {
+    {
+        lock_guard guard(merge_mutex_);
+        stopping_ = true;
+    }
+    merge_cv_.notify_all();
+    merge_thread_.join();
+}
+
+void SegmentedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status,
+    const vector<int>& ratings) {
+    lock_guard guard(writer_mutex_);
+    AddToActive(document_id, document, status, ratings);
+}
+
+void SegmentedSearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    lock_guard guard(writer_mutex_);
+    for (const NewDocument& document : documents) {
+        AddToActive(document.id, document.text, document.status, document.ratings);
+    }
+    Publish();
+}
+
+void SegmentedSearchServer::RemoveDocument(int document_id) {
+    lock_guard guard(writer_mutex_);
+    if (active_->ContainsDocument(document_id)) {
+        active_->RemoveDocument(document_id);
+        active_changed_ = true;
+    }
+    else {
+        const auto segment = find_if(pending_.segments.begin(), pending_.segments.end(), [document_id](const Segment& segment) {
+            return segment.index->ContainsDocument(document_id) && segment.removed->count(document_id) == 0;
+        });
+        if (segment == pending_.segments.end()) {
+            return;
+        }
+        GetRemoved(*segment).insert(document_id);
+        WordCounts& removed_word_freqs = GetRemovedWordFreqs();
+        for (const auto& [word, freq] : segment->index->GetWordFrequencies(document_id)) {
+            ++removed_word_freqs[string(word)];
+        }
+    }
+    --pending_.document_count;
+    CountChange();
+}
+
+void SegmentedSearchServer::Refresh() {
+    lock_guard guard(writer_mutex_);
+    Publish();
+}
+
+vector<Document> SegmentedSearchServer::FindTopDocuments(QueryContext& context, string_view raw_query,
+    DocumentStatus status, size_t max_result_count) const {
+    return FindTopDocuments(context, raw_query, [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    }, max_result_count);
+}
+
+vector<Document> SegmentedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
+    QueryContext context;
+    return FindTopDocuments(context, raw_query, status);
+}
+
+int SegmentedSearchServer::GetDocumentCount() const {
+    return GetState()->document_count;
+}
+
+size_t SegmentedSearchServer::GetSegmentCount() const {
+    return GetState()->segments.size();
+}
+
+void SegmentedSearchServer::WaitForMerges() const {
+    unique_lock lock(merge_mutex_);
+    merge_cv_.wait(lock, [this] {
+        return !merging_ && FindMerge(*GetState()).empty();
+    });
+}
+
+shared_ptr<const SegmentedSearchServer::State> SegmentedSearchServer::GetState() const {
+    return atomic_load(&state_);
+}
+
+void SegmentedSearchServer::AddToActive(int document_id, string_view document, DocumentStatus status,
+    const vector<int>& ratings) {
+    for (const Segment& segment : pending_.segments) {
+        if (segment.index->ContainsDocument(document_id) && segment.removed->count(document_id) == 0) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+    }
+    active_->AddDocument(document_id, document, status, ratings);
+    active_changed_ = true;
+    ++pending_.document_count;
+    if (static_cast<size_t>(active_->GetDocumentCount()) < options_.seal_threshold) {
+        CountChange();
+        return;
+    }
+    // nobody changes the sealed segment again, so it is published without a copy
+    pending_.segments.push_back({ move(active_), make_shared<const unordered_set<int>>() });
+    active_ = make_shared<SearchServer>(empty_segment_);
+    pending_.active = make_shared<const SearchServer>(empty_segment_);
+    active_changed_ = false;
+    Publish();
+    {
+        // the merge thread either sees the new segment or is already waiting
+        lock_guard merge_guard(merge_mutex_);
+    }
+    merge_cv_.notify_all();
+}
+
+void SegmentedSearchServer::CountChange() {
+    if (++buffered_change_count_ >= options_.refresh_threshold) {
+        Publish();
+    }
+}
+
+// Readers keep the published copy of the active segment, so the writer's next change
+// to active_ copies its columns again: one copy of the active segment per publication
+void SegmentedSearchServer::Publish() {
+    if (active_changed_) {
+        pending_.active = make_shared<const SearchServer>(*active_);
+        active_changed_ = false;
+    }
+    buffered_change_count_ = 0;
+    owned_removed_.clear();
+    owned_removed_word_freqs_.reset();
+    atomic_store(&state_, shared_ptr<const State>(make_shared<const State>(pending_)));
+}
+
+unordered_set<int>& SegmentedSearchServer::GetRemoved(Segment& segment) {
+    for (const auto& removed : owned_removed_) {
+        if (removed == segment.removed) {
+            return *removed;
+        }
+    }
+    auto removed = make_shared<unordered_set<int>>(*segment.removed);
+    segment.removed = removed;
+    owned_removed_.push_back(removed);
+    return *removed;
+}
+
+SegmentedSearchServer::WordCounts& SegmentedSearchServer::GetRemovedWordFreqs() {
+    if (!owned_removed_word_freqs_) {
+        owned_removed_word_freqs_ = make_shared<WordCounts>(*pending_.removed_word_freqs);
+        pending_.removed_word_freqs = owned_removed_word_freqs_;
+    }
+    return *owned_removed_word_freqs_;
+}
+
+vector<size_t> SegmentedSearchServer::FindMerge(const State& state) const {
+    // segments of the lowest tier that has enough of them
+    map<size_t, vector<size_t>> tiers;
+    for (size_t i = 0; i < state.segments.size(); ++i) {
+        size_t tier = 0;
+        for (size_t bound = options_.seal_threshold * options_.merge_factor;
+            static_cast<size_t>(state.segments[i].index->GetDocumentCount()) >= bound; bound *= options_.merge_factor) {
+            ++tier;
+        }
+        tiers[tier].push_back(i);
+    }
+    for (auto& [tier, segments] : tiers) {
+        if (segments.size() >= options_.merge_factor) {
+            segments.resize(options_.merge_factor);
+            return segments;
+        }
+    }
+    return {};
+}
+
+void SegmentedSearchServer::MergeLoop() {
+    while (true) {
+        vector<Segment> inputs;
+        {
+            unique_lock lock(merge_mutex_);
+            merge_cv_.wait(lock, [this, &inputs] {
+                if (stopping_) {
+                    return true;
+                }
+                const auto state = GetState();
+                for (const size_t i : FindMerge(*state)) {
+                    inputs.push_back(state->segments[i]);
+                }
+                return !inputs.empty();
+            });
+            if (stopping_) {
+                return;
+            }
+            merging_ = true;
+        }
+        Merge(inputs);
+        {
+            lock_guard guard(merge_mutex_);
+            merging_ = false;
+        }
+        merge_cv_.notify_all();
+    }
+}
+
+// Builds the merged segment without blocking writers, then swaps it in. Documents
+// removed while the merge ran stay tombstoned in the merged segment
+void SegmentedSearchServer::Merge(const vector<Segment>& inputs) {
+    auto merged = make_shared<SearchServer>(empty_segment_);
+    for (const Segment& input : inputs) {
+        merged->AddDocumentsFrom(*input.index, [&removed = *input.removed](int document_id) {
+            return removed.count(document_id) == 0;
+        });
+    }
+
+    lock_guard guard(writer_mutex_);
+    auto removed = make_shared<unordered_set<int>>();
+    WordCounts& removed_word_freqs = GetRemovedWordFreqs();
+    for (const Segment& input : inputs) {
+        const auto current = find_if(pending_.segments.begin(), pending_.segments.end(), [&input](const Segment& segment) {
+            return segment.index == input.index;
+        });
+        for (const int document_id : *current->removed) {
+            if (input.removed->count(document_id) > 0) {
+                // the merge dropped the document, so its words stop counting as removed
+                for (const auto& [word, freq] : input.index->GetWordFrequencies(document_id)) {
+                    const auto it = removed_word_freqs.find(word);
+                    if (--it->second == 0) {
+                        removed_word_freqs.erase(it);
+                    }
+                }
+            }
+            else {
+                removed->insert(document_id);
+            }
+        }
+        pending_.segments.erase(current);
+    }
+    pending_.segments.push_back({ move(merged), move(removed) });
+    // publishes the changes buffered so far too
+    Publish();
+}
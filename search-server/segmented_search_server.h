@@ -0,0 +1,166 @@
+#pragma once
+
+#include "document.h"
+#include "query_context.h"
+#include "search_server.h"
+#include "top_documents.h"
+
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Index split into segments, each a SearchServer of its own. New documents go into a
+// small active segment, which is sealed once it reaches the seal threshold. A background
+// thread merges sealed segments of the same size tier into larger ones. Removing a document
+// of a sealed segment only tombstones it; the next merge of that segment drops it.
+// Queries run on every segment with inverse document frequencies counted over the whole
+// index, so relevance is the same as in a single SearchServer with the same documents.
+// Readers work on immutable states published like in VersionedSearchServer and never
+// wait for writers or merges. The writer changes its own active segment in place and
+// publishes a copy of it only when it seals, at the end of a batch, once the refresh
+// threshold of buffered changes is reached and on Refresh(), so a write costs
+// O(document) plus one copy of the active segment per publication.
+class SegmentedSearchServer {
+public:
+    struct Options {
+        // documents in the active segment that make it sealed
+        size_t seal_threshold = 1024;
+        // segments of one tier merged at once; a tier holds segments of
+        // [seal_threshold * merge_factor^k, seal_threshold * merge_factor^(k+1)) documents
+        size_t merge_factor = 4;
+        // buffered changes that are published without waiting for a seal or a batch end
+        size_t refresh_threshold = 64;
+    };
+
+    explicit SegmentedSearchServer(const std::string& stop_words_text);
+    SegmentedSearchServer(const std::string& stop_words_text, const Options& options);
+    // Waits for the running merge, if any
+    ~SegmentedSearchServer();
+
+    SegmentedSearchServer(const SegmentedSearchServer&) = delete;
+    SegmentedSearchServer& operator=(const SegmentedSearchServer&) = delete;
+
+    // Changes are buffered: readers see them after the next publication
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Published together when the call returns. If a document is rejected, the ones
+    // before it stay added and the exception propagates
+    void AddDocuments(const std::vector<NewDocument>& documents);
+    void RemoveDocument(int document_id);
+    // Publishes the buffered changes
+    void Refresh();
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(QueryContext& context, std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(QueryContext& context, std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL, size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    int GetDocumentCount() const;
+    // Sealed segments, not counting the active one
+    size_t GetSegmentCount() const;
+    // Blocks until no merge is running or due
+    void WaitForMerges() const;
+
+private:
+    struct Segment {
+        std::shared_ptr<const SearchServer> index;
+        // documents removed since the segment was sealed
+        std::shared_ptr<const std::unordered_set<int>> removed;
+    };
+
+    using WordCounts = std::map<std::string, int, std::less<>>;
+
+    struct State {
+        std::vector<Segment> segments;
+        std::shared_ptr<const SearchServer> active;
+        // for every word, removed documents of sealed segments that still contain it
+        std::shared_ptr<const WordCounts> removed_word_freqs;
+        int document_count = 0;
+    };
+
+    std::shared_ptr<const State> GetState() const;
+    // Called with writer_mutex_ held
+    void AddToActive(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void CountChange();
+    void Publish();
+    // Tombstones of the segment and the removed word counts, copied once per publication
+    std::unordered_set<int>& GetRemoved(Segment& segment);
+    WordCounts& GetRemovedWordFreqs();
+    // Returns the indexes of the segments to merge next, or nothing
+    std::vector<size_t> FindMerge(const State& state) const;
+    void MergeLoop();
+    void Merge(const std::vector<Segment>& inputs);
+
+    const Options options_;
+    const SearchServer empty_segment_;
+
+    std::mutex writer_mutex_;
+    // read with std::atomic_load and replaced with std::atomic_store
+    std::shared_ptr<const State> state_;
+    // the writer's state: published as it is, except that active is replaced with a copy
+    // of active_ when it has changed
+    State pending_;
+    std::shared_ptr<SearchServer> active_;
+    bool active_changed_ = false;
+    size_t buffered_change_count_ = 0;
+    // copied since the last publication, so readers do not see them
+    std::vector<std::shared_ptr<std::unordered_set<int>>> owned_removed_;
+    std::shared_ptr<WordCounts> owned_removed_word_freqs_;
+
+    mutable std::mutex merge_mutex_;
+    mutable std::condition_variable merge_cv_;
+    bool merging_ = false;
+    bool stopping_ = false;
+    std::thread merge_thread_;
+};
+
+template <typename DocumentPredicate>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(QueryContext& context, std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t max_result_count) const {
+    const auto state = GetState();
+    // every segment asks for the same words, so each is counted over the index once
+    std::vector<std::pair<std::string_view, double>> idfs;
+    const auto idf = [&state, &idfs](std::string_view word) {
+        for (const auto& [known_word, known_idf] : idfs) {
+            if (known_word == word) {
+                return known_idf;
+            }
+        }
+        auto freq = static_cast<int64_t>(state->active->GetDocumentFrequency(word));
+        for (const Segment& segment : state->segments) {
+            freq += segment.index->GetDocumentFrequency(word);
+        }
+        if (const auto it = state->removed_word_freqs->find(word); it != state->removed_word_freqs->end()) {
+            freq -= it->second;
+        }
+        const double result = freq > 0 ? std::log(state->document_count * 1.0 / freq) : 0.0;
+        idfs.push_back({ word, result });
+        return result;
+    };
+
+    TopDocuments top_documents(max_result_count);
+    const auto add_segment = [&](const SearchServer& index, const std::unordered_set<int>* removed) {
+        const auto& found = index.FindTopDocuments(context, raw_query,
+            [&document_predicate, removed](int document_id, DocumentStatus status, int rating) {
+                return (removed == nullptr || removed->count(document_id) == 0)
+                    && document_predicate(document_id, status, rating);
+            }, max_result_count, idf);
+        for (const Document& document : found) {
+            top_documents.Add(document);
+        }
+    };
+    add_segment(*state->active, nullptr);
+    for (const Segment& segment : state->segments) {
+        add_segment(*segment.index, segment.removed.get());
+    }
+    return top_documents.Extract();
+}
@@ -0,0 +1,223 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SNAPSHOT_USE_MMAP
+#endif
+
+using namespace std;
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = { 'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P' };
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+const uint64_t FNV_PRIME = 1099511628211ull;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t section_table_offset;
+    uint64_t file_size;
+    uint64_t checksum;
+};
+
+uint64_t UpdateChecksum(uint64_t checksum, const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        checksum = (checksum ^ static_cast<unsigned char>(data[i])) * FNV_PRIME;
+    }
+    return checksum;
+}
+
+uint64_t RotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+} // namespace
+
+uint64_t HashBytes(const void* data, size_t size) {
+    return UpdateChecksum(FNV_OFFSET_BASIS, static_cast<const char*>(data), size);
+}
+
+SnapshotChecksum::SnapshotChecksum() {
+    for (size_t lane = 0; lane < LANE_COUNT; ++lane) {
+        lanes_[lane] = FNV_OFFSET_BASIS + lane;
+    }
+}
+
+void SnapshotChecksum::Update(const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    total_size_ += size;
+    if (pending_size_ > 0) {
+        const size_t taken = min(size, STRIPE_SIZE - pending_size_);
+        memcpy(pending_ + pending_size_, bytes, taken);
+        pending_size_ += taken;
+        bytes += taken;
+        size -= taken;
+        if (pending_size_ < STRIPE_SIZE) {
+            return;
+        }
+        HashStripe(pending_);
+        pending_size_ = 0;
+    }
+    for (; size >= STRIPE_SIZE; bytes += STRIPE_SIZE, size -= STRIPE_SIZE) {
+        HashStripe(bytes);
+    }
+    memcpy(pending_, bytes, size);
+    pending_size_ = size;
+}
+
+// Every step is a bijection of the lane for a fixed word and of the word for a fixed lane,
+// so a change of any single word always changes the result
+uint64_t SnapshotChecksum::Finish() const {
+    uint64_t checksum = UpdateChecksum(FNV_OFFSET_BASIS, pending_, pending_size_);
+    for (const uint64_t lane : lanes_) {
+        checksum = (checksum ^ lane) * FNV_PRIME;
+    }
+    return (checksum ^ total_size_) * FNV_PRIME;
+}
+
+void SnapshotChecksum::HashStripe(const char* stripe) {
+    for (size_t lane = 0; lane < LANE_COUNT; ++lane) {
+        uint64_t word;
+        memcpy(&word, stripe + lane * sizeof(word), sizeof(word));
+        lanes_[lane] = RotateLeft((lanes_[lane] ^ word) * FNV_PRIME, 31);
+    }
+}
+
+SnapshotWriter::SnapshotWriter(const string& path)
+    : out_(path, ios::binary | ios::trunc) {
+    if (!out_) {
+        throw SnapshotError("Cannot create snapshot file "s + path);
+    }
+    const SnapshotHeader placeholder{};
+    out_.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+    position_ = sizeof(placeholder);
+}
+
+void SnapshotWriter::BeginSection() {
+    sections_.push_back({ position_, 0 });
+}
+
+void SnapshotWriter::EndSection() {
+    sections_.back().second = position_ - sections_.back().first;
+    static const char padding[8] = {};
+    WriteBytes(padding, (8 - position_ % 8) % 8);
+}
+
+void SnapshotWriter::WriteBytes(const void* data, size_t size) {
+    out_.write(static_cast<const char*>(data), size);
+    checksum_.Update(data, size);
+    position_ += size;
+}
+
+void SnapshotWriter::Finish() {
+    SnapshotHeader header{};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.section_count = static_cast<uint32_t>(sections_.size());
+    header.section_table_offset = position_;
+    for (const auto& [offset, size] : sections_) {
+        Write(offset);
+        Write(size);
+    }
+    header.file_size = position_;
+    header.checksum = checksum_.Finish();
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.flush();
+    if (!out_) {
+        throw SnapshotError("Failed to write snapshot"s);
+    }
+}
+
+shared_ptr<const MappedSnapshot> MappedSnapshot::Open(const string& path) {
+    shared_ptr<MappedSnapshot> snapshot(new MappedSnapshot());
+#ifdef SNAPSHOT_USE_MMAP
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw SnapshotError("Cannot open snapshot file "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(sizeof(SnapshotHeader))) {
+        close(fd);
+        throw SnapshotError("Snapshot file "s + path + " is truncated"s);
+    }
+    void* mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw SnapshotError("Cannot map snapshot file "s + path);
+    }
+    snapshot->data_ = static_cast<const char*>(mapping);
+    snapshot->size_ = file_stat.st_size;
+#else
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in) {
+        throw SnapshotError("Cannot open snapshot file "s + path);
+    }
+    snapshot->buffer_.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    in.read(snapshot->buffer_.data(), snapshot->buffer_.size());
+    snapshot->data_ = snapshot->buffer_.data();
+    snapshot->size_ = snapshot->buffer_.size();
+    if (snapshot->size_ < sizeof(SnapshotHeader)) {
+        throw SnapshotError("Snapshot file "s + path + " is truncated"s);
+    }
+#endif
+
+    SnapshotHeader header;
+    memcpy(&header, snapshot->data_, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        throw SnapshotError(path + " is not a search server snapshot"s);
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        throw SnapshotError("Unsupported snapshot version "s + to_string(header.version));
+    }
+    // compared without adding, so that huge values cannot wrap around
+    if (header.file_size != snapshot->size_ || header.section_table_offset < sizeof(header)
+        || header.section_table_offset > header.file_size || header.section_table_offset % 8 != 0
+        || (header.file_size - header.section_table_offset) / (2 * sizeof(uint64_t)) != header.section_count
+        || (header.file_size - header.section_table_offset) % (2 * sizeof(uint64_t)) != 0) {
+        throw SnapshotError("Snapshot file "s + path + " is truncated"s);
+    }
+    SnapshotChecksum checksum;
+    checksum.Update(snapshot->data_ + sizeof(header), snapshot->size_ - sizeof(header));
+    if (checksum.Finish() != header.checksum) {
+        throw SnapshotError("Snapshot checksum mismatch in "s + path);
+    }
+    snapshot->section_table_ = reinterpret_cast<const uint64_t*>(snapshot->data_ + header.section_table_offset);
+    snapshot->section_count_ = header.section_count;
+    return snapshot;
+}
+
+MappedSnapshot::~MappedSnapshot() {
+#ifdef SNAPSHOT_USE_MMAP
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
+
+size_t MappedSnapshot::GetSectionCount() const {
+    return section_count_;
+}
+
+pair<const char*, size_t> MappedSnapshot::GetSectionBytes(size_t index) const {
+    if (index >= section_count_) {
+        throw SnapshotError("Snapshot has no section "s + to_string(index));
+    }
+    const uint64_t offset = section_table_[index * 2];
+    const uint64_t size = section_table_[index * 2 + 1];
+    // sections lie between the header and the section table
+    const uint64_t table_offset = reinterpret_cast<const char*>(section_table_) - data_;
+    if (offset < sizeof(SnapshotHeader) || offset > table_offset || size > table_offset - offset || offset % 8 != 0) {
+        throw SnapshotError("Snapshot section is out of the file"s);
+    }
+    return { data_ + offset, size };
+}
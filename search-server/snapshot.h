@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Binary snapshot file: a header, a sequence of 8-byte aligned sections and a table
+// of section offsets at the end. Values are written in the native byte order, the
+// header checksum covers everything after the header.
+const uint32_t SNAPSHOT_VERSION = 3;
+
+// FNV-1a hash, stable across processes and builds
+uint64_t HashBytes(const void* data, size_t size);
+
+// How much of a snapshot is checked when it is loaded. The header, the section table,
+// the block tables of the posting lists, term ids, ordinals and the checksum are always
+// checked; that is enough for a file damaged on disk or in transit
+enum class SnapshotCheck {
+    CHECKSUM,
+    // also decodes every posting, for a file that may have been crafted to pass the
+    // checksum. Costs a pass over all postings
+    FULL,
+};
+
+// A file that cannot be opened, has another version or is damaged
+class SnapshotError : public std::invalid_argument {
+public:
+    using std::invalid_argument::invalid_argument;
+};
+
+// Checksum of the bytes after the snapshot header, fed in pieces of any size. Hashes
+// 8-byte words in independent lanes, so checking a file runs at memory speed
+class SnapshotChecksum {
+public:
+    SnapshotChecksum();
+
+    void Update(const void* data, size_t size);
+    uint64_t Finish() const;
+
+private:
+    static constexpr size_t LANE_COUNT = 4;
+    static constexpr size_t STRIPE_SIZE = LANE_COUNT * sizeof(uint64_t);
+
+    void HashStripe(const char* stripe);
+
+    uint64_t lanes_[LANE_COUNT];
+    // bytes of a stripe that is not complete yet
+    char pending_[STRIPE_SIZE];
+    size_t pending_size_ = 0;
+    uint64_t total_size_ = 0;
+};
+
+// Streams sections to a file
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+
+    void BeginSection();
+    void EndSection();
+
+    void WriteBytes(const void* data, size_t size);
+
+    template <typename T>
+    void Write(const T* data, size_t count) {
+        WriteBytes(data, count * sizeof(T));
+    }
+
+    template <typename T>
+    void Write(const T& value) {
+        WriteBytes(&value, sizeof(T));
+    }
+
+    // Writes the section table and the header
+    void Finish();
+
+private:
+    std::ofstream out_;
+    uint64_t position_ = 0;
+    SnapshotChecksum checksum_;
+    std::vector<std::pair<uint64_t, uint64_t>> sections_;
+};
+
+// Read-only view of a snapshot file mapped into memory. Sections point straight
+// into the mapping, so the snapshot must outlive everything built on top of it.
+class MappedSnapshot {
+public:
+    // Checks the header, the section table and the checksum
+    static std::shared_ptr<const MappedSnapshot> Open(const std::string& path);
+
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+    ~MappedSnapshot();
+
+    size_t GetSectionCount() const;
+
+    // Sections are read in the order they were written; index is advanced past the section.
+    // The section is known to lie inside the file, its contents are not checked
+    template <typename T>
+    std::pair<const T*, size_t> GetSection(size_t& index) const {
+        const auto [data, size] = GetSectionBytes(index++);
+        if (size % sizeof(T) != 0) {
+            throw SnapshotError("Snapshot section has unexpected size");
+        }
+        return { reinterpret_cast<const T*>(data), size / sizeof(T) };
+    }
+
+private:
+    MappedSnapshot() = default;
+
+    std::pair<const char*, size_t> GetSectionBytes(size_t index) const;
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    // fallback storage on platforms without mmap
+    std::vector<char> buffer_;
+    const uint64_t* section_table_ = nullptr;
+    size_t section_count_ = 0;
+};
@@ -0,0 +1,65 @@
+#include "stop_words.h"
+
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+namespace {
+
+uint64_t LengthBit(size_t length) {
+    return uint64_t{ 1 } << min<size_t>(length, 63);
+}
+
+} // namespace
+
+StopWords::StopWords(const set<string>& words)
+    : words_(words.begin(), words.end()) {
+    if (words_.empty()) {
+        return;
+    }
+    size_t slot_count = 1;
+    while (slot_count < words_.size() * 2) {
+        slot_count *= 2;
+    }
+    slots_.assign(slot_count, 0);
+    for (size_t index = 0; index < words_.size(); ++index) {
+        size_t slot = hash<string_view>{}(words_[index]) & (slot_count - 1);
+        while (slots_[slot] != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots_[slot] = static_cast<uint32_t>(index + 1);
+        length_mask_ |= LengthBit(words_[index].size());
+    }
+}
+
+bool StopWords::Contains(string_view word) const {
+    if ((length_mask_ & LengthBit(word.size())) == 0) {
+        return false;
+    }
+    for (size_t slot = hash<string_view>{}(word) & (slots_.size() - 1);; slot = (slot + 1) & (slots_.size() - 1)) {
+        const uint32_t entry = slots_[slot];
+        if (entry == 0) {
+            return false;
+        }
+        if (words_[entry - 1] == word) {
+            return true;
+        }
+    }
+}
+
+size_t StopWords::size() const {
+    return words_.size();
+}
+
+bool StopWords::empty() const {
+    return words_.empty();
+}
+
+vector<string>::const_iterator StopWords::begin() const {
+    return words_.begin();
+}
+
+vector<string>::const_iterator StopWords::end() const {
+    return words_.end();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Immutable set of stop words queried by string_view without allocating.
+// Words are kept sorted for iteration and indexed by an open addressing table
+// built at construction; a mask of present word lengths rejects most misses
+// before the word is hashed.
+class StopWords {
+public:
+    StopWords() = default;
+    explicit StopWords(const std::set<std::string>& words);
+
+    bool Contains(std::string_view word) const;
+
+    size_t size() const;
+    bool empty() const;
+    std::vector<std::string>::const_iterator begin() const;
+    std::vector<std::string>::const_iterator end() const;
+
+private:
+    std::vector<std::string> words_;
+    // hold index + 1, 0 marks an empty slot
+    std::vector<uint32_t> slots_;
+    // bit i is set if there is a word of length i; bit 63 covers all longer words
+    uint64_t length_mask_ = 0;
+};
@@ -1,22 +1,126 @@
 #include "string_processing.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define STRING_PROCESSING_SSE2
+#endif
+
 using namespace std;
 
-vector<string_view> SplitIntoWords(string_view text) {
+namespace {
 
+const size_t BLOCK_SIZE = 64;
+
+size_t CountTrailingZeros(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#else
+    size_t count = 0;
+    for (; (bits & 1) == 0; bits >>= 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+// Sets bit i of spaces for every ' ' and bit i of controls for every byte 0x00-0x1F in block[0..64)
+void ClassifyBlock(const char* block, uint64_t& spaces, uint64_t& controls) {
+#if defined(__AVX2__)
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i last_control = _mm256_set1_epi8(0x1F);
+    spaces = 0;
+    controls = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; i += 32) {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+        const __m256i is_space = _mm256_cmpeq_epi8(bytes, space);
+        // unsigned byte <= 0x1F exactly when min(byte, 0x1F) == byte
+        const __m256i is_control = _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, last_control), bytes);
+        spaces |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(is_space))) << i;
+        controls |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(is_control))) << i;
+    }
+#elif defined(STRING_PROCESSING_SSE2)
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i last_control = _mm_set1_epi8(0x1F);
+    spaces = 0;
+    controls = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+        const __m128i is_space = _mm_cmpeq_epi8(bytes, space);
+        const __m128i is_control = _mm_cmpeq_epi8(_mm_min_epu8(bytes, last_control), bytes);
+        spaces |= static_cast<uint64_t>(_mm_movemask_epi8(is_space)) << i;
+        controls |= static_cast<uint64_t>(_mm_movemask_epi8(is_control)) << i;
+    }
+#else
+    spaces = 0;
+    controls = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        const auto byte = static_cast<unsigned char>(block[i]);
+        spaces |= static_cast<uint64_t>(byte == ' ') << i;
+        controls |= static_cast<uint64_t>(byte < ' ') << i;
+    }
+#endif
+}
+
+} // namespace
+
+vector<string_view> SplitIntoWords(string_view text) {
     vector<string_view> result;
-    text.remove_prefix(min(text.find_first_not_of(" "), text.size()));
-    while (!text.empty()) {
-        size_t pos = text.find(" ");
-        result.push_back(text.substr(0, pos));
+    SplitIntoWords(text, result);
+    return result;
+}
 
-        if (pos == text.npos) {
-            text.remove_prefix(text.size());
+size_t SplitIntoWords(string_view text, vector<string_view>& words) {
+    words.clear();
+    size_t first_control = text.size();
+    // set while the previous byte belongs to a word
+    uint64_t in_word = 0;
+    size_t word_begin = 0;
+    char tail[BLOCK_SIZE];
+    for (size_t base = 0; base < text.size(); base += BLOCK_SIZE) {
+        const char* block = text.data() + base;
+        const size_t block_size = min(BLOCK_SIZE, text.size() - base);
+        if (block_size < BLOCK_SIZE) {
+            // the last block is padded with spaces, which close the last word
+            memset(tail, ' ', BLOCK_SIZE);
+            memcpy(tail, block, block_size);
+            block = tail;
         }
-        else {
-            text.remove_prefix(pos);
-            text.remove_prefix(min(text.find_first_not_of(" "), text.size()));
+        uint64_t spaces;
+        uint64_t controls;
+        ClassifyBlock(block, spaces, controls);
+        if (controls != 0 && first_control == text.size()) {
+            first_control = base + CountTrailingZeros(controls);
         }
+        // every set bit marks a byte where a word starts or ends
+        const uint64_t word_bytes = ~spaces;
+        uint64_t transitions = word_bytes ^ ((word_bytes << 1) | in_word);
+        while (transitions != 0) {
+            const size_t pos = base + CountTrailingZeros(transitions);
+            if ((word_bytes >> (pos - base)) & 1) {
+                word_begin = pos;
+            }
+            else {
+                words.push_back(text.substr(word_begin, pos - word_begin));
+            }
+            transitions &= transitions - 1;
+        }
+        in_word = word_bytes >> (BLOCK_SIZE - 1);
     }
-    return result;
-}
\ No newline at end of file
+    if (in_word) {
+        words.push_back(text.substr(word_begin));
+    }
+    if (first_control == text.size()) {
+        return words.size();
+    }
+    // a control character is not a separator, so it lies inside the word it invalidates
+    return upper_bound(words.begin(), words.end(), text.data() + first_control,
+        [](const char* pos, string_view word) {
+            return pos < word.data();
+        }) - words.begin() - 1;
+}
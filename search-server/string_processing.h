@@ -5,6 +5,11 @@
 
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
 
+// Splits text by spaces into the caller's buffer, reusing its capacity. Separators and
+// control characters (0x00-0x1F) are found in the same pass, with SSE2/AVX2 where available.
+// Returns the index of the first word holding a control character or words.size() if there is none
+size_t SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
+
 template <typename StringContainer>
 std::set<std::string> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string> non_empty_strings;
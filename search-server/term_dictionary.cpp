@@ -0,0 +1,173 @@
+#include "term_dictionary.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+TermId TermDictionary::Intern(string_view term) {
+    if (const TermId id = Find(term); id != NO_TERM) {
+        return id;
+    }
+    const TermId id = static_cast<TermId>(size());
+    const string_view stored = Store(term);
+    terms_.push_back(stored);
+    ids_.emplace(stored, id);
+    return id;
+}
+
+TermId TermDictionary::Find(string_view term) const {
+    if (mapped_count_ > 0) {
+        if (const TermId id = FindMapped(term); id != NO_TERM) {
+            return id;
+        }
+    }
+    const auto it = ids_.find(term);
+    return it == ids_.end() ? NO_TERM : it->second;
+}
+
+string_view TermDictionary::GetTerm(TermId id) const {
+    if (id < mapped_count_) {
+        const MappedTerm& mapped = mapped_terms_[id];
+        return { mapped_blob_ + mapped.offset, mapped.length };
+    }
+    return terms_.at(id - mapped_count_);
+}
+
+size_t TermDictionary::size() const {
+    return mapped_count_ + terms_.size();
+}
+
+TermDictionary::TermDictionary(const TermDictionary& other)
+    : chunks_(other.chunks_)
+    , chunk_used_(other.chunk_used_)
+    , arena_capacity_(other.arena_capacity_)
+    , terms_(other.terms_)
+    , ids_(other.ids_)
+    , mapped_blob_(other.mapped_blob_)
+    , mapped_terms_(other.mapped_terms_)
+    , mapped_slots_(other.mapped_slots_)
+    , mapped_slot_count_(other.mapped_slot_count_)
+    , mapped_count_(other.mapped_count_) {
+}
+
+TermDictionary& TermDictionary::operator=(const TermDictionary& other) {
+    if (this != &other) {
+        *this = TermDictionary(other);
+    }
+    return *this;
+}
+
+size_t TermDictionary::GetArenaCapacity() const {
+    return arena_capacity_;
+}
+
+TermDictionary::Chunk::Chunk(size_t size)
+    : data(new char[size])
+    , size(size) {
+}
+
+string_view TermDictionary::Store(string_view term) {
+    if (!chunks_.empty()) {
+        Chunk& chunk = *chunks_.back();
+        // fails if a copy sharing the chunk has already appended past this view
+        size_t expected = chunk_used_;
+        if (term.size() <= chunk.size - chunk_used_
+            && chunk.used.compare_exchange_strong(expected, chunk_used_ + term.size())) {
+            char* dst = chunk.data.get() + chunk_used_;
+            memcpy(dst, term.data(), term.size());
+            chunk_used_ += term.size();
+            return { dst, term.size() };
+        }
+    }
+    // terms longer than a chunk get a chunk of their own
+    const size_t chunk_size = max(CHUNK_SIZE, term.size());
+    chunks_.push_back(make_shared<Chunk>(chunk_size));
+    arena_capacity_ += chunk_size;
+    Chunk& chunk = *chunks_.back();
+    memcpy(chunk.data.get(), term.data(), term.size());
+    chunk.used = term.size();
+    chunk_used_ = term.size();
+    return { chunk.data.get(), term.size() };
+}
+
+TermId TermDictionary::FindMapped(string_view term) const {
+    for (size_t slot = HashBytes(term.data(), term.size()) & (mapped_slot_count_ - 1);;
+        slot = (slot + 1) & (mapped_slot_count_ - 1)) {
+        const uint32_t entry = mapped_slots_[slot];
+        if (entry == 0) {
+            return NO_TERM;
+        }
+        if (GetTerm(entry - 1) == term) {
+            return entry - 1;
+        }
+    }
+}
+
+// Sections: term bytes, (offset, length) per id, hash slots
+void TermDictionary::Save(SnapshotWriter& writer) const {
+    const size_t count = size();
+    size_t slot_count = 1;
+    while (slot_count < count * 2) {
+        slot_count *= 2;
+    }
+    vector<MappedTerm> entries;
+    entries.reserve(count);
+    vector<uint32_t> slots(slot_count, 0);
+
+    writer.BeginSection();
+    uint32_t offset = 0;
+    for (TermId id = 0; id < count; ++id) {
+        const string_view term = GetTerm(id);
+        writer.Write(term.data(), term.size());
+        entries.push_back({ offset, static_cast<uint32_t>(term.size()) });
+        offset += static_cast<uint32_t>(term.size());
+        size_t slot = HashBytes(term.data(), term.size()) & (slot_count - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = id + 1;
+    }
+    writer.EndSection();
+
+    writer.BeginSection();
+    writer.Write(entries.data(), entries.size());
+    writer.EndSection();
+
+    writer.BeginSection();
+    writer.Write(slots.data(), slots.size());
+    writer.EndSection();
+}
+
+TermDictionary TermDictionary::Load(const MappedSnapshot& snapshot, size_t& section) {
+    TermDictionary result;
+    const auto [blob, blob_size] = snapshot.GetSection<char>(section);
+    result.mapped_blob_ = blob;
+    const auto [entries, count] = snapshot.GetSection<MappedTerm>(section);
+    const auto [slots, slot_count] = snapshot.GetSection<uint32_t>(section);
+    if (slot_count == 0 || (slot_count & (slot_count - 1)) != 0 || slot_count <= count || count >= NO_TERM) {
+        throw SnapshotError("Snapshot term table is corrupted"s);
+    }
+    for (size_t id = 0; id < count; ++id) {
+        if (entries[id].offset > blob_size || entries[id].length > blob_size - entries[id].offset) {
+            throw SnapshotError("Snapshot term is out of bounds"s);
+        }
+    }
+    // every id in one slot leaves empty slots, which end every probe sequence
+    size_t used_slots = 0;
+    for (size_t slot = 0; slot < slot_count; ++slot) {
+        if (slots[slot] > count) {
+            throw SnapshotError("Snapshot term table is corrupted"s);
+        }
+        used_slots += slots[slot] != 0;
+    }
+    if (used_slots != count) {
+        throw SnapshotError("Snapshot term table is corrupted"s);
+    }
+    result.mapped_terms_ = entries;
+    result.mapped_slots_ = slots;
+    result.mapped_slot_count_ = slot_count;
+    result.mapped_count_ = static_cast<TermId>(count);
+    return result;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using TermId = uint32_t;
+
+class SnapshotWriter;
+class MappedSnapshot;
+
+// Stores every distinct term once in a chunked arena and assigns it a dense id.
+// Views returned by the dictionary stay valid for the dictionary's lifetime.
+// Copies share the arena chunks and keep them alive. The first of them to add a term after
+// the copy keeps filling the shared last chunk; the others start chunks of their own.
+// A dictionary loaded from a snapshot looks its terms up in the mapped hash table;
+// terms added after loading go to the arena and get ids after the mapped ones.
+class TermDictionary {
+public:
+    static constexpr TermId NO_TERM = static_cast<TermId>(-1);
+
+    TermDictionary() = default;
+    TermDictionary(const TermDictionary& other);
+    TermDictionary& operator=(const TermDictionary& other);
+    TermDictionary(TermDictionary&&) = default;
+    TermDictionary& operator=(TermDictionary&&) = default;
+
+    // Returns the id of the term, adding it to the dictionary if it is new
+    TermId Intern(std::string_view term);
+
+    // Returns NO_TERM if the term is not in the dictionary
+    TermId Find(std::string_view term) const;
+
+    std::string_view GetTerm(TermId id) const;
+    size_t size() const;
+
+    // Bytes reserved by the arena (for memory accounting)
+    size_t GetArenaCapacity() const;
+
+    void Save(SnapshotWriter& writer) const;
+    // The snapshot memory must outlive the dictionary
+    static TermDictionary Load(const MappedSnapshot& snapshot, size_t& section);
+
+private:
+    struct MappedTerm {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    // used is the high-water mark over every dictionary sharing the chunk: one may append
+    // in place only while nobody has appended past the bytes it has seen
+    struct Chunk {
+        explicit Chunk(size_t size);
+
+        std::unique_ptr<char[]> data;
+        size_t size;
+        std::atomic<size_t> used{ 0 };
+    };
+
+    std::string_view Store(std::string_view term);
+    TermId FindMapped(std::string_view term) const;
+
+    std::vector<std::shared_ptr<Chunk>> chunks_;
+    // bytes of the last chunk that belong to this dictionary's view
+    size_t chunk_used_ = 0;
+    size_t arena_capacity_ = 0;
+    std::vector<std::string_view> terms_;
+    std::unordered_map<std::string_view, TermId> ids_;
+
+    // open addressing table of the snapshot, slots hold id + 1 and 0 when empty
+    const char* mapped_blob_ = nullptr;
+    const MappedTerm* mapped_terms_ = nullptr;
+    const uint32_t* mapped_slots_ = nullptr;
+    size_t mapped_slot_count_ = 0;
+    TermId mapped_count_ = 0;
+};
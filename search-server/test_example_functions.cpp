@@ -1,4 +1,30 @@
 #include "test_example_functions.h"
+#include "remove_duplicates.h"
+#include "snapshot.h"
+#include "process_queries.h"
+#include "query_cache.h"
+#include "query_executor.h"
+#include "query_dispatcher.h"
+#include "request_queue.h"
+#include "versioned_search_server.h"
+#include "segmented_search_server.h"
+#include "trace.h"
+#include "allocation_counter.h"
+#include "benchmark.h"
+#include "paginator.h"
+#include "document_loader.h"
+#include "bounded_queue.h"
+
+#include <random>
+#include <filesystem>
+#include <sstream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
 
 void AssertImpl(bool value, const string& expr_str, const string& file, const string& func, unsigned line,
     const string& hint) {
@@ -380,6 +406,1730 @@ void TestDocumentCount() {
     }
 }
 
+void TestWordFrequencies() {
+    SearchServer server("и"s);
+    {
+        // исходный текст уничтожается сразу после добавления
+        const string content = "пушистый кот пушистый хвост"s;
+        server.AddDocument(1, content, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        server.AddDocument(2, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+    }
+    const map<string_view, double> expected = { {"кот"sv, 0.25}, {"пушистый"sv, 0.5}, {"хвост"sv, 0.25} };
+    ASSERT_EQUAL(server.GetWordFrequencies(1), expected);
+    ASSERT_EQUAL(server.GetWordFrequencies(2).size(), 4u);
+    ASSERT(server.GetWordFrequencies(3).empty());
+
+    // одно и то же слово из разных документов хранится в словаре один раз
+    const auto first_cat = server.GetWordFrequencies(1).find("кот"sv)->first;
+    const auto second_cat = server.GetWordFrequencies(2).find("кот"sv)->first;
+    ASSERT(first_cat.data() == second_cat.data());
+
+    server.RemoveDocument(1);
+    ASSERT(server.GetWordFrequencies(1).empty());
+    ASSERT(server.FindTopDocuments("пушистый"s).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("кот"s).size(), 1u);
+}
+
+void TestPostingList() {
+    PostingList postings;
+    map<int, uint32_t> expected;
+    // сначала добавляем по возрастанию, затем вставляем в середину и удаляем
+    for (int id = 0; id < 1000; id += 3) {
+        postings.Add(id, id % 7 + 1, 0.1);
+        expected[id] = id % 7 + 1;
+    }
+    for (int id = 1; id < 1000; id += 9) {
+        postings.Add(id, 2, 0.1);
+        expected[id] = 2;
+    }
+    for (int id = 0; id < 1000; id += 6) {
+        ASSERT(postings.Erase(id));
+        expected.erase(id);
+    }
+    ASSERT(!postings.Erase(0));
+    // пакетное удаление: часть идентификаторов в списке отсутствует
+    vector<int> to_erase;
+    for (int id = 500; id < 800; id += 2) {
+        to_erase.push_back(id);
+    }
+    size_t expected_erased = 0;
+    for (const int id : to_erase) {
+        expected_erased += expected.erase(id);
+    }
+    ASSERT_EQUAL(postings.Erase(to_erase.data(), to_erase.data() + to_erase.size()), expected_erased);
+    ASSERT_EQUAL(postings.Erase(to_erase.data(), to_erase.data() + to_erase.size()), 0u);
+    ASSERT_EQUAL(postings.size(), expected.size());
+
+    auto expected_it = expected.begin();
+    for (auto cursor = postings.GetCursor(); !cursor.AtEnd(); cursor.Next(), ++expected_it) {
+        ASSERT(expected_it != expected.end());
+        ASSERT_EQUAL(cursor.GetDocumentId(), expected_it->first);
+        ASSERT_EQUAL(cursor.GetCount(), expected_it->second);
+    }
+    ASSERT(expected_it == expected.end());
+
+    for (int target : { 0, 5, 500, 997, 999 }) {
+        auto cursor = postings.GetCursor();
+        cursor.Advance(target);
+        const auto it = expected.lower_bound(target);
+        ASSERT_EQUAL(cursor.AtEnd(), it == expected.end());
+        if (it != expected.end()) {
+            ASSERT_EQUAL(cursor.GetDocumentId(), it->first);
+        }
+    }
+    ASSERT_EQUAL(postings.GetCount(3), 4u);
+    ASSERT_EQUAL(postings.GetCount(4), 0u);
+}
+
+void TestDocumentIds() {
+    SearchServer server("и"s);
+    server.AddDocument(7, "пушистый кот"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(3, "белый кот"s, DocumentStatus::BANNED, { 2 });
+    server.AddDocument(5, "ухоженный пёс"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(1, "пушистый кот"s, DocumentStatus::ACTUAL, { 4 });
+
+    server.RemoveDocument(3);
+    server.RemoveDocument(execution::par, 5);
+    ASSERT_EQUAL(server.GetDocumentCount(), 2);
+    ASSERT_EQUAL(vector<int>(server.begin(), server.end()), vector<int>({ 7, 1 }));
+    ASSERT(server.FindTopDocuments("ухоженный белый"s, DocumentStatus::BANNED).empty());
+
+    const auto found = server.FindTopDocuments("кот"s);
+    ASSERT_EQUAL(found.size(), 2u);
+    ASSERT_EQUAL(found[0].id, 1);
+    ASSERT_EQUAL(found[0].rating, 4);
+
+    // id удаленного документа можно использовать повторно
+    server.AddDocument(3, "белый пёс"s, DocumentStatus::ACTUAL, { 5 });
+    ASSERT(get<1>(server.MatchDocument("белый"s, 3)) == DocumentStatus::ACTUAL);
+
+    // из дубликатов остается документ с наименьшим id, даже если он добавлен позже
+    ASSERT_EQUAL(RemoveDuplicates(server), vector<int>({ 7 }));
+    ASSERT_EQUAL(vector<int>(server.begin(), server.end()), vector<int>({ 1, 3 }));
+}
+
+void TestTopDocuments() {
+    SearchServer server("и"s);
+    for (int id = 0; id < 50; ++id) {
+        const string text = (id % 3 == 0 ? "пушистый кот"s : "белый кот кот"s) + (id % 5 == 0 ? " хвост"s : ""s);
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 7 });
+    }
+    const auto all = server.FindTopDocuments("кот хвост"s, DocumentStatus::ACTUAL, 100);
+    ASSERT_EQUAL(all.size(), 50u);
+    ASSERT(is_sorted(all.begin(), all.end(), IsMoreRelevant));
+
+    for (size_t count : { 0, 1, 5, 17 }) {
+        const auto top = server.FindTopDocuments("кот хвост"s, DocumentStatus::ACTUAL, count);
+        const auto top_par = server.FindTopDocuments(execution::par, "кот хвост"s, DocumentStatus::ACTUAL, count);
+        ASSERT_EQUAL(top.size(), count);
+        ASSERT_EQUAL(top_par.size(), count);
+        for (size_t i = 0; i < count; ++i) {
+            ASSERT_EQUAL(top[i].id, all[i].id);
+            ASSERT_EQUAL(top_par[i].id, all[i].id);
+        }
+    }
+    ASSERT_EQUAL(server.FindTopDocuments("кот"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+}
+
+void TestParallelSearch() {
+    SearchServer server("и"s);
+    for (int id = 0; id < 200; ++id) {
+        const string text = (id % 2 ? "пушистый кот"s : "белый пёс"s) + (id % 3 ? " хвост"s : " ошейник"s);
+        server.AddDocument(id * 7, text, id % 4 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED, { id % 11 });
+    }
+    for (const string& query : { "кот хвост -ошейник"s, "пёс -белый"s, "хвост ошейник -кот"s, "пушистый"s }) {
+        const auto expected = server.FindTopDocuments(query, DocumentStatus::ACTUAL, 1000);
+        const auto found = server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 1000);
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t i = 0; i < found.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected[i].id);
+            ASSERT(abs(found[i].relevance - expected[i].relevance) < ACCURACY);
+        }
+    }
+}
+
+void TestDocumentAtATimeSearch() {
+    mt19937 generator(17);
+    const vector<string> dictionary = { "кот"s, "пёс"s, "хвост"s, "ошейник"s, "белый"s, "пушистый"s, "скворец"s, "глаза"s };
+    const auto make_text = [&generator, &dictionary](int word_count) {
+        string text;
+        for (int i = 0; i < word_count; ++i) {
+            text += dictionary[uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)] + " "s;
+        }
+        return text;
+    };
+    SearchServer server("и"s);
+    for (int id = 0; id < 500; ++id) {
+        server.AddDocument(id, make_text(uniform_int_distribution(1, 12)(generator)),
+            id % 5 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED, { id % 13 });
+    }
+    for (int i = 0; i < 400; ++i) {
+        if (i == 200) {
+            // границы блоков должны оставаться верными после удаления и повторного добавления
+            for (int id = 0; id < 500; id += 3) {
+                server.RemoveDocument(id);
+            }
+            for (int id = 500; id < 700; ++id) {
+                server.AddDocument(id, make_text(uniform_int_distribution(1, 12)(generator)), DocumentStatus::ACTUAL, { id % 13 });
+            }
+        }
+        const string query = make_text(uniform_int_distribution(1, 5)(generator)) + (i % 3 ? "-"s + make_text(1) : ""s);
+        for (size_t count : { 1, 5, 50 }) {
+            const auto expected = server.FindTopDocuments(query, DocumentStatus::ACTUAL, count);
+            const auto found = server.FindTopDocuments(query_policy::daat, query, DocumentStatus::ACTUAL, count);
+            ASSERT_EQUAL(found.size(), expected.size());
+            for (size_t j = 0; j < found.size(); ++j) {
+                ASSERT(abs(found[j].relevance - expected[j].relevance) < ACCURACY);
+                ASSERT_EQUAL(found[j].rating, expected[j].rating);
+            }
+        }
+    }
+    // длинные запросы и запросы из частых слов считаются без отсечения, результат тот же
+    for (int word_count : { 3, 20, 40 }) {
+        const string query = make_text(word_count);
+        const auto expected = server.FindTopDocuments(query, DocumentStatus::ACTUAL, 10);
+        const auto found = server.FindTopDocuments(query_policy::daat, query, DocumentStatus::ACTUAL, 10);
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t j = 0; j < found.size(); ++j) {
+            ASSERT_EQUAL(found[j].id, expected[j].id);
+            ASSERT(abs(found[j].relevance - expected[j].relevance) < ACCURACY);
+        }
+    }
+}
+
+void TestSnapshot() {
+    mt19937 generator(23);
+    const vector<string> dictionary = { "кот"s, "пёс"s, "хвост"s, "ошейник"s, "белый"s, "пушистый"s, "скворец"s, "глаза"s };
+    const auto make_text = [&generator, &dictionary](int word_count) {
+        string text;
+        for (int i = 0; i < word_count; ++i) {
+            text += dictionary[uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)] + " "s;
+        }
+        return text;
+    };
+    SearchServer server("и в на"s);
+    for (int id = 0; id < 400; ++id) {
+        server.AddDocument(id * 2, make_text(uniform_int_distribution(1, 12)(generator)) + "и"s,
+            id % 4 ? DocumentStatus::ACTUAL : DocumentStatus::IRRELEVANT, { id % 7, id % 3 });
+    }
+    for (int id = 0; id < 800; id += 10) {
+        server.RemoveDocument(id);
+    }
+
+    const string path = (filesystem::temp_directory_path() / "search_server_test.snapshot"s).string();
+    server.SaveSnapshot(path);
+    SearchServer loaded = SearchServer::LoadSnapshot(path);
+
+    const auto assert_same = [&](const SearchServer& lhs, const SearchServer& rhs) {
+        ASSERT_EQUAL(lhs.GetDocumentCount(), rhs.GetDocumentCount());
+        ASSERT(equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end()));
+        for (int i = 0; i < 50; ++i) {
+            const string query = make_text(uniform_int_distribution(1, 4)(generator)) + (i % 2 ? "-"s + make_text(1) : ""s);
+            for (DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT }) {
+                const auto expected = lhs.FindTopDocuments(query, status, 20);
+                const auto found = rhs.FindTopDocuments(query, status, 20);
+                ASSERT_EQUAL(found.size(), expected.size());
+                for (size_t j = 0; j < found.size(); ++j) {
+                    ASSERT_EQUAL(found[j].id, expected[j].id);
+                    ASSERT_EQUAL(found[j].rating, expected[j].rating);
+                }
+                ASSERT_EQUAL(rhs.FindTopDocuments(execution::par, query, status, 20).size(), expected.size());
+                ASSERT_EQUAL(rhs.FindTopDocuments(query_policy::daat, query, status, 20).size(), expected.size());
+            }
+            for (const int id : lhs) {
+                const auto [expected_words, expected_status] = lhs.MatchDocument(query, id);
+                const auto [words, status] = rhs.MatchDocument(query, id);
+                ASSERT_EQUAL(words, expected_words);
+                ASSERT(status == expected_status);
+            }
+        }
+        for (const int id : lhs) {
+            ASSERT_EQUAL(rhs.GetWordFrequencies(id), lhs.GetWordFrequencies(id));
+        }
+    };
+    assert_same(server, loaded);
+    ASSERT(loaded.FindTopDocuments("и"s).empty());
+    ASSERT_EQUAL(loaded.GetWordFrequencies(0).size(), 0u);
+
+    // загруженный индекс остаётся изменяемым
+    for (SearchServer* target : { &server, &loaded }) {
+        target->AddDocument(0, "белый кот и новый ошейник"s, DocumentStatus::ACTUAL, { 9 });
+        target->AddDocument(1001, "новый пушистый пёс"s, DocumentStatus::ACTUAL, { 1 });
+        target->RemoveDocument(2);
+        target->RemoveDocument(execution::par, 4);
+    }
+    try {
+        loaded.AddDocument(6, "кот"s, DocumentStatus::ACTUAL, {});
+        ASSERT_HINT(false, "Document id from the snapshot must stay taken"s);
+    }
+    catch (const invalid_argument&) {
+    }
+    assert_same(server, loaded);
+    ASSERT_EQUAL(loaded.FindTopDocuments("новый"s).size(), 2u);
+
+    // любое повреждение файла находит контрольная сумма; файл, подделанный вместе с ней,
+    // при полной проверке либо отвергается, либо оставляет индекс, который читается без
+    // выхода за границы
+    // loaded всё ещё отображает path, поэтому снимок пишется в другой файл
+    const string damaged_path = path + ".damaged"s;
+    loaded.SaveSnapshot(damaged_path);
+    const string intact = [&damaged_path] {
+        ifstream in(damaged_path, ios::binary);
+        return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }();
+    const auto write_file = [&damaged_path](const string& content) {
+        ofstream(damaged_path, ios::binary | ios::trunc) << content;
+    };
+    ASSERT_EQUAL(SearchServer::LoadSnapshot(damaged_path, SnapshotCheck::FULL).GetDocumentCount(),
+        loaded.GetDocumentCount());
+    // контрольная сумма лежит в последних 8 байтах 40-байтного заголовка
+    const auto forge_checksum = [](string& content) {
+        SnapshotChecksum checksum;
+        checksum.Update(content.data() + 40, content.size() - 40);
+        const uint64_t value = checksum.Finish();
+        memcpy(content.data() + 32, &value, sizeof(value));
+    };
+    size_t rejected = 0;
+    for (size_t offset = 40; offset < intact.size(); offset += 4) {
+        string damaged = intact;
+        damaged[offset] = static_cast<char>(damaged[offset] ^ 0x5a);
+        damaged[offset + 1] = '\xff';
+        if (damaged == intact) {
+            continue;
+        }
+        write_file(damaged);
+        try {
+            SearchServer::LoadSnapshot(damaged_path);
+            ASSERT_HINT(false, "Damaged snapshot must be rejected"s);
+        }
+        catch (const SnapshotError&) {
+        }
+        forge_checksum(damaged);
+        write_file(damaged);
+        try {
+            const SearchServer damaged_server = SearchServer::LoadSnapshot(damaged_path, SnapshotCheck::FULL);
+            for (const int id : damaged_server) {
+                damaged_server.GetWordFrequencies(id);
+                damaged_server.MatchDocument("кот пёс -хвост"s, id);
+            }
+            damaged_server.FindTopDocuments("кот пёс белый -хвост"s);
+            damaged_server.FindTopDocuments(query_policy::daat, "кот пёс белый -хвост"s);
+        }
+        catch (const invalid_argument&) {
+            ++rejected;
+        }
+    }
+    ASSERT(rejected > 0);
+    write_file(intact.substr(0, intact.size() - 16));
+    try {
+        SearchServer::LoadSnapshot(damaged_path);
+        ASSERT_HINT(false, "Truncated snapshot must be rejected"s);
+    }
+    catch (const invalid_argument&) {
+    }
+    // байт в тексте слова структуру не нарушает, его находит только контрольная сумма
+    string damaged_term = intact;
+    damaged_term[damaged_term.find("пушистый"s)] ^= 1;
+    write_file(damaged_term);
+    try {
+        SearchServer::LoadSnapshot(damaged_path);
+        ASSERT_HINT(false, "Corrupted snapshot must be rejected"s);
+    }
+    catch (const SnapshotError&) {
+    }
+    forge_checksum(damaged_term);
+    write_file(damaged_term);
+    SearchServer::LoadSnapshot(damaged_path, SnapshotCheck::FULL);
+    {
+        ofstream file(damaged_path, ios::binary | ios::trunc);
+        file << "not a snapshot at all, just some text long enough for a header"s;
+    }
+    try {
+        SearchServer::LoadSnapshot(damaged_path);
+        ASSERT_HINT(false, "Foreign file must be rejected"s);
+    }
+    catch (const SnapshotError&) {
+    }
+    filesystem::remove(damaged_path);
+    filesystem::remove(path);
+}
+
+void TestAddDocuments() {
+    mt19937 generator(29);
+    const vector<string> dictionary = { "кот"s, "пёс"s, "хвост"s, "ошейник"s, "белый"s, "пушистый"s, "скворец"s, "и"s };
+    vector<string> texts;
+    for (int i = 0; i < 3000; ++i) {
+        string text;
+        for (int j = uniform_int_distribution(0, 10)(generator); j > 0; --j) {
+            text += dictionary[uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)] + " "s;
+        }
+        texts.push_back(text);
+    }
+    vector<NewDocument> batch;
+    SearchServer expected("и"s);
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        const DocumentStatus status = i % 3 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED;
+        batch.push_back({ i * 3, texts[i], status, { i % 11, 4 } });
+        expected.AddDocument(i * 3, texts[i], status, { i % 11, 4 });
+    }
+    SearchServer seq_server("и"s);
+    seq_server.AddDocuments(batch);
+    SearchServer par_server("и"s);
+    par_server.AddDocument(1, "белый скворец"s, DocumentStatus::ACTUAL, { 1 });
+    par_server.AddDocuments(execution::par, batch);
+    par_server.RemoveDocument(1);
+
+    for (const SearchServer* server : { &seq_server, &par_server }) {
+        ASSERT_EQUAL(server->GetDocumentCount(), expected.GetDocumentCount());
+        ASSERT(equal(server->begin(), server->end(), expected.begin(), expected.end()));
+        for (const string& query : { "кот"s, "пёс -хвост"s, "белый пушистый скворец"s, "ошейник кот -скворец"s }) {
+            const auto found = server->FindTopDocuments(query, DocumentStatus::ACTUAL, 50);
+            const auto expected_found = expected.FindTopDocuments(query, DocumentStatus::ACTUAL, 50);
+            ASSERT_EQUAL(found.size(), expected_found.size());
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL(found[i].id, expected_found[i].id);
+                ASSERT_EQUAL(found[i].rating, expected_found[i].rating);
+            }
+        }
+        for (const int id : expected) {
+            ASSERT_EQUAL(server->GetWordFrequencies(id), expected.GetWordFrequencies(id));
+            ASSERT(get<1>(server->MatchDocument("кот"s, id)) == get<1>(expected.MatchDocument("кот"s, id)));
+        }
+    }
+
+    // ошибка в любом документе пакета отменяет весь пакет
+    const vector<vector<NewDocument>> invalid_batches = {
+        { { 10000, "рыжий кот"sv, DocumentStatus::ACTUAL, {} }, { -1, "рыжий пёс"sv, DocumentStatus::ACTUAL, {} } },
+        { { 10000, "рыжий кот"sv, DocumentStatus::ACTUAL, {} }, { 3, "рыжий пёс"sv, DocumentStatus::ACTUAL, {} } },
+        { { 10000, "рыжий кот"sv, DocumentStatus::ACTUAL, {} }, { 10000, "рыжий пёс"sv, DocumentStatus::ACTUAL, {} } },
+        { { 10000, "рыжий кот"sv, DocumentStatus::ACTUAL, {} }, { 10001, "рыжий п\x12ёс"sv, DocumentStatus::ACTUAL, {} } },
+    };
+    for (const auto& invalid_batch : invalid_batches) {
+        try {
+            par_server.AddDocuments(execution::par, invalid_batch);
+            ASSERT_HINT(false, "Invalid batch must be rejected"s);
+        }
+        catch (const invalid_argument&) {
+        }
+        ASSERT_EQUAL(par_server.GetDocumentCount(), expected.GetDocumentCount());
+        ASSERT(par_server.FindTopDocuments("рыжий"s).empty());
+        ASSERT_EQUAL(par_server.GetWordFrequencies(10000).size(), 0u);
+    }
+    par_server.AddDocuments(execution::par, { { 10000, "рыжий кот"sv, DocumentStatus::ACTUAL, {} } });
+    ASSERT_EQUAL(par_server.FindTopDocuments("рыжий"s).size(), 1u);
+}
+
+void TestSplitIntoWords() {
+    ASSERT_EQUAL(SplitIntoWords(""s).size(), 0u);
+    ASSERT_EQUAL(SplitIntoWords("   "s).size(), 0u);
+    ASSERT_EQUAL(SplitIntoWords("  белый  кот "s), vector<string_view>({ "белый"sv, "кот"sv }));
+
+    // сравнение с посимвольным разбором на строках, пересекающих границы блоков
+    mt19937 generator(31);
+    const string alphabet = "  ab\x01\x1f\x20\x7f\xd0\xba-"s;
+    vector<string_view> words;
+    for (int i = 0; i < 2000; ++i) {
+        string text;
+        for (int j = uniform_int_distribution(0, 200)(generator); j > 0; --j) {
+            text += alphabet[uniform_int_distribution<size_t>(0, alphabet.size() - 1)(generator)];
+        }
+        vector<string_view> expected;
+        size_t expected_invalid = string::npos;
+        for (size_t pos = 0; pos < text.size();) {
+            if (text[pos] == ' ') {
+                ++pos;
+                continue;
+            }
+            const size_t end = min(text.find(' ', pos), text.size());
+            const string_view word = string_view(text).substr(pos, end - pos);
+            if (expected_invalid == string::npos
+                && any_of(word.begin(), word.end(), [](char c) { return static_cast<unsigned char>(c) < ' '; })) {
+                expected_invalid = expected.size();
+            }
+            expected.push_back(word);
+            pos = end;
+        }
+        const size_t invalid = SplitIntoWords(text, words);
+        ASSERT_EQUAL(words, expected);
+        ASSERT_EQUAL(invalid, min(expected_invalid, expected.size()));
+    }
+}
+
+void TestStopWords() {
+    ASSERT(!StopWords().Contains("и"sv));
+    ASSERT(!StopWords().Contains(""sv));
+
+    const string long_word(100, 'x');
+    const StopWords stop_words(MakeUniqueNonEmptyStrings(vector<string>{ "и"s, "в"s, ""s, "на"s, "в"s, long_word }));
+    ASSERT_EQUAL(stop_words.size(), 4u);
+    ASSERT(stop_words.Contains("и"sv));
+    ASSERT(stop_words.Contains("на"sv));
+    ASSERT(stop_words.Contains(long_word));
+    ASSERT(!stop_words.Contains(string(99, 'x')));
+    ASSERT(!stop_words.Contains("над"sv));
+    ASSERT(!stop_words.Contains(""sv));
+    // слово внутри более длинной строки, без завершающего нуля
+    ASSERT(stop_words.Contains("нары"sv.substr(0, 4)));
+
+    mt19937 generator(37);
+    set<string> words;
+    while (words.size() < 10000) {
+        words.insert(to_string(uniform_int_distribution(0, 1'000'000)(generator)));
+    }
+    const StopWords many_words(words);
+    for (int i = 0; i < 20000; ++i) {
+        const string word = to_string(uniform_int_distribution(0, 1'000'000)(generator));
+        ASSERT_EQUAL(many_words.Contains(word), words.count(word) > 0);
+    }
+    ASSERT(equal(many_words.begin(), many_words.end(), words.begin(), words.end()));
+}
+
+void TestQueryContext() {
+    mt19937 generator(41);
+    const vector<string> dictionary = { "кот"s, "пёс"s, "хвост"s, "ошейник"s, "белый"s, "пушистый"s, "скворец"s, "и"s };
+    const auto make_text = [&generator, &dictionary](int word_count) {
+        string text;
+        for (int i = 0; i < word_count; ++i) {
+            text += dictionary[uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)] + " "s;
+        }
+        return text;
+    };
+    SearchServer small_server("и"s);
+    small_server.AddDocument(3, "белый кот"s, DocumentStatus::ACTUAL, { 1 });
+    SearchServer server("и"s);
+    for (int id = 0; id < 1000; ++id) {
+        server.AddDocument(id, make_text(uniform_int_distribution(1, 10)(generator)),
+            id % 4 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED, { id % 9 });
+    }
+    for (int id = 0; id < 1000; id += 7) {
+        server.RemoveDocument(id);
+    }
+
+    QueryContext context;
+    vector<string> queries;
+    for (int i = 0; i < 200; ++i) {
+        queries.push_back(make_text(uniform_int_distribution(1, 5)(generator)) + (i % 3 ? "-"s + make_text(1) : ""s));
+        const string& query = queries.back();
+        // контекст переиспользуется и между серверами разного размера
+        ASSERT_EQUAL(small_server.FindTopDocuments(context, query).size(), small_server.FindTopDocuments(query).size());
+        const size_t count = i % 2 ? 5 : 50;
+        const auto expected = server.FindTopDocuments(query, DocumentStatus::ACTUAL, count);
+        const auto& found = server.FindTopDocuments(context, query, DocumentStatus::ACTUAL, count);
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t j = 0; j < found.size(); ++j) {
+            ASSERT_EQUAL(found[j].id, expected[j].id);
+            ASSERT(abs(found[j].relevance - expected[j].relevance) < ACCURACY);
+        }
+        const auto is_even = [](int document_id, DocumentStatus, int) { return document_id % 2 == 0; };
+        ASSERT_EQUAL(server.FindTopDocuments(context, query, is_even).size(), server.FindTopDocuments(query, is_even).size());
+    }
+    try {
+        server.FindTopDocuments(context, "кот --пёс"s);
+        ASSERT_HINT(false, "Invalid query must be rejected"s);
+    }
+    catch (const invalid_argument&) {
+    }
+
+    // после прогрева запросы не выделяют память
+    for (const string& query : queries) {
+        server.FindTopDocuments(context, query, DocumentStatus::ACTUAL, 50);
+    }
+    size_t found_count = 0;
+    uint64_t allocation_count = 0;
+    {
+        AllocationCounter allocations;
+        for (const string& query : queries) {
+            found_count += server.FindTopDocuments(context, query, DocumentStatus::ACTUAL, 50).size();
+        }
+        allocation_count = allocations.GetCount();
+    }
+    ASSERT(found_count > 0);
+    ASSERT_EQUAL(allocation_count, 0u);
+
+    const auto results = ProcessQueries(server, queries);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        ASSERT_EQUAL(results[i].size(), server.FindTopDocuments(queries[i]).size());
+    }
+}
+
+void TestQueryCache() {
+    SearchServer server("и в на"s);
+    server.AddDocument(1, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+    server.AddDocument(2, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    server.AddDocument(3, "ухоженный пёс выразительные глаза"s, DocumentStatus::BANNED, { 5, -12, 2, 1 });
+
+    QueryCache cache(server, 100);
+    ASSERT_EQUAL(cache.FindTopDocuments("пушистый кот"s).size(), 2u);
+    // запросы с одинаковой нормальной формой делят одну запись
+    ASSERT_EQUAL(server.NormalizeQuery("кот  пушистый и кот"s), server.NormalizeQuery("пушистый кот"s));
+    ASSERT(server.NormalizeQuery("кот -хвост"s) != server.NormalizeQuery("кот хвост"s));
+    const auto cached = cache.FindTopDocuments("кот  пушистый и кот"s);
+    ASSERT_EQUAL(cached.size(), 2u);
+    ASSERT_EQUAL(cached[0].id, 2);
+    ASSERT_EQUAL(cache.GetStats().hits, 1u);
+    ASSERT_EQUAL(cache.GetStats().misses, 1u);
+
+    // статус, предикат и размер выдачи входят в ключ
+    ASSERT_EQUAL(cache.FindTopDocuments("пёс"s, DocumentStatus::BANNED).size(), 1u);
+    ASSERT_EQUAL(cache.FindTopDocuments("пёс"s).size(), 0u);
+    ASSERT_EQUAL(cache.FindTopDocuments("кот"s, DocumentStatus::ACTUAL, 1).size(), 1u);
+    const auto is_odd = [](int document_id, DocumentStatus, int) { return document_id % 2 == 1; };
+    ASSERT_EQUAL(cache.FindTopDocuments("кот"s, "odd"sv, is_odd).size(), 1u);
+    ASSERT_EQUAL(cache.FindTopDocuments("кот"s, "odd"sv, is_odd).size(), 1u);
+    ASSERT_EQUAL(cache.GetStats().hits, 2u);
+    ASSERT_EQUAL(cache.GetStats().misses, 5u);
+
+    // любое изменение индекса сбрасывает кэш
+    server.AddDocument(4, "пушистый кот"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(cache.FindTopDocuments("пушистый кот"s).size(), 3u);
+    server.RemoveDocument(2);
+    ASSERT_EQUAL(cache.FindTopDocuments("пушистый кот"s).size(), 2u);
+    ASSERT_EQUAL(cache.GetStats().misses, 7u);
+
+    try {
+        cache.FindTopDocuments("кот --хвост"s);
+        ASSERT_HINT(false, "Invalid query must be rejected"s);
+    }
+    catch (const invalid_argument&) {
+    }
+
+    // размер ограничен, а частые запросы не вытесняются разовыми
+    QueryCache small_cache(server, 16);
+    for (int i = 0; i < 1000; ++i) {
+        small_cache.FindTopDocuments("кот слово"s + to_string(i));
+        if (i % 10 == 0) {
+            small_cache.FindTopDocuments("кот"s);
+        }
+    }
+    ASSERT(small_cache.size() <= 16u);
+    ASSERT(small_cache.GetStats().rejections > 0u);
+    const uint64_t hits = small_cache.GetStats().hits;
+    small_cache.FindTopDocuments("кот"s);
+    ASSERT_EQUAL(small_cache.GetStats().hits, hits + 1);
+
+    vector<string> queries;
+    for (int i = 0; i < 500; ++i) {
+        queries.push_back("кот ошейник слово"s + to_string(i % 37));
+    }
+    for_each(execution::par, queries.begin(), queries.end(), [&cache, &server](const string& query) {
+        ASSERT_EQUAL(cache.FindTopDocuments(query).size(), server.FindTopDocuments(query).size());
+    });
+}
+
+void TestQueryExecutor() {
+    SearchServer server("и в на"s);
+    const vector<string> words = { "кот"s, "пёс"s, "хвост"s, "ошейник"s, "белый"s, "пушистый"s, "скворец"s };
+    for (int id = 0; id < 300; ++id) {
+        server.AddDocument(id, words[id % 7] + " "s + words[id % 5] + " и "s + words[id % 3], DocumentStatus::ACTUAL, { id % 11 });
+    }
+    vector<string> queries;
+    for (int i = 0; i < 1000; ++i) {
+        queries.push_back(words[i % 7] + " "s + words[i % 4] + (i % 5 ? ""s : " -"s + words[i % 6]));
+    }
+
+    for (const size_t thread_count : { 1, 3 }) {
+        QueryExecutor::Options options;
+        options.thread_count = thread_count;
+        options.pin_threads = thread_count == 1;
+        options.chunk_size = 7;
+        QueryExecutor executor(options);
+        ASSERT_EQUAL(executor.GetThreadCount(), thread_count);
+        // пул переиспользуется между пакетами
+        for (int batch = 0; batch < 3; ++batch) {
+            const auto results = executor.ProcessQueries(server, queries);
+            const auto joined = executor.ProcessQueriesJoined(server, queries);
+            ASSERT_EQUAL(results.size(), queries.size());
+            size_t position = 0;
+            for (size_t i = 0; i < queries.size(); ++i) {
+                const auto expected = server.FindTopDocuments(queries[i]);
+                ASSERT_EQUAL(results[i].size(), expected.size());
+                for (size_t j = 0; j < expected.size(); ++j) {
+                    ASSERT_EQUAL(results[i][j].id, expected[j].id);
+                    ASSERT_EQUAL(joined[position++].id, expected[j].id);
+                }
+            }
+            ASSERT_EQUAL(position, joined.size());
+        }
+        ASSERT(executor.ProcessQueries(server, {}).empty());
+
+        // ошибка в одном запросе не теряет остальные и доходит до вызывающего
+        auto invalid_queries = queries;
+        invalid_queries[500] = "кот --пёс"s;
+        try {
+            executor.ProcessQueriesJoined(server, invalid_queries);
+            ASSERT_HINT(false, "Invalid query must be rejected"s);
+        }
+        catch (const invalid_argument&) {
+        }
+        ASSERT_EQUAL(executor.ProcessQueries(server, queries).size(), queries.size());
+    }
+}
+
+void TestQueryDispatcher() {
+    SearchServer server("и в на"s);
+    server.AddDocument(1, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+    server.AddDocument(2, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    server.AddDocument(3, "ухоженный пёс выразительные глаза"s, DocumentStatus::BANNED, { 5, -12, 2, 1 });
+
+    {
+        QueryDispatcher dispatcher(server);
+        vector<future<vector<Document>>> results;
+        for (int i = 0; i < 100; ++i) {
+            results.push_back(dispatcher.SubmitQuery(i % 2 ? "пушистый кот"s : "скворец"s));
+        }
+        QueryOptions banned;
+        banned.status = DocumentStatus::BANNED;
+        auto banned_result = dispatcher.SubmitQuery("пёс"s, banned);
+        auto invalid_result = dispatcher.SubmitQuery("кот --хвост"s);
+        for (int i = 0; i < 100; ++i) {
+            const auto documents = results[i].get();
+            ASSERT_EQUAL(documents.size(), i % 2 ? 2u : 0u);
+        }
+        ASSERT_EQUAL(banned_result.get().size(), 1u);
+        try {
+            invalid_result.get();
+            ASSERT_HINT(false, "Invalid query must be rejected"s);
+        }
+        catch (const invalid_argument&) {
+        }
+        // запросы без результатов учитываются, как в RequestQueue
+        ASSERT_EQUAL(dispatcher.GetNoResultRequests(), 50);
+        ASSERT_EQUAL(dispatcher.GetStats().completed, 101u);
+        ASSERT_EQUAL(dispatcher.GetStats().failed, 1u);
+    }
+
+    // один поток занят, очередь на два запроса заполнена: следующий отклоняется сразу
+    QueryDispatcher::Options options;
+    options.thread_count = 1;
+    options.max_queue_depth = 2;
+    QueryDispatcher dispatcher(server, options);
+    promise<void> started;
+    promise<void> release;
+    auto released = release.get_future().share();
+    vector<Document> first;
+    ASSERT(dispatcher.SubmitQuery("кот"s, {}, [&started, released, &first](vector<Document> documents, exception_ptr) {
+        first = move(documents);
+        started.set_value();
+        released.wait();
+    }));
+    started.get_future().wait();
+    QueryOptions short_deadline;
+    short_deadline.timeout = chrono::milliseconds(1);
+    auto expired = dispatcher.SubmitQuery("кот"s, short_deadline);
+    auto queued = dispatcher.SubmitQuery("хвост"s);
+    auto rejected = dispatcher.SubmitQuery("кот"s);
+    ASSERT_EQUAL(dispatcher.GetQueueDepth(), 2u);
+    try {
+        rejected.get();
+        ASSERT_HINT(false, "Query over the queue depth must be rejected"s);
+    }
+    catch (const QueryOverloadError&) {
+    }
+    this_thread::sleep_for(chrono::milliseconds(5));
+    release.set_value();
+    // срок истёк, пока запрос стоял в очереди
+    try {
+        expired.get();
+        ASSERT_HINT(false, "Query past its deadline must fail"s);
+    }
+    catch (const QueryDeadlineError&) {
+    }
+    ASSERT_EQUAL(queued.get().size(), 1u);
+    ASSERT_EQUAL(first.size(), 2u);
+    const auto stats = dispatcher.GetStats();
+    ASSERT_EQUAL(stats.completed, 2u);
+    ASSERT_EQUAL(stats.rejected, 1u);
+    ASSERT_EQUAL(stats.expired, 1u);
+
+    QueryContext context;
+    context.SetDeadline(chrono::steady_clock::now() - chrono::seconds(1));
+    try {
+        server.FindTopDocuments(context, "кот"s);
+        ASSERT_HINT(false, "Query past its deadline must fail"s);
+    }
+    catch (const QueryDeadlineError&) {
+    }
+    context.ClearDeadline();
+    ASSERT_EQUAL(server.FindTopDocuments(context, "кот"s).size(), 2u);
+}
+
+void TestVersionedSearchServer() {
+    VersionedSearchServer server(SearchServer("и в на"s));
+    server.AddDocument(1, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+    const auto first = server.GetSnapshot();
+    server.AddDocument(2, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    server.RemoveDocument(1);
+    const auto second = server.GetSnapshot();
+
+    // старое поколение не видит последующих изменений
+    ASSERT_EQUAL(first->GetDocumentCount(), 1);
+    ASSERT_EQUAL(first->FindTopDocuments("кот"s).size(), 1u);
+    ASSERT_EQUAL(first->FindTopDocuments("кот"s)[0].id, 1);
+    ASSERT_EQUAL(get<0>(first->MatchDocument("модный кот"s, 1)).size(), 2u);
+    ASSERT_EQUAL(first->GetWordFrequencies(1).size(), 4u);
+    ASSERT_EQUAL(second->GetDocumentCount(), 1);
+    ASSERT_EQUAL(second->FindTopDocuments("кот"s)[0].id, 2);
+    ASSERT(second->GetWordFrequencies(1).empty());
+    ASSERT(second->GetGeneration() > first->GetGeneration());
+
+    // изменение, прерванное исключением, не публикуется
+    try {
+        server.Modify([](VersionedSearchServer::Writer& next) {
+            next.AddDocument(3, "скворец"s, DocumentStatus::ACTUAL, { 1 });
+            next.AddDocument(2, "скворец"s, DocumentStatus::ACTUAL, { 1 });
+        });
+        ASSERT_HINT(false, "Repeated id must be rejected"s);
+    }
+    catch (const invalid_argument&) {
+    }
+    ASSERT_EQUAL(server.GetSnapshot()->GetDocumentCount(), 1);
+    ASSERT(server.GetSnapshot()->FindTopDocuments("скворец"s).empty());
+
+    // копия индекса независима от оригинала, но делит с ним неизменённые данные
+    SearchServer original("и"s);
+    original.AddDocument(1, "кот и пёс"s, DocumentStatus::ACTUAL, { 1 });
+    SearchServer copy = original;
+    copy.AddDocument(2, "кот и скворец"s, DocumentStatus::ACTUAL, { 1 });
+    original.AddDocument(3, "ошейник"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(original.FindTopDocuments("кот"s).size(), 1u);
+    ASSERT_EQUAL(copy.FindTopDocuments("кот"s).size(), 2u);
+    ASSERT(copy.FindTopDocuments("ошейник"s).empty());
+    ASSERT_EQUAL(copy.GetWordFrequencies(2).count("скворец"sv), 1u);
+
+    // каждое поколение копирует индекс и дописывает новые слова: копия продолжает общий
+    // кусок арены, а не заводит свой, так что память слов не растёт с числом поколений
+    auto generation = make_shared<SearchServer>("и"s);
+    for (int id = 0; id < 2000; ++id) {
+        auto next = make_shared<SearchServer>(*generation);
+        next->AddDocument(id, "слово"s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+        generation = move(next);
+    }
+    ASSERT(generation->GetTermStorageCapacity() <= 64 * 1024);
+    // две копии дописывают разные слова, и ни одна не портит слова другой
+    SearchServer forked = *generation;
+    forked.AddDocument(5000, "ветка"s, DocumentStatus::ACTUAL, { 1 });
+    generation->AddDocument(5000, "ствол"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(forked.GetWordFrequencies(5000).begin()->first, "ветка"sv);
+    ASSERT_EQUAL(generation->GetWordFrequencies(5000).begin()->first, "ствол"sv);
+    ASSERT_EQUAL(forked.FindTopDocuments("слово1999"s).size(), 1u);
+
+    // база, дельта и удалённые из базы документы ранжируются как один индекс,
+    // в том числе после переноса изменений в новую базу
+    SearchServer base("и"s);
+    SearchServer expected("и"s);
+    for (int id = 0; id < 6; ++id) {
+        const string text = (id % 2 == 0 ? "кот"s : "пёс"s) + (id % 3 == 0 ? " хвост"s : " ошейник"s);
+        base.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+        expected.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+    }
+    VersionedSearchServer folded(base, { 5 });
+    const auto base_generation = folded.GetSnapshot();
+    const auto check_same = [&folded, &expected] {
+        const auto snapshot = folded.GetSnapshot();
+        ASSERT_EQUAL(snapshot->GetDocumentCount(), expected.GetDocumentCount());
+        for (const string query : { "кот"s, "пёс хвост"s, "ошейник -кот"s, "скворец хвост"s }) {
+            const auto found = snapshot->FindTopDocuments(query);
+            const auto expected_found = expected.FindTopDocuments(query);
+            ASSERT_EQUAL(found.size(), expected_found.size());
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL(found[i].id, expected_found[i].id);
+                ASSERT(abs(found[i].relevance - expected_found[i].relevance) < 1e-6);
+            }
+        }
+    };
+    folded.RemoveDocument(0);
+    expected.RemoveDocument(0);
+    folded.AddDocument(10, "скворец и кот"s, DocumentStatus::ACTUAL, { 3 });
+    expected.AddDocument(10, "скворец и кот"s, DocumentStatus::ACTUAL, { 3 });
+    check_same();
+    ASSERT(!folded.GetSnapshot()->ContainsDocument(0));
+    ASSERT(folded.GetSnapshot()->GetWordFrequencies(0).empty());
+    ASSERT_EQUAL(folded.GetSnapshot()->GetWordFrequencies(10).size(), 2u);
+    try {
+        folded.AddDocument(1, "скворец"s, DocumentStatus::ACTUAL, { 1 });
+        ASSERT_HINT(false, "Id of a base document must be rejected"s);
+    }
+    catch (const invalid_argument&) {
+    }
+    // удалённый из базы id можно добавить снова, он ищется в дельте
+    folded.AddDocument(0, "пёс и скворец"s, DocumentStatus::ACTUAL, { 4 });
+    expected.AddDocument(0, "пёс и скворец"s, DocumentStatus::ACTUAL, { 4 });
+    check_same();
+    ASSERT_EQUAL(get<0>(folded.GetSnapshot()->MatchDocument("скворец кот"s, 0)).size(), 1u);
+    folded.RemoveDocument(10);
+    expected.RemoveDocument(10);
+    folded.RemoveDocument(3);
+    expected.RemoveDocument(3);
+    // пятое изменение перенесло всё в новую базу, старое поколение не изменилось
+    check_same();
+    ASSERT_EQUAL(base_generation->GetDocumentCount(), 6);
+    ASSERT_EQUAL(base_generation->FindTopDocuments("кот"s).size(), 3u);
+    // несколько удалений из базы в одном поколении копируют надгробия один раз,
+    // а предыдущее поколение их не видит
+    const auto before_removal = folded.GetSnapshot();
+    folded.Modify([](VersionedSearchServer::Writer& next) {
+        next.RemoveDocument(1);
+        next.RemoveDocument(2);
+    });
+    expected.RemoveDocument(1);
+    expected.RemoveDocument(2);
+    check_same();
+    ASSERT(before_removal->ContainsDocument(1));
+    ASSERT(before_removal->ContainsDocument(2));
+    ASSERT_EQUAL(before_removal->GetDocumentCount(), folded.GetSnapshot()->GetDocumentCount() + 2);
+
+    // смешанная нагрузка: документы добавляются и удаляются парами в одном поколении,
+    // поэтому читатель всегда видит чётное число совпадений
+    VersionedSearchServer stressed(SearchServer("и"s));
+    const vector<string> words = { "кот"s, "пёс"s, "хвост"s, "ошейник"s };
+    atomic<bool> stop = false;
+    atomic<int> read_count = 0;
+    vector<thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back([&stressed, &stop, &read_count, &words, i] {
+            QueryContext context;
+            while (!stop) {
+                const auto snapshot = stressed.GetSnapshot();
+                ASSERT_EQUAL(snapshot->FindTopDocuments(context, words[i], DocumentStatus::ACTUAL, 1000).size() % 2, 0u);
+                ASSERT_EQUAL(static_cast<int>(snapshot->FindTopDocuments("скворец"s, DocumentStatus::ACTUAL, 1000).size()),
+                    snapshot->GetDocumentCount());
+                ++read_count;
+            }
+        });
+    }
+    for (int id = 10; id < 410; id += 2) {
+        stressed.Modify([&words, id](VersionedSearchServer::Writer& next) {
+            const string text = words[id / 2 % 4] + " скворец"s;
+            next.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+            next.AddDocument(id + 1, text, DocumentStatus::ACTUAL, { 2 });
+        });
+        if (id % 16 == 0) {
+            stressed.Modify([id](VersionedSearchServer::Writer& next) {
+                next.RemoveDocument(id - 6);
+                next.RemoveDocument(id - 5);
+            });
+        }
+    }
+    while (read_count < 100) {
+        this_thread::yield();
+    }
+    stop = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+}
+
+void TestSegmentedSearchServer() {
+    mt19937 generator(17);
+    const vector<string> dictionary = { "кот"s, "пёс"s, "хвост"s, "ошейник"s, "белый"s, "пушистый"s, "скворец"s, "и"s };
+    const auto make_text = [&generator, &dictionary]() {
+        string text;
+        for (int i = uniform_int_distribution(1, 6)(generator); i > 0; --i) {
+            text += dictionary[uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)] + " "s;
+        }
+        return text;
+    };
+    SegmentedSearchServer::Options options;
+    options.seal_threshold = 8;
+    options.merge_factor = 2;
+    SegmentedSearchServer segmented("и"s, options);
+    SearchServer single("и"s);
+    const vector<string> queries = { "кот"s, "пушистый скворец"s, "белый кот -хвост"s, "пёс ошейник хвост"s };
+    const auto check = [&segmented, &single, &queries]() {
+        segmented.Refresh();
+        ASSERT_EQUAL(segmented.GetDocumentCount(), single.GetDocumentCount());
+        QueryContext context;
+        for (const string& query : queries) {
+            const auto expected = single.FindTopDocuments(query, DocumentStatus::ACTUAL, 1000);
+            const auto found = segmented.FindTopDocuments(context, query, DocumentStatus::ACTUAL, 1000);
+            ASSERT_EQUAL(found.size(), expected.size());
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT(abs(found[i].relevance - expected[i].relevance) < ACCURACY);
+                ASSERT_EQUAL(found[i].rating, expected[i].rating);
+            }
+        }
+    };
+    for (int id = 0; id < 200; ++id) {
+        const string text = make_text();
+        const DocumentStatus status = id % 5 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED;
+        segmented.AddDocument(id, text, status, { id % 7, 3 });
+        single.AddDocument(id, text, status, { id % 7, 3 });
+        // удаляются документы и активного, и запечатанных сегментов
+        if (id % 3 == 0) {
+            segmented.RemoveDocument(id / 2);
+            single.RemoveDocument(id / 2);
+        }
+        if (id % 25 == 0) {
+            check();
+        }
+    }
+    segmented.WaitForMerges();
+    check();
+    // уровни сливаются: сегментов меньше, чем запечатывалось
+    ASSERT(segmented.GetSegmentCount() < 200 / 8);
+
+    // удалённый идентификатор можно добавить снова, а занятый — нельзя
+    segmented.AddDocument(0, "кот"s, DocumentStatus::ACTUAL, { 1 });
+    single.AddDocument(0, "кот"s, DocumentStatus::ACTUAL, { 1 });
+    try {
+        segmented.AddDocument(199, "кот"s, DocumentStatus::ACTUAL, { 1 });
+        ASSERT_HINT(false, "Repeated id must be rejected"s);
+    }
+    catch (const invalid_argument&) {
+    }
+    try {
+        segmented.FindTopDocuments("кот --пёс"s);
+        ASSERT_HINT(false, "Invalid query must be rejected"s);
+    }
+    catch (const invalid_argument&) {
+    }
+    segmented.WaitForMerges();
+    check();
+
+    // изменения копятся в активном сегменте и видны читателям только после публикации
+    SegmentedSearchServer::Options buffered_options;
+    buffered_options.seal_threshold = 100;
+    buffered_options.refresh_threshold = 10;
+    SegmentedSearchServer buffered("и"s, buffered_options);
+    for (int id = 0; id < 9; ++id) {
+        buffered.AddDocument(id, "кот"s, DocumentStatus::ACTUAL, { 1 });
+    }
+    ASSERT_EQUAL(buffered.GetDocumentCount(), 0);
+    ASSERT(buffered.FindTopDocuments("кот"s).empty());
+    buffered.RemoveDocument(0);
+    ASSERT_EQUAL(buffered.GetDocumentCount(), 8);
+    buffered.RemoveDocument(1);
+    ASSERT_EQUAL(buffered.GetDocumentCount(), 8);
+    buffered.Refresh();
+    ASSERT_EQUAL(buffered.GetDocumentCount(), 7);
+    ASSERT_EQUAL(buffered.FindTopDocuments("кот"s).size(), 5u);
+    // пакет публикуется целиком по возвращении, запечатанный сегмент — сразу
+    vector<NewDocument> batch;
+    const string batch_text = "пёс"s;
+    for (int id = 100; id < 250; ++id) {
+        batch.push_back({ id, batch_text, DocumentStatus::ACTUAL, { 1 } });
+    }
+    buffered.AddDocuments(batch);
+    ASSERT_EQUAL(buffered.GetDocumentCount(), 157);
+    ASSERT_EQUAL(buffered.GetSegmentCount(), 1u);
+    ASSERT_EQUAL(buffered.FindTopDocuments("пёс"s, DocumentStatus::ACTUAL).size(), 5u);
+    try {
+        buffered.AddDocument(150, "кот"s, DocumentStatus::ACTUAL, { 1 });
+        ASSERT_HINT(false, "Id of a sealed document must be rejected"s);
+    }
+    catch (const invalid_argument&) {
+    }
+}
+
+void TestRemoveDocuments() {
+    mt19937 generator(23);
+    const vector<string> dictionary = { "кот"s, "пёс"s, "хвост"s, "ошейник"s, "белый"s, "пушистый"s, "скворец"s, "и"s };
+    const auto make_text = [&generator, &dictionary]() {
+        string text;
+        for (int i = uniform_int_distribution(1, 6)(generator); i > 0; --i) {
+            text += dictionary[uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)] + " "s;
+        }
+        return text;
+    };
+    const vector<string> queries = { "кот"s, "пушистый скворец"s, "белый кот -хвост"s, "пёс ошейник хвост"s };
+    const auto check = [&queries](const SearchServer& server, const SearchServer& expected_server) {
+        ASSERT_EQUAL(server.GetDocumentCount(), expected_server.GetDocumentCount());
+        ASSERT(vector<int>(server.begin(), server.end()) == vector<int>(expected_server.begin(), expected_server.end()));
+        for (const string& query : queries) {
+            const auto found = server.FindTopDocuments(query, DocumentStatus::ACTUAL, 1000);
+            const auto expected = expected_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 1000);
+            ASSERT_EQUAL(found.size(), expected.size());
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL(found[i].id, expected[i].id);
+                ASSERT(abs(found[i].relevance - expected[i].relevance) < ACCURACY);
+            }
+        }
+    };
+
+    SearchServer one_by_one("и"s);
+    SearchServer sequential("и"s);
+    SearchServer parallel("и"s);
+    for (int id = 0; id < 500; ++id) {
+        const string text = make_text();
+        for (SearchServer* server : { &one_by_one, &sequential, &parallel }) {
+            server->AddDocument(id, text, DocumentStatus::ACTUAL, { id % 7 });
+        }
+    }
+    // неизвестные и повторные идентификаторы пропускаются
+    vector<int> to_remove = { -1, 1000, 7, 7 };
+    for (int id = 0; id < 500; id += 3) {
+        to_remove.push_back(id);
+    }
+    for (const int id : to_remove) {
+        one_by_one.RemoveDocument(id);
+    }
+    sequential.RemoveDocuments(to_remove);
+    parallel.RemoveDocuments(execution::par, to_remove);
+    check(sequential, one_by_one);
+    check(parallel, one_by_one);
+
+    // документы постоянно добавляются и удаляются, индекс время от времени уплотняется, а ответы не меняются
+    SearchServer churned("и"s);
+    SearchServer fresh("и"s);
+    for (int id = 0; id < 5000; ++id) {
+        const string text = make_text() + "слово"s + to_string(id);
+        churned.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 5 });
+        if (id >= 4900) {
+            fresh.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 5 });
+        }
+        if (id >= 100) {
+            if (id % 2) {
+                churned.RemoveDocument(id - 100);
+            }
+            else {
+                churned.RemoveDocument(execution::par, id - 100);
+            }
+        }
+        if (id % 1000 == 999) {
+            churned.CompactIfSparse();
+        }
+    }
+    check(churned, fresh);
+    ASSERT(churned.FindTopDocuments("слово10"s).empty());
+    ASSERT_EQUAL(churned.FindTopDocuments("слово4999"s).size(), 1u);
+    ASSERT(churned.GetWordFrequencies(4999) == fresh.GetWordFrequencies(4999));
+    // слова всех документов удалены: нулевой частоты в IDF нет
+    churned.RemoveDocuments(vector<int>(churned.begin(), churned.end()));
+    ASSERT_EQUAL(churned.GetDocumentCount(), 0);
+    ASSERT(churned.FindTopDocuments("кот"s).empty());
+
+    // удаление во время обхода: удаление само не уплотняет индекс, поэтому итераторы
+    // остаются верными; уплотнение освобождает слова, которых больше нет ни в одном документе
+    const string path = (filesystem::temp_directory_path() / "search_server_compaction.snapshot"s).string();
+    {
+        SearchServer saved("и"s);
+        for (int id = 0; id < 3000; ++id) {
+            saved.AddDocument(id, "кот и слово"s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+        }
+        saved.SaveSnapshot(path);
+    }
+    SearchServer loaded = SearchServer::LoadSnapshot(path);
+    SearchServer added("и"s);
+    added.AddDocumentsFrom(loaded, [](int) {
+        return true;
+    });
+    for (SearchServer* server : { &loaded, &added }) {
+        const size_t storage_before = server->GetTermStorageCapacity();
+        vector<int> visited;
+        for (const int id : *server) {
+            visited.push_back(id);
+            if (id % 3 != 0) {
+                server->RemoveDocument(id);
+            }
+        }
+        ASSERT_EQUAL(visited.size(), 3000u);
+        ASSERT(is_sorted(visited.begin(), visited.end()));
+        ASSERT_EQUAL(server->GetDocumentCount(), 1000);
+        ASSERT_EQUAL(server->GetVocabularySize(), 3001u);
+        server->Compact();
+        ASSERT_EQUAL(vector<int>(server->begin(), server->end()).size(), 1000u);
+        ASSERT_EQUAL(*server->begin(), 0);
+        ASSERT_EQUAL(server->GetVocabularySize(), 1001u);
+        ASSERT(server == &loaded || server->GetTermStorageCapacity() <= storage_before);
+        ASSERT(server->FindTopDocuments("слово1"s).empty());
+        ASSERT_EQUAL(server->FindTopDocuments("слово2997"s).size(), 1u);
+        // строки берутся уже после уплотнения и указывают в новый словарь
+        vector<string> words;
+        for (const auto& [word, frequency] : server->GetWordFrequencies(2997)) {
+            words.push_back(string(word));
+        }
+        ASSERT(words == vector<string>({ "кот"s, "слово2997"s }));
+    }
+    filesystem::remove(path);
+
+    // после удаления всех документов с уникальными словами уплотнение возвращает их память
+    SearchServer unique_words("и"s);
+    for (int id = 0; id < 20000; ++id) {
+        unique_words.AddDocument(id, "слово"s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+    }
+    ASSERT(unique_words.GetTermStorageCapacity() > 64 * 1024);
+    unique_words.RemoveDocuments(vector<int>(unique_words.begin(), unique_words.end()));
+    unique_words.Compact();
+    ASSERT_EQUAL(unique_words.GetVocabularySize(), 0u);
+    ASSERT_EQUAL(unique_words.GetTermStorageCapacity(), 0u);
+    filesystem::remove(path);
+}
+
+void TestNearDuplicates() {
+    SearchServer server("и в на"s);
+    const vector<string> words = { "кот"s, "пёс"s, "хвост"s, "ошейник"s, "белый"s, "пушистый"s, "скворец"s,
+        "глаза"s, "модный"s, "ухоженный"s, "выразительные"s, "чёрный"s };
+    // документы 100+k повторяют набор слов документа k в другом порядке и с другими стоп-словами
+    for (int id = 0; id < 12; ++id) {
+        string text;
+        string reversed;
+        for (int i = 0; i < 10; ++i) {
+            const string word = words[(id + i) % words.size()] + to_string(id);
+            text += word + " "s;
+            reversed = word + " и "s + reversed;
+        }
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+        server.AddDocument(100 + id, reversed + words[id % words.size()] + to_string(id), DocumentStatus::ACTUAL, { 2 });
+    }
+    server.AddDocument(50, "и в на"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(40, "на"s, DocumentStatus::ACTUAL, { 1 });
+    // отличается от документа 0 одним словом из десяти: сходство 9/11
+    server.AddDocument(200, "кот0 пёс0 хвост0 ошейник0 белый0 пушистый0 скворец0 глаза0 модный0 лапа0"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(201, "кот0 пёс0 хвост0"s, DocumentStatus::ACTUAL, { 1 });
+
+    vector<int> exact = { 50 };
+    for (int id = 100; id < 112; ++id) {
+        exact.push_back(id);
+    }
+    ASSERT_EQUAL(FindDuplicates(server), exact);
+
+    auto near = exact;
+    near.push_back(200);
+    ASSERT_EQUAL(FindNearDuplicates(server), near);
+    NearDuplicateOptions strict;
+    strict.jaccard_threshold = 0.9;
+    ASSERT_EQUAL(FindNearDuplicates(server, strict), exact);
+
+    ASSERT_EQUAL(RemoveNearDuplicates(server), near);
+    ASSERT_EQUAL(server.GetDocumentCount(), 14);
+    ASSERT(FindDuplicates(server).empty());
+    ASSERT(FindNearDuplicates(server).empty());
+}
+
+void TestIncrementalDuplicates() {
+    SearchServer server("и в на"s);
+    ASSERT(!server.AddDocument(5, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 1 }, DuplicatePolicy::REJECT));
+    ASSERT(!server.AddDocument(3, "пушистый кот"s, DocumentStatus::ACTUAL, { 1 }, DuplicatePolicy::ADD));
+    // тот же набор слов в другом порядке, с повторами и стоп-словами
+    ASSERT(server.AddDocument(8, "ошейник модный кот в белый кот"s, DocumentStatus::ACTUAL, { 2 }, DuplicatePolicy::ADD) == 5);
+    ASSERT(server.AddDocument(2, "модный белый ошейник кот"s, DocumentStatus::ACTUAL, { 2 }, DuplicatePolicy::REJECT) == 5);
+    ASSERT(!server.ContainsDocument(2));
+    ASSERT_EQUAL(server.GetDocumentCount(), 3);
+    // отвергнутый дубликат не добавляет слов в словарь и не меняет индекс
+    const size_t vocabulary_size = server.GetVocabularySize();
+    const uint64_t generation = server.GetGeneration();
+    ASSERT(server.AddDocument(7, "кот пушистый пушистый"s, DocumentStatus::ACTUAL, { 2 }, DuplicatePolicy::REJECT) == 3);
+    ASSERT_EQUAL(server.GetVocabularySize(), vocabulary_size);
+    ASSERT_EQUAL(server.GetGeneration(), generation);
+    // новое слово исключает дубликат, документ добавляется вместе со словом
+    ASSERT(!server.AddDocument(7, "кот пушистый скворец"s, DocumentStatus::ACTUAL, { 2 }, DuplicatePolicy::REJECT));
+    ASSERT_EQUAL(server.GetVocabularySize(), vocabulary_size + 1);
+    server.RemoveDocument(7);
+    // подмножество слов дубликатом не считается
+    ASSERT(!server.AddDocument(9, "белый кот"s, DocumentStatus::ACTUAL, { 1 }, DuplicatePolicy::REJECT));
+    ASSERT_EQUAL(server.GetDuplicateIds(), vector<int>({ 8 }));
+
+    // после удаления оригинала остаётся самый маленький id из совпавших
+    server.RemoveDocument(5);
+    ASSERT(server.AddDocument(1, "кот белый модный ошейник"s, DocumentStatus::ACTUAL, { 1 }, DuplicatePolicy::ADD) == 8);
+    ASSERT_EQUAL(server.GetDuplicateIds(), vector<int>({ 8 }));
+    server.RemoveDocument(8);
+    ASSERT(server.GetDuplicateIds().empty());
+
+    // сжатие индекса меняет номера слов, таблица отпечатков строится заново
+    for (int id = 100; id < 3100; ++id) {
+        server.AddDocument(id, "слово"s + to_string(id % 1500), DocumentStatus::ACTUAL, { 1 });
+    }
+    vector<int> expected;
+    for (int id = 1600; id < 3100; ++id) {
+        expected.push_back(id);
+    }
+    ASSERT_EQUAL(server.GetDuplicateIds(), expected);
+    vector<int> removed;
+    // удалённых становится больше, чем живых
+    for (int id = 100; id <= 1600; ++id) {
+        removed.push_back(id);
+    }
+    server.RemoveDocuments(removed);
+    ASSERT(server.GetDuplicateIds().empty());
+    ASSERT(server.AddDocument(4, "слово200"s, DocumentStatus::ACTUAL, { 1 }, DuplicatePolicy::REJECT) == 1700);
+    ASSERT_EQUAL(RemoveDuplicates(server), vector<int>());
+
+    // таблица переживает снимок и копирование
+    server.AddDocument(4000, "пушистый кот"s, DocumentStatus::ACTUAL, { 1 });
+    const string path = (filesystem::temp_directory_path() / "search_server_duplicates.snapshot"s).string();
+    server.SaveSnapshot(path);
+    SearchServer loaded = SearchServer::LoadSnapshot(path);
+    filesystem::remove(path);
+    ASSERT_EQUAL(loaded.GetDuplicateIds(), vector<int>({ 4000 }));
+    ASSERT(loaded.AddDocument(4001, "кот пушистый"s, DocumentStatus::ACTUAL, { 1 }, DuplicatePolicy::REJECT) == 3);
+    SearchServer copy = loaded;
+    copy.RemoveDocument(3);
+    ASSERT(copy.GetDuplicateIds().empty());
+    ASSERT_EQUAL(RemoveDuplicates(loaded), vector<int>({ 4000 }));
+}
+
+void TestTrace() {
+    LatencyHistogram histogram;
+    ASSERT_EQUAL(histogram.GetValueAtQuantile(0.5), 0u);
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        histogram.Record(value);
+    }
+    ASSERT_EQUAL(histogram.GetCount(), 1000u);
+    ASSERT_EQUAL(histogram.GetMax(), 1000u);
+    ASSERT_EQUAL(histogram.GetValueAtQuantile(0.01), 10u);
+    ASSERT_EQUAL(histogram.GetValueAtQuantile(1.0), 1000u);
+    // большие значения округляются вверх не больше чем на 1/32
+    const uint64_t median = histogram.GetValueAtQuantile(0.5);
+    ASSERT(median >= 500 && median <= 500 + 500 / 32);
+    const uint64_t p99 = histogram.GetValueAtQuantile(0.99);
+    ASSERT(p99 >= 990 && p99 <= 990 + 990 / 32);
+
+    LatencyHistogram large;
+    large.Record(uint64_t{ 1 } << 62);
+    large.Record(numeric_limits<uint64_t>::max());
+    histogram.Merge(large);
+    ASSERT_EQUAL(histogram.GetCount(), 1002u);
+    ASSERT_EQUAL(histogram.GetValueAtQuantile(1.0), numeric_limits<uint64_t>::max());
+    histogram.Reset();
+    ASSERT_EQUAL(histogram.GetCount(), 0u);
+
+    // вложенные этапы записываются с глубиной в буфер своего потока
+    Tracer::Reset();
+    thread([] {
+        TraceScope query(TraceSpan::QUERY);
+        {
+            TraceScope parse(TraceSpan::PARSE);
+        }
+        TraceScope scan(TraceSpan::POSTING_SCAN);
+    }).join();
+    vector<Tracer::Event> events;
+    for (const Tracer::Event& event : Tracer::GetRecentEvents()) {
+        if (event.span == TraceSpan::QUERY || event.span == TraceSpan::PARSE || event.span == TraceSpan::POSTING_SCAN) {
+            events.push_back(event);
+        }
+    }
+    ASSERT_EQUAL(events.size(), 3u);
+    ASSERT(events[0].span == TraceSpan::PARSE && events[0].depth == 1);
+    ASSERT(events[1].span == TraceSpan::POSTING_SCAN && events[1].depth == 1);
+    ASSERT(events[2].span == TraceSpan::QUERY && events[2].depth == 0);
+    ASSERT(events[2].start_ns <= events[0].start_ns && events[0].start_ns <= events[1].start_ns);
+    ASSERT(events[2].duration_ns >= events[0].duration_ns + events[1].duration_ns);
+
+    LatencyHistogram parse;
+    Tracer::MergeHistogram(TraceSpan::PARSE, parse);
+    ASSERT_EQUAL(parse.GetCount(), 1u);
+    ostringstream dump;
+    Tracer::Dump(dump);
+    ASSERT(dump.str().find("PARSE: 1 spans"s) != string::npos);
+    ASSERT_EQUAL(GetTraceSpanName(TraceSpan::TOP_K), "TOP_K"sv);
+
+    // без SEARCH_SERVER_TRACING макрос ничего не записывает
+    {
+        TRACE_SPAN(SERIALIZE);
+    }
+    LatencyHistogram serialize;
+    Tracer::MergeHistogram(TraceSpan::SERIALIZE, serialize);
+#ifdef SEARCH_SERVER_TRACING
+    ASSERT(serialize.GetCount() >= 1);
+#else
+    ASSERT_EQUAL(serialize.GetCount(), 0u);
+#endif
+}
+
+void TestQueryStats() {
+    SearchServer server("и"s);
+    server.AddDocument(1, "белый кот"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "белый пёс"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "пушистый кот и пёс"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "белый скворец"s, DocumentStatus::BANNED, { 4 });
+
+    QueryContext context;
+    context.EnableStats(true);
+    // "хвост" нет в индексе, стоп-слова не считаются
+    const auto& found = server.FindTopDocuments(context, "белый кот хвост и -пушистый"s);
+    ASSERT_EQUAL(found.size(), 2u);
+    const QueryStats& stats = context.GetStats();
+    ASSERT_EQUAL(stats.plus_terms, 2u);
+    ASSERT_EQUAL(stats.minus_terms, 1u);
+    // белый: 1, 2, 4; кот: 1, 3; пушистый: 3
+    ASSERT_EQUAL(stats.postings_scanned, 6u);
+    ASSERT_EQUAL(stats.minus_rejections, 1u);
+    ASSERT_EQUAL(stats.predicate_rejections, 1u);
+    ASSERT_EQUAL(stats.candidates, 2u);
+    ASSERT(stats.GetTotalTime() > chrono::nanoseconds(0));
+    ASSERT(stats.GetTotalTime() == stats.parse_time + stats.minus_filter_time + stats.scan_time + stats.top_k_time);
+
+    // следующий запрос начинает счёт заново
+    server.FindTopDocuments(context, "скворец"s);
+    ASSERT_EQUAL(context.GetStats().postings_scanned, 1u);
+    ASSERT_EQUAL(context.GetStats().predicate_rejections, 1u);
+    ASSERT_EQUAL(context.GetStats().candidates, 0u);
+
+    QueryStats match_stats;
+    // найденные слова указывают в текст запроса
+    const string match_query = "кот пёс хвост"s;
+    const auto [words, status] = server.MatchDocument(match_query, 3, match_stats);
+    ASSERT_EQUAL(words, vector<string_view>({ "кот"sv, "пёс"sv }));
+    ASSERT_EQUAL(match_stats.plus_terms, 2u);
+    ASSERT_EQUAL(match_stats.postings_scanned, 2u);
+    ASSERT_EQUAL(match_stats.candidates, 1u);
+    server.MatchDocument("кот -пушистый -белый"s, 3, match_stats);
+    ASSERT_EQUAL(match_stats.minus_rejections, 1u);
+    ASSERT_EQUAL(match_stats.candidates, 0u);
+
+    // окно RequestQueue складывает статистику последних 1440 запросов
+    RequestQueue request_queue(server);
+    const auto expected = server.FindTopDocuments("кот"s);
+    for (int i = 0; i < 1440; ++i) {
+        const auto found = request_queue.AddFindRequest("кот"s);
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t j = 0; j < found.size(); ++j) {
+            ASSERT_EQUAL(found[j].id, expected[j].id);
+        }
+    }
+    ASSERT_EQUAL(request_queue.GetWindowStats().plus_terms, 1440u);
+    ASSERT_EQUAL(request_queue.GetWindowStats().candidates, 2880u);
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQUAL(request_queue.AddFindRequest("белый пёс"s, DocumentStatus::BANNED).size(), 1u);
+    }
+    const QueryStats& window = request_queue.GetWindowStats();
+    ASSERT_EQUAL(window.plus_terms, 1430u + 20u);
+    ASSERT_EQUAL(window.postings_scanned, 1430u * 2 + 10u * 5);
+    ASSERT_EQUAL(window.predicate_rejections, 10u * 4);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 0);
+    request_queue.AddRequest(0);
+    ASSERT_EQUAL(request_queue.GetWindowStats().plus_terms, 1429u + 20u);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1);
+
+    const auto slowest = request_queue.GetSlowestRequests(3);
+    ASSERT_EQUAL(slowest.size(), 3u);
+    ASSERT(slowest[0].second.GetTotalTime() >= slowest[1].second.GetTotalTime());
+    ASSERT(slowest[1].second.GetTotalTime() >= slowest[2].second.GetTotalTime());
+    ASSERT_EQUAL(request_queue.GetSlowestRequests(5000).size(), 1440u);
+}
+
+void TestBenchmarkSuite() {
+    CorpusOptions options;
+    options.name = "test"s;
+    options.document_count = 400;
+    options.vocabulary_size = 500;
+    options.query_count = 20;
+    options.duplicate_share = 0.1;
+    // корпус определяется параметрами
+    const Corpus corpus = GenerateCorpus(options);
+    ASSERT_EQUAL(corpus.documents.size(), 400u);
+    ASSERT_EQUAL(corpus.queries.size(), 20u);
+    ASSERT(GenerateCorpus(options).documents == corpus.documents);
+    ASSERT(GenerateCorpus(options).queries == corpus.queries);
+    CorpusOptions other_seed = options;
+    other_seed.seed = 2;
+    ASSERT(GenerateCorpus(other_seed).documents != corpus.documents);
+    for (const string& document : corpus.documents) {
+        const auto word_count = count(document.begin(), document.end(), ' ') + 1;
+        ASSERT(word_count >= options.min_document_words && word_count <= options.max_document_words);
+    }
+
+    // повторы документов находятся как дубликаты
+    SearchServer server(corpus.stop_words);
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        server.AddDocument(i, corpus.documents[i], DocumentStatus::ACTUAL, corpus.ratings[i]);
+    }
+    const size_t duplicate_count = FindDuplicates(server).size();
+    ASSERT(duplicate_count >= 20u && duplicate_count <= 60u);
+
+    // по закону Ципфа самое частое слово после стоп-слов встречается намного чаще, чем при равномерном выборе
+    CorpusOptions zipf = options;
+    zipf.zipf_exponent = 1.0;
+    const string& frequent_word = corpus.vocabulary[options.stop_word_count];
+    const auto count_word = [&frequent_word](const Corpus& corpus) {
+        size_t count = 0;
+        for (const string& document : corpus.documents) {
+            count += (" "s + document + " "s).find(" "s + frequent_word + " "s) != string::npos;
+        }
+        return count;
+    };
+    ASSERT(count_word(GenerateCorpus(zipf)) > 3 * count_word(corpus));
+
+    BenchmarkOptions benchmark_options;
+    benchmark_options.corpora = { options, zipf };
+    benchmark_options.corpora[1].name = "zipf"s;
+    benchmark_options.repetitions = 1;
+    ostringstream log;
+    const BenchmarkReport report = RunBenchmarks(benchmark_options, log);
+    ASSERT_EQUAL(report.results.size(), 2 * 17u);
+    for (const BenchmarkResult& result : report.results) {
+        ASSERT_HINT(result.items > 0 && result.seconds > 0 && result.p50_ns <= result.p99_ns, result.name);
+        ASSERT_HINT(log.str().find(result.name) != string::npos, result.name);
+        if (result.name == "test/find_top_context"s) {
+            ASSERT_EQUAL(result.allocations_per_operation, 0.0);
+        }
+        if (result.name == "test/ingest"s) {
+            ASSERT(result.allocations_per_operation > 0);
+        }
+    }
+
+    // отчёт читается из JSON без потерь
+    stringstream json;
+    WriteBenchmarkReport(json, report);
+    const BenchmarkReport read = ReadBenchmarkReport(json);
+    ASSERT(read.corpora == report.corpora);
+    ASSERT_EQUAL(read.results.size(), report.results.size());
+    for (size_t i = 0; i < read.results.size(); ++i) {
+        ASSERT_EQUAL(read.results[i].name, report.results[i].name);
+        ASSERT_EQUAL(read.results[i].items, report.results[i].items);
+        ASSERT_EQUAL(read.results[i].seconds, report.results[i].seconds);
+        ASSERT_EQUAL(read.results[i].p99_ns, report.results[i].p99_ns);
+        ASSERT_EQUAL(read.results[i].allocations_per_operation, report.results[i].allocations_per_operation);
+    }
+    ASSERT(FindRegressions(read, report, 10).empty());
+
+    // ухудшения в пределах порога не считаются
+    BenchmarkReport current = report;
+    current.results[0].seconds *= 1.05;
+    current.results[0].p50_ns = current.results[0].p50_ns * 105 / 100;
+    current.results[1].seconds *= 2;
+    current.results[4].peak_rss_kib *= 2;
+    current.results[7].allocations_per_operation = 1;
+    current.results.push_back({ "new"s, 1, 1, 1.0 });
+    const auto regressions = FindRegressions(report, current, 10);
+    ASSERT_EQUAL(regressions.size(), 3u);
+    ASSERT_EQUAL(regressions[0].name, report.results[1].name);
+    ASSERT_EQUAL(regressions[0].metric, "throughput"s);
+    ASSERT_EQUAL(regressions[0].current * 2, regressions[0].baseline);
+    ASSERT_EQUAL(regressions[1].metric, "peak_rss_kib"s);
+    ASSERT_EQUAL(regressions[2].name, "test/find_top_context"s);
+    ASSERT_EQUAL(regressions[2].metric, "allocations_per_operation"s);
+    ASSERT_EQUAL(FindRegressions(report, current, 150).size(), 1u);
+
+    // числа разных корпусов несравнимы
+    current.corpora[0].seed = 2;
+    try {
+        FindRegressions(report, current, 10);
+        ASSERT_HINT(false, "Baseline of another corpus must be rejected"s);
+    }
+    catch (const invalid_argument&) {
+    }
+    for (const string& malformed : { ""s, "{"s, "[]"s, "{\"corpora\": []}"s, "{\"corpora\": [], \"results\": [{}]}"s }) {
+        try {
+            istringstream in(malformed);
+            ReadBenchmarkReport(in);
+            ASSERT_HINT(false, "Malformed report must be rejected: "s + malformed);
+        }
+        catch (const invalid_argument&) {
+        }
+    }
+}
+
+void TestPaginator() {
+    vector<Document> documents;
+    for (int i = 0; i < 10; ++i) {
+        documents.push_back({ i, i * 0.1234567, i - 5 });
+    }
+    documents.push_back({ 10, 1e-7, 0 });
+    documents.push_back({ 11, 12345678.9, 1 });
+    const auto pages = Paginate(documents, 5);
+    ASSERT_EQUAL(pages.size(), 3u);
+    ASSERT(!pages.empty());
+    ASSERT_EQUAL(pages.end() - pages.begin(), 3);
+    // страницы указывают в исходный массив
+    ASSERT(&*pages[1].begin() == &documents[5]);
+    ASSERT_EQUAL(pages.page(2).size(), 2u);
+    ASSERT(&*pages.page(2).begin() == &documents[10]);
+    ASSERT(pages.page(2).end() == documents.end());
+    try {
+        pages.page(3);
+        ASSERT_HINT(false, "Page past the end must be rejected"s);
+    }
+    catch (const out_of_range&) {
+    }
+
+    size_t page_count = 0;
+    size_t document_count = 0;
+    for (const auto page : pages) {
+        ++page_count;
+        document_count += page.size();
+    }
+    ASSERT_EQUAL(page_count, 3u);
+    ASSERT_EQUAL(document_count, documents.size());
+    auto it = pages.begin();
+    it += 2;
+    ASSERT_EQUAL((*it).size(), 2u);
+    ASSERT_EQUAL((*--it).size(), 5u);
+    ASSERT(it[1].begin() == pages[2].begin());
+    ASSERT(pages.begin() < it && it + 2 == pages.end());
+
+    ASSERT_EQUAL(Paginate(vector<Document>(), 3).size(), 0u);
+    ASSERT(Paginate(vector<Document>(), 3).empty());
+    ASSERT_EQUAL(Paginate(documents, 100).size(), 1u);
+    ASSERT_EQUAL(Paginate(documents, 1).size(), documents.size());
+
+    // в буфер пишется тот же текст, что и в поток, и без выделений памяти, если его хватает
+    ostringstream out;
+    string buffer;
+    for (const auto page : pages) {
+        out << page;
+        AppendPage(buffer, page);
+    }
+    ASSERT_EQUAL(buffer, out.str());
+    buffer.clear();
+    uint64_t allocation_count = 0;
+    {
+        AllocationCounter allocations;
+        const auto lazy_pages = Paginate(documents, 2);
+        for (size_t i = 0; i < lazy_pages.size(); ++i) {
+            AppendPage(buffer, lazy_pages.page(i));
+        }
+        allocation_count = allocations.GetCount();
+    }
+    ASSERT_EQUAL(allocation_count, 0u);
+    ASSERT_EQUAL(buffer, out.str());
+}
+
+void TestDocumentLoader() {
+    mt19937 generator(31);
+    const vector<string> dictionary = { "кот"s, "пёс"s, "хвост"s, "ошейник"s, "белый"s, "пушистый"s, "скворец"s, "и"s };
+    SearchServer expected("и"s);
+    string input;
+    vector<NewDocument> first_half;
+    vector<NewDocument> second_half;
+    vector<string> texts;
+    for (int i = 0; i < 2000; ++i) {
+        string text;
+        for (int j = uniform_int_distribution(1, 10)(generator); j > 0; --j) {
+            text += (text.empty() ? ""s : " "s) + dictionary[uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)];
+        }
+        texts.push_back(text);
+    }
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        const DocumentStatus status = static_cast<DocumentStatus>(i % 4);
+        const vector<int> ratings = i % 5 ? vector<int>{ i % 11, -4 } : vector<int>{};
+        expected.AddDocument(i * 2, texts[i], status, ratings);
+        AppendDocumentLine(input, i * 2, status, ratings, texts[i]);
+        (i < 1000 ? first_half : second_half).push_back({ i * 2, texts[i], status, ratings });
+        // пустые строки и переводы строк Windows пропускаются
+        if (i % 100 == 0) {
+            input.back() = '\r';
+            input += "\n\n"s;
+        }
+    }
+    ASSERT_EQUAL(input.substr(0, input.find('\n')), "0\tACTUAL\t\t"s + texts[0] + "\r"s);
+
+    const auto assert_same_index = [&expected](const SearchServer& server) {
+        ASSERT_EQUAL(server.GetDocumentCount(), expected.GetDocumentCount());
+        ASSERT(equal(server.begin(), server.end(), expected.begin(), expected.end()));
+        for (const string& query : { "кот"s, "пёс -хвост"s, "белый пушистый скворец"s }) {
+            for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                const auto found = server.FindTopDocuments(query, status, 50);
+                const auto expected_found = expected.FindTopDocuments(query, status, 50);
+                ASSERT_EQUAL(found.size(), expected_found.size());
+                for (size_t i = 0; i < found.size(); ++i) {
+                    ASSERT_EQUAL(found[i].id, expected_found[i].id);
+                    ASSERT_EQUAL(found[i].rating, expected_found[i].rating);
+                }
+            }
+        }
+        for (const int id : expected) {
+            ASSERT_EQUAL(server.GetWordFrequencies(id), expected.GetWordFrequencies(id));
+        }
+    };
+
+    // токенизация отдельно от добавления
+    {
+        SearchServer server("и"s);
+        auto first = server.TokenizeDocuments(first_half);
+        auto second = server.TokenizeDocuments(second_half);
+        ASSERT_EQUAL(second.GetDocuments().size(), 1000u);
+        server.AddTokenizedDocuments(move(first));
+        server.AddTokenizedDocuments(move(second));
+        assert_same_index(server);
+        try {
+            server.AddTokenizedDocuments(server.TokenizeDocuments({ { 0, "кот"sv, DocumentStatus::ACTUAL, {} } }));
+            ASSERT_HINT(false, "Repeated id must be rejected"s);
+        }
+        catch (const invalid_argument&) {
+        }
+        try {
+            server.TokenizeDocuments({ { 5001, "к\x12от"sv, DocumentStatus::ACTUAL, {} } });
+            ASSERT_HINT(false, "Invalid word must be rejected"s);
+        }
+        catch (const invalid_argument&) {
+        }
+        ASSERT_EQUAL(server.GetDocumentCount(), 2000);
+    }
+
+    const string path = (filesystem::temp_directory_path() / "search_server_test_documents.tsv"s).string();
+    {
+        ofstream out(path, ios::binary);
+        // последняя строка без перевода строки
+        out << input.substr(0, input.size() - 1);
+    }
+    // блоки меньше строки: читатель дочитывает строку целиком
+    for (const size_t block_size : { size_t{ 7 }, size_t{ 1000 }, size_t{ 1 } << 20 }) {
+        DocumentLoadOptions options;
+        options.block_size = block_size;
+        options.tokenizer_count = 3;
+        options.queue_capacity = 2;
+        SearchServer from_file("и"s);
+        const DocumentLoadStats file_stats = LoadDocuments(from_file, path, options);
+        ASSERT_EQUAL(file_stats.documents, 2000u);
+        ASSERT_EQUAL(file_stats.bytes, input.size() - 1);
+        ASSERT(file_stats.blocks >= 1 && file_stats.blocks <= input.size() / min(block_size, input.size()) + 1);
+        assert_same_index(from_file);
+
+        SearchServer from_stream("и"s);
+        istringstream stream(input);
+        const DocumentLoadStats stream_stats = LoadDocuments(from_stream, stream, options);
+        ASSERT_EQUAL(stream_stats.documents, 2000u);
+        ASSERT_EQUAL(stream_stats.bytes, input.size());
+        assert_same_index(from_stream);
+    }
+    filesystem::remove(path);
+
+    try {
+        SearchServer server("и"s);
+        LoadDocuments(server, path);
+        ASSERT_HINT(false, "Missing file must be reported"s);
+    }
+    catch (const DocumentLoadError&) {
+    }
+    // ошибка сообщает смещение строки; блоки до неё остаются в индексе
+    for (const string& bad_line : { "7\tACTUAL\t1 2\n"s, "x\tACTUAL\t\tкот\n"s, "7\tGOOD\t\tкот\n"s,
+        "7\tACTUAL\t1 x\tкот\n"s, "7\tACTUAL\t\tк\x12от\n"s, "0\tACTUAL\t\tкот\n"s }) {
+        DocumentLoadOptions options;
+        options.block_size = 64;
+        SearchServer server("и"s);
+        istringstream stream(input + bad_line + input);
+        try {
+            LoadDocuments(server, stream, options);
+            ASSERT_HINT(false, "Malformed line must be rejected: "s + bad_line);
+        }
+        catch (const invalid_argument& error) {
+            ASSERT_HINT(string(error.what()).find("byte "s) != string::npos, error.what());
+        }
+        ASSERT(server.GetDocumentCount() <= 2000);
+    }
+}
+
+void TestBoundedQueuePush() {
+    BoundedQueue<int> queue(2);
+    ASSERT(queue.Push(1));
+    ASSERT(queue.Push(2));
+    ASSERT(!queue.TryPush(3));
+    // полная очередь задерживает Push до освобождения места
+    atomic<bool> pushed = false;
+    thread producer([&] {
+        pushed = queue.Push(3);
+    });
+    this_thread::sleep_for(chrono::milliseconds(20));
+    ASSERT(!pushed);
+    int value = 0;
+    ASSERT(queue.Pop(value) && value == 1);
+    producer.join();
+    ASSERT(pushed);
+    // закрытие будит ожидающих производителей
+    thread rejected([&] {
+        pushed = queue.Push(4);
+    });
+    this_thread::sleep_for(chrono::milliseconds(20));
+    queue.Close();
+    rejected.join();
+    ASSERT(!pushed);
+    ASSERT(queue.Pop(value) && value == 2);
+    ASSERT(queue.Pop(value) && value == 3);
+    ASSERT(!queue.Pop(value));
+}
+
 void TestSearchServer() {
     RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
     RUN_TEST(TestMinusWords);
@@ -391,4 +2141,29 @@ void TestSearchServer() {
     RUN_TEST(TestIDF_TF);
     RUN_TEST(TestSearch);
     RUN_TEST(TestDocumentCount);
+    RUN_TEST(TestWordFrequencies);
+    RUN_TEST(TestPostingList);
+    RUN_TEST(TestDocumentIds);
+    RUN_TEST(TestTopDocuments);
+    RUN_TEST(TestParallelSearch);
+    RUN_TEST(TestDocumentAtATimeSearch);
+    RUN_TEST(TestSnapshot);
+    RUN_TEST(TestAddDocuments);
+    RUN_TEST(TestSplitIntoWords);
+    RUN_TEST(TestStopWords);
+    RUN_TEST(TestQueryContext);
+    RUN_TEST(TestQueryCache);
+    RUN_TEST(TestQueryExecutor);
+    RUN_TEST(TestQueryDispatcher);
+    RUN_TEST(TestVersionedSearchServer);
+    RUN_TEST(TestSegmentedSearchServer);
+    RUN_TEST(TestRemoveDocuments);
+    RUN_TEST(TestNearDuplicates);
+    RUN_TEST(TestIncrementalDuplicates);
+    RUN_TEST(TestTrace);
+    RUN_TEST(TestQueryStats);
+    RUN_TEST(TestBenchmarkSuite);
+    RUN_TEST(TestPaginator);
+    RUN_TEST(TestDocumentLoader);
+    RUN_TEST(TestBoundedQueuePush);
 }
\ No newline at end of file
@@ -105,4 +105,54 @@ void TestSearch();
 
 void TestDocumentCount();
 
+void TestWordFrequencies();
+
+void TestPostingList();
+
+void TestDocumentIds();
+
+void TestTopDocuments();
+
+void TestParallelSearch();
+
+void TestDocumentAtATimeSearch();
+
+void TestSnapshot();
+
+void TestAddDocuments();
+
+void TestSplitIntoWords();
+
+void TestStopWords();
+
+void TestQueryContext();
+
+void TestQueryCache();
+
+void TestQueryExecutor();
+
+void TestQueryDispatcher();
+
+void TestVersionedSearchServer();
+
+void TestSegmentedSearchServer();
+
+void TestRemoveDocuments();
+
+void TestNearDuplicates();
+
+void TestIncrementalDuplicates();
+
+void TestTrace();
+
+void TestQueryStats();
+
+void TestBenchmarkSuite();
+
+void TestPaginator();
+
+void TestDocumentLoader();
+
+void TestBoundedQueuePush();
+
 void TestSearchServer();
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "top_documents.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (abs(lhs.relevance - rhs.relevance) < ACCURACY) {
+        return lhs.rating > rhs.rating || (lhs.rating == rhs.rating && lhs.id < rhs.id);
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+TopDocuments::TopDocuments(size_t max_count)
+    : max_count_(max_count) {
+    heap_.reserve(max_count);
+}
+
+void TopDocuments::Add(const Document& document) {
+    // the heap front is the least relevant kept document
+    if (heap_.size() < max_count_) {
+        heap_.push_back(document);
+        push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+    else if (max_count_ > 0 && IsMoreRelevant(document, heap_.front())) {
+        pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+}
+
+void TopDocuments::Merge(const TopDocuments& other) {
+    for (const Document& document : other.heap_) {
+        Add(document);
+    }
+}
+
+size_t TopDocuments::size() const {
+    return heap_.size();
+}
+
+bool TopDocuments::IsFull() const {
+    return heap_.size() == max_count_;
+}
+
+const Document& TopDocuments::GetWorst() const {
+    return heap_.front();
+}
+
+vector<Document> TopDocuments::Extract() {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    vector<Document> result = move(heap_);
+    heap_.clear();
+    return result;
+}
+
+void TopDocuments::ExtractTo(vector<Document>& result) {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    result.assign(heap_.begin(), heap_.end());
+    heap_.clear();
+}
+
+void TopDocuments::Reset(size_t max_count) {
+    heap_.clear();
+    max_count_ = max_count;
+    heap_.reserve(max_count);
+}
+
+vector<Document> SelectTopDocuments(const vector<Document>& documents, size_t max_count) {
+    TopDocuments top(max_count);
+    for (const Document& document : documents) {
+        top.Add(document);
+    }
+    return top.Extract();
+}
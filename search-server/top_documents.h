@@ -0,0 +1,73 @@
+#pragma once
+
+#include "document.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <execution>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+const int MAX_RESULT_DOCUMENT_COUNT = 5;
+const double ACCURACY = 1e-6;
+
+// Result order: higher relevance first; relevances closer than ACCURACY are
+// ordered by rating, and equal ratings by ascending id so the order is deterministic
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+// Keeps the max_count most relevant documents seen so far in a bounded heap
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t max_count);
+
+    void Add(const Document& document);
+    void Merge(const TopDocuments& other);
+
+    size_t size() const;
+    bool IsFull() const;
+    // The least relevant kept document, only valid when not empty
+    const Document& GetWorst() const;
+
+    // Returns kept documents sorted by IsMoreRelevant and leaves the heap empty
+    std::vector<Document> Extract();
+    // Same as Extract, but fills the caller's vector so both keep their storage
+    void ExtractTo(std::vector<Document>& result);
+
+    // Empties the heap and sets a new bound without releasing the storage
+    void Reset(size_t max_count);
+
+private:
+    size_t max_count_;
+    std::vector<Document> heap_;
+};
+
+std::vector<Document> SelectTopDocuments(const std::vector<Document>& documents, size_t max_count);
+
+// Every chunk of the input is reduced into its own heap, the heaps are merged at the end
+template <typename Policy>
+std::vector<Document> SelectTopDocuments(Policy& policy, const std::vector<Document>& documents, size_t max_count) {
+    const size_t chunk_count = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(),
+        documents.size() / std::max<size_t>(max_count * 4, 1024)));
+    if (chunk_count == 1) {
+        return SelectTopDocuments(documents, max_count);
+    }
+    std::vector<TopDocuments> chunk_tops(chunk_count, TopDocuments(max_count));
+    std::vector<size_t> chunks(chunk_count);
+    std::iota(chunks.begin(), chunks.end(), 0);
+    std::for_each(
+        policy,
+        chunks.begin(), chunks.end(),
+        [&documents, &chunk_tops, chunk_count](size_t chunk) {
+            const size_t begin = documents.size() * chunk / chunk_count;
+            const size_t end = documents.size() * (chunk + 1) / chunk_count;
+            for (size_t i = begin; i < end; ++i) {
+                chunk_tops[chunk].Add(documents[i]);
+            }
+        }
+    );
+    for (size_t chunk = 1; chunk < chunk_count; ++chunk) {
+        chunk_tops[0].Merge(chunk_tops[chunk]);
+    }
+    return chunk_tops[0].Extract();
+}
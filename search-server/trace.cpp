@@ -0,0 +1,183 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+namespace {
+
+const array<string_view, static_cast<size_t>(TraceSpan::COUNT)> SPAN_NAMES = {
+    "QUERY"sv, "PARSE"sv, "MINUS_FILTER"sv, "POSTING_SCAN"sv, "COLLECT"sv, "TOP_K"sv, "SERIALIZE"sv,
+};
+
+// Owner-only counters: a relaxed load and store is enough and avoids a locked add
+void Increment(atomic<uint64_t>& counter, uint64_t delta = 1) {
+    counter.store(counter.load(memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+struct ThreadTrace {
+    // an event is kept as its start and duration << 16 | depth << 8 | span
+    array<atomic<uint64_t>, Tracer::RING_CAPACITY> starts{};
+    array<atomic<uint64_t>, Tracer::RING_CAPACITY> packed{};
+    atomic<uint64_t> event_count{ 0 };
+    array<LatencyHistogram, static_cast<size_t>(TraceSpan::COUNT)> histograms;
+    uint32_t depth = 0;
+};
+
+mutex registry_mutex;
+vector<shared_ptr<ThreadTrace>> registry;
+
+ThreadTrace& GetThreadTrace() {
+    thread_local const shared_ptr<ThreadTrace> trace = [] {
+        auto created = make_shared<ThreadTrace>();
+        lock_guard guard(registry_mutex);
+        registry.push_back(created);
+        return created;
+    }();
+    return *trace;
+}
+
+} // namespace
+
+string_view GetTraceSpanName(TraceSpan span) {
+    return SPAN_NAMES.at(static_cast<size_t>(span));
+}
+
+void LatencyHistogram::Record(uint64_t nanoseconds) {
+    Increment(counts_[GetBucket(nanoseconds)]);
+    Increment(count_);
+    if (nanoseconds > max_.load(memory_order_relaxed)) {
+        max_.store(nanoseconds, memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        Increment(counts_[bucket], other.counts_[bucket].load(memory_order_relaxed));
+    }
+    Increment(count_, other.count_.load(memory_order_relaxed));
+    max_.store(max(GetMax(), other.GetMax()), memory_order_relaxed);
+}
+
+void LatencyHistogram::Reset() {
+    for (auto& count : counts_) {
+        count.store(0, memory_order_relaxed);
+    }
+    count_.store(0, memory_order_relaxed);
+    max_.store(0, memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    return count_.load(memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetMax() const {
+    return max_.load(memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetValueAtQuantile(double quantile) const {
+    // buckets are summed again rather than trusting count_, which a recording thread may be ahead on
+    uint64_t total = 0;
+    for (const auto& count : counts_) {
+        total += count.load(memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+    const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(quantile * total + 0.5));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen += counts_[bucket].load(memory_order_relaxed);
+        if (seen >= rank) {
+            return min(GetBucketUpperBound(bucket), GetMax());
+        }
+    }
+    return GetMax();
+}
+
+// Values in [2^m, 2^(m+1)) with m >= SUB_BUCKET_BITS share 2^SUB_BUCKET_BITS buckets
+// that follow the exact ones
+size_t LatencyHistogram::GetBucket(uint64_t value) {
+    const uint64_t sub_bucket_count = uint64_t{ 1 } << SUB_BUCKET_BITS;
+    if (value < sub_bucket_count) {
+        return value;
+    }
+    const int magnitude = 63 - __builtin_clzll(value);
+    const uint64_t top_bits = value >> (magnitude - SUB_BUCKET_BITS);
+    return (magnitude - SUB_BUCKET_BITS + 1) * sub_bucket_count + (top_bits - sub_bucket_count);
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t bucket) {
+    const uint64_t sub_bucket_count = uint64_t{ 1 } << SUB_BUCKET_BITS;
+    if (bucket < sub_bucket_count) {
+        return bucket;
+    }
+    const size_t shift = bucket / sub_bucket_count - 1;
+    const uint64_t lower = (bucket % sub_bucket_count + sub_bucket_count) << shift;
+    return lower + ((uint64_t{ 1 } << shift) - 1);
+}
+
+uint32_t Tracer::Enter() {
+    return GetThreadTrace().depth++;
+}
+
+void Tracer::Exit(TraceSpan span, uint32_t depth, uint64_t start_ns, uint64_t end_ns) {
+    ThreadTrace& trace = GetThreadTrace();
+    trace.depth = depth;
+    const uint64_t duration = end_ns - start_ns;
+    trace.histograms[static_cast<size_t>(span)].Record(duration);
+    const uint64_t event = trace.event_count.load(memory_order_relaxed);
+    const size_t slot = event % RING_CAPACITY;
+    trace.starts[slot].store(start_ns, memory_order_relaxed);
+    trace.packed[slot].store(duration << 16 | uint64_t{ min<uint32_t>(depth, 255) } << 8 | static_cast<uint64_t>(span),
+        memory_order_relaxed);
+    trace.event_count.store(event + 1, memory_order_release);
+}
+
+void Tracer::MergeHistogram(TraceSpan span, LatencyHistogram& histogram) {
+    lock_guard guard(registry_mutex);
+    for (const auto& trace : registry) {
+        histogram.Merge(trace->histograms[static_cast<size_t>(span)]);
+    }
+}
+
+vector<Tracer::Event> Tracer::GetRecentEvents() {
+    vector<Event> events;
+    lock_guard guard(registry_mutex);
+    for (const auto& trace : registry) {
+        const uint64_t end = trace->event_count.load(memory_order_acquire);
+        for (uint64_t event = end - min<uint64_t>(end, RING_CAPACITY); event < end; ++event) {
+            const size_t slot = event % RING_CAPACITY;
+            const uint64_t packed = trace->packed[slot].load(memory_order_relaxed);
+            events.push_back({ static_cast<TraceSpan>(packed & 0xff), static_cast<uint32_t>(packed >> 8 & 0xff),
+                trace->starts[slot].load(memory_order_relaxed), packed >> 16 });
+        }
+    }
+    return events;
+}
+
+void Tracer::Dump(ostream& out) {
+    for (size_t span = 0; span < static_cast<size_t>(TraceSpan::COUNT); ++span) {
+        LatencyHistogram histogram;
+        MergeHistogram(static_cast<TraceSpan>(span), histogram);
+        if (histogram.GetCount() == 0) {
+            continue;
+        }
+        out << SPAN_NAMES[span] << ": "sv << histogram.GetCount() << " spans, p50 "sv
+            << histogram.GetValueAtQuantile(0.5) << " ns, p90 "sv << histogram.GetValueAtQuantile(0.9)
+            << " ns, p99 "sv << histogram.GetValueAtQuantile(0.99) << " ns, p99.9 "sv
+            << histogram.GetValueAtQuantile(0.999) << " ns, max "sv << histogram.GetMax() << " ns"sv << endl;
+    }
+}
+
+void Tracer::Reset() {
+    lock_guard guard(registry_mutex);
+    for (const auto& trace : registry) {
+        for (auto& histogram : trace->histograms) {
+            histogram.Reset();
+        }
+        trace->event_count.store(0, memory_order_relaxed);
+    }
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "log_duration.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+/**
+ * Макрос замеряет время от своего вызова до конца блока как этап запроса span
+ * (значение TraceSpan) и записывает его в трассировку текущего потока.
+ * Работает, только если программа собрана с SEARCH_SERVER_TRACING,
+ * иначе не порождает никакого кода.
+ *
+ * Пример использования:
+ *
+ *  void Parse() {
+ *      TRACE_SPAN(PARSE);
+ *      ...
+ *  }
+ *
+ *  int main() {
+ *      Parse();
+ *      Tracer::Dump(std::cerr); // Выведет перцентили длительности каждого этапа
+ *  }
+ */
+#ifdef SEARCH_SERVER_TRACING
+#define TRACE_SPAN(span) TraceScope PROFILE_CONCAT(traceScope, __LINE__)(TraceSpan::span)
+#else
+#define TRACE_SPAN(span) static_cast<void>(0)
+#endif
+
+// Stages of a query; QUERY encloses the others. The document predicate runs inside
+// POSTING_SCAN: timing it per posting would cost more than the check itself
+enum class TraceSpan : uint8_t {
+    QUERY,
+    PARSE,
+    MINUS_FILTER,
+    POSTING_SCAN,
+    COLLECT,
+    TOP_K,
+    SERIALIZE,
+    COUNT,
+};
+
+std::string_view GetTraceSpanName(TraceSpan span);
+
+// Counts of nanosecond latencies in log-linear buckets, as in HdrHistogram: values below
+// 2^SUB_BUCKET_BITS are exact, larger ones keep SUB_BUCKET_BITS bits after the leading one,
+// so a quantile is off by at most 1/2^SUB_BUCKET_BITS. One thread records, any may read
+class LatencyHistogram {
+public:
+    void Record(uint64_t nanoseconds);
+    void Merge(const LatencyHistogram& other);
+    // Not synchronised with Record: values recorded meanwhile may be lost
+    void Reset();
+
+    uint64_t GetCount() const;
+    uint64_t GetMax() const;
+    // Upper bound of the bucket below which the quantile (0..1] of the values lies, 0 if empty
+    uint64_t GetValueAtQuantile(double quantile) const;
+
+    static constexpr int SUB_BUCKET_BITS = 5;
+
+private:
+    static constexpr size_t BUCKET_COUNT = size_t{ 65 - SUB_BUCKET_BITS } << SUB_BUCKET_BITS;
+
+    static size_t GetBucket(uint64_t value);
+    static uint64_t GetBucketUpperBound(size_t bucket);
+
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> counts_{};
+    std::atomic<uint64_t> count_{ 0 };
+    std::atomic<uint64_t> max_{ 0 };
+};
+
+// Spans of every thread go to that thread's own ring buffer of recent events and its own
+// histograms, so recording takes no locks. A thread registers on its first span and its
+// data is kept after it exits
+class Tracer {
+public:
+    struct Event {
+        TraceSpan span;
+        // number of spans of the thread enclosing this one
+        uint32_t depth;
+        uint64_t start_ns;
+        uint64_t duration_ns;
+    };
+
+    static const size_t RING_CAPACITY = 4096;
+
+    // Nanoseconds of steady_clock
+    static uint64_t Now() {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Both are called by TraceScope: Enter returns the depth of the new span
+    static uint32_t Enter();
+    static void Exit(TraceSpan span, uint32_t depth, uint64_t start_ns, uint64_t end_ns);
+
+    // Adds the spans of all threads to the histogram
+    static void MergeHistogram(TraceSpan span, LatencyHistogram& histogram);
+    // Up to RING_CAPACITY last spans of every thread in the order they ended. An event
+    // read while its thread overwrites it may mix fields of two spans
+    static std::vector<Event> GetRecentEvents();
+    // Prints count, quantiles and maximum of every span recorded
+    static void Dump(std::ostream& out);
+    // Clears the histograms and ring buffers of all threads; spans recorded meanwhile may be lost
+    static void Reset();
+};
+
+// Times its own lifetime as the given span
+class TraceScope {
+public:
+    explicit TraceScope(TraceSpan span)
+        : span_(span)
+        , depth_(Tracer::Enter())
+        , start_ns_(Tracer::Now()) {
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    ~TraceScope() {
+        Tracer::Exit(span_, depth_, start_ns_, Tracer::Now());
+    }
+
+private:
+    const TraceSpan span_;
+    const uint32_t depth_;
+    const uint64_t start_ns_;
+};
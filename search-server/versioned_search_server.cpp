@@ -0,0 +1,177 @@
+#include "versioned_search_server.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+vector<Document> VersionedSearchServer::Snapshot::FindTopDocuments(QueryContext& context, string_view raw_query,
+    DocumentStatus status, size_t max_result_count) const {
+    return FindTopDocuments(context, raw_query, [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    }, max_result_count);
+}
+
+vector<Document> VersionedSearchServer::Snapshot::FindTopDocuments(string_view raw_query, DocumentStatus status,
+    size_t max_result_count) const {
+    QueryContext context;
+    return FindTopDocuments(context, raw_query, status, max_result_count);
+}
+
+tuple<vector<string_view>, DocumentStatus> VersionedSearchServer::Snapshot::MatchDocument(string_view raw_query,
+    int document_id) const {
+    const SearchServer* index = FindIndex(document_id);
+    if (index == nullptr) {
+        throw out_of_range("out_of_range");
+    }
+    return index->MatchDocument(raw_query, document_id);
+}
+
+map<string_view, double> VersionedSearchServer::Snapshot::GetWordFrequencies(int document_id) const {
+    const SearchServer* index = FindIndex(document_id);
+    if (index == nullptr) {
+        return {};
+    }
+    return index->GetWordFrequencies(document_id);
+}
+
+int VersionedSearchServer::Snapshot::GetDocumentCount() const {
+    return base_->GetDocumentCount() - static_cast<int>(removed_->size()) + delta_->GetDocumentCount();
+}
+
+bool VersionedSearchServer::Snapshot::ContainsDocument(int document_id) const {
+    return FindIndex(document_id) != nullptr;
+}
+
+uint64_t VersionedSearchServer::Snapshot::GetGeneration() const {
+    return generation_;
+}
+
+// An id removed from the base may have been added again, so the delta goes first
+const SearchServer* VersionedSearchServer::Snapshot::FindIndex(int document_id) const {
+    if (delta_->ContainsDocument(document_id)) {
+        return delta_.get();
+    }
+    return IsLiveInBase(document_id) ? base_.get() : nullptr;
+}
+
+bool VersionedSearchServer::Snapshot::IsLiveInBase(int document_id) const {
+    return base_->ContainsDocument(document_id) && removed_->count(document_id) == 0;
+}
+
+VersionedSearchServer::Writer::Writer(Snapshot& next)
+    : next_(next) {
+}
+
+void VersionedSearchServer::Writer::AddDocument(int document_id, string_view document, DocumentStatus status,
+    const vector<int>& ratings) {
+    if (next_.IsLiveInBase(document_id)) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    GetDelta().AddDocument(document_id, document, status, ratings);
+    ++next_.change_count_;
+}
+
+void VersionedSearchServer::Writer::AddDocuments(const vector<NewDocument>& documents) {
+    for (const NewDocument& document : documents) {
+        if (next_.IsLiveInBase(document.id)) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+    }
+    GetDelta().AddDocuments(documents);
+    next_.change_count_ += documents.size();
+}
+
+void VersionedSearchServer::Writer::RemoveDocument(int document_id) {
+    if (next_.delta_->ContainsDocument(document_id)) {
+        GetDelta().RemoveDocument(document_id);
+        ++next_.change_count_;
+        return;
+    }
+    if (!next_.IsLiveInBase(document_id)) {
+        return;
+    }
+    if (!removed_) {
+        // copied once per generation, like the delta
+        removed_ = make_shared<unordered_set<int>>(*next_.removed_);
+        next_.removed_ = removed_;
+        removed_word_freqs_ = make_shared<Snapshot::WordCounts>(*next_.removed_word_freqs_);
+        next_.removed_word_freqs_ = removed_word_freqs_;
+    }
+    removed_->insert(document_id);
+    for (const auto& [word, freq] : next_.base_->GetWordFrequencies(document_id)) {
+        ++(*removed_word_freqs_)[string(word)];
+    }
+    ++next_.change_count_;
+}
+
+// Readers of the current generation may hold the delta, so it is copied once per
+// generation; the copy is small because the delta is folded regularly
+SearchServer& VersionedSearchServer::Writer::GetDelta() {
+    if (!delta_) {
+        delta_ = make_shared<SearchServer>(*next_.delta_);
+        next_.delta_ = delta_;
+    }
+    return *delta_;
+}
+
+VersionedSearchServer::VersionedSearchServer(SearchServer search_server)
+    : VersionedSearchServer(move(search_server), Options{}) {
+}
+
+VersionedSearchServer::VersionedSearchServer(SearchServer search_server, const Options& options)
+    : options_({ max<size_t>(1, options.fold_threshold) })
+    , empty_index_(search_server.MakeEmpty()) {
+    Snapshot snapshot;
+    snapshot.base_ = make_shared<const SearchServer>(move(search_server));
+    snapshot.delta_ = make_shared<const SearchServer>(empty_index_);
+    snapshot.removed_ = make_shared<const unordered_set<int>>();
+    snapshot.removed_word_freqs_ = make_shared<const Snapshot::WordCounts>();
+    current_ = make_shared<const Snapshot>(move(snapshot));
+}
+
+shared_ptr<const VersionedSearchServer::Snapshot> VersionedSearchServer::GetSnapshot() const {
+    return atomic_load(&current_);
+}
+
+void VersionedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status,
+    const vector<int>& ratings) {
+    Modify([&](Writer& writer) {
+        writer.AddDocument(document_id, document, status, ratings);
+    });
+}
+
+void VersionedSearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    Modify([&documents](Writer& writer) {
+        writer.AddDocuments(documents);
+    });
+}
+
+void VersionedSearchServer::RemoveDocument(int document_id) {
+    Modify([document_id](Writer& writer) {
+        writer.RemoveDocument(document_id);
+    });
+}
+
+void VersionedSearchServer::Publish(Snapshot next) {
+    ++next.generation_;
+    atomic_store(&current_, shared_ptr<const Snapshot>(make_shared<const Snapshot>(move(next))));
+}
+
+// Copies the base, which shares its columns until they are written, and applies the
+// changes to the copy; the generations before the fold keep the old base
+void VersionedSearchServer::Fold(Snapshot& next) const {
+    auto base = make_shared<SearchServer>(*next.base_);
+    base->RemoveDocuments(vector<int>(next.removed_->begin(), next.removed_->end()));
+    base->AddDocumentsFrom(*next.delta_, [](int) {
+        return true;
+    });
+    // nobody iterates the copy yet, so this is a safe point to drop the removed documents
+    base->CompactIfSparse();
+    next.base_ = move(base);
+    next.delta_ = make_shared<const SearchServer>(empty_index_);
+    next.removed_ = make_shared<const unordered_set<int>>();
+    next.removed_word_freqs_ = make_shared<const Snapshot::WordCounts>();
+    next.change_count_ = 0;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "document.h"
+#include "query_context.h"
+#include "search_server.h"
+#include "top_documents.h"
+
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Serves queries from immutable generations of the index while it is being changed.
+// A reader takes the current generation and queries it; it never sees later changes and
+// never waits for writers. A generation is a large base index shared by every generation
+// since the last fold, a small delta index with the documents added since then, and the
+// tombstoned ids of removed base documents. A write copies only the delta and the
+// tombstones, so it costs O(changes since the fold) instead of a copy of the whole index.
+// Once the changes reach the fold threshold, the writer applies them to a copy of the
+// base, which shares the unchanged columns, and publishes it as the new base.
+// A generation is freed when its last reader lets it go.
+class VersionedSearchServer {
+public:
+    struct Options {
+        // changes kept beside the base before they are folded into a new one
+        size_t fold_threshold = 256;
+    };
+
+    class Snapshot {
+    public:
+        template <typename DocumentPredicate>
+        std::vector<Document> FindTopDocuments(QueryContext& context, std::string_view raw_query,
+            DocumentPredicate document_predicate, size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+        std::vector<Document> FindTopDocuments(QueryContext& context, std::string_view raw_query,
+            DocumentStatus status = DocumentStatus::ACTUAL, size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+        std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+            size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+        // Views point into the generation and stay valid for as long as it is held
+        std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+        std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+        int GetDocumentCount() const;
+        bool ContainsDocument(int document_id) const;
+        // Grows with every published generation
+        uint64_t GetGeneration() const;
+
+    private:
+        friend class VersionedSearchServer;
+        using WordCounts = std::map<std::string, int, std::less<>>;
+
+        // Returns nullptr if no live document has the id
+        const SearchServer* FindIndex(int document_id) const;
+        bool IsLiveInBase(int document_id) const;
+
+        std::shared_ptr<const SearchServer> base_;
+        std::shared_ptr<const SearchServer> delta_;
+        // base documents removed since the fold
+        std::shared_ptr<const std::unordered_set<int>> removed_;
+        // for every word, removed base documents that still contain it
+        std::shared_ptr<const WordCounts> removed_word_freqs_;
+        size_t change_count_ = 0;
+        uint64_t generation_ = 0;
+    };
+
+    // Changes of one generation. The delta and the tombstones are each copied once, on
+    // the first write to them, so a generation of n changes costs one copy plus O(n)
+    class Writer {
+    public:
+        // Throw invalid_argument like SearchServer, before anything is changed
+        void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+        void AddDocuments(const std::vector<NewDocument>& documents);
+        void RemoveDocument(int document_id);
+
+    private:
+        friend class VersionedSearchServer;
+        explicit Writer(Snapshot& next);
+        SearchServer& GetDelta();
+
+        Snapshot& next_;
+        std::shared_ptr<SearchServer> delta_;
+        std::shared_ptr<std::unordered_set<int>> removed_;
+        std::shared_ptr<Snapshot::WordCounts> removed_word_freqs_;
+    };
+
+    explicit VersionedSearchServer(SearchServer search_server);
+    VersionedSearchServer(SearchServer search_server, const Options& options);
+
+    // The returned generation stays valid and unchanged for as long as it is held
+    std::shared_ptr<const Snapshot> GetSnapshot() const;
+
+    // Each call publishes one generation; writers run one at a time
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void AddDocuments(const std::vector<NewDocument>& documents);
+    void RemoveDocument(int document_id);
+
+    // Applies all changes made by update(Writer&) in one generation. If update
+    // throws, nothing is published and the exception propagates
+    template <typename Update>
+    void Modify(Update update);
+
+private:
+    // Called with writer_mutex_ held
+    void Publish(Snapshot next);
+    // Rebuilds the base with the live documents of the base and the delta
+    void Fold(Snapshot& next) const;
+
+    const Options options_;
+    const SearchServer empty_index_;
+
+    std::mutex writer_mutex_;
+    // read with std::atomic_load and replaced with std::atomic_store
+    std::shared_ptr<const Snapshot> current_;
+};
+
+template <typename DocumentPredicate>
+std::vector<Document> VersionedSearchServer::Snapshot::FindTopDocuments(QueryContext& context, std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t max_result_count) const {
+    if (change_count_ == 0) {
+        const auto& found = base_->FindTopDocuments(context, raw_query, document_predicate, max_result_count);
+        return { found.begin(), found.end() };
+    }
+    // the base and the delta ask for the same words, so each is counted once
+    std::vector<std::pair<std::string_view, double>> idfs;
+    const auto idf = [this, &idfs](std::string_view word) {
+        for (const auto& [known_word, known_idf] : idfs) {
+            if (known_word == word) {
+                return known_idf;
+            }
+        }
+        auto freq = static_cast<int64_t>(base_->GetDocumentFrequency(word) + delta_->GetDocumentFrequency(word));
+        if (const auto it = removed_word_freqs_->find(word); it != removed_word_freqs_->end()) {
+            freq -= it->second;
+        }
+        const double result = freq > 0 ? std::log(GetDocumentCount() * 1.0 / freq) : 0.0;
+        idfs.push_back({ word, result });
+        return result;
+    };
+
+    TopDocuments top_documents(max_result_count);
+    for (const Document& document : delta_->FindTopDocuments(context, raw_query, document_predicate, max_result_count, idf)) {
+        top_documents.Add(document);
+    }
+    const auto& found = base_->FindTopDocuments(context, raw_query,
+        [this, &document_predicate](int document_id, DocumentStatus status, int rating) {
+            return removed_->count(document_id) == 0 && document_predicate(document_id, status, rating);
+        }, max_result_count, idf);
+    for (const Document& document : found) {
+        top_documents.Add(document);
+    }
+    return top_documents.Extract();
+}
+
+template <typename Update>
+void VersionedSearchServer::Modify(Update update) {
+    std::lock_guard guard(writer_mutex_);
+    // only writers replace current_, so it is stable while the lock is held
+    Snapshot next = *current_;
+    Writer writer(next);
+    update(writer);
+    if (next.change_count_ >= options_.fold_threshold) {
+        Fold(next);
+    }
+    Publish(std::move(next));
+}